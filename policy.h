@@ -0,0 +1,645 @@
+/*
+ * Generated by wumplus --seed 1 --train 300000, do not edit. The best
+ * action for every policy_state(), '.' to ask the kb.
+ */
+static const char policy_table[POLICY_STATES + 1] =
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "........................w...................w....w....w........."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".......................s...................ss..................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "...........................................s...................."
+  "................................................................"
+  "................................................................"
+  "...........ww..................................................."
+  "................................................................"
+  ".......................sw..................sw.........w........s"
+  "................................................................"
+  "................................................................"
+  "...........s...................................................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "............................................w..................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "..........................................es...................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "..........................................e....................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "......................e...................e.........e.........e."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "..........................................e....................."
+  "................................................................"
+  "................................................................"
+  "..........e....................................................."
+  "................................................................"
+  "..........................................s....................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "......................es..................es........es.........."
+  "................................................................"
+  "................................................................"
+  "............w..................................................."
+  "................................................................"
+  ".......................ew.........w.......esw.........w........."
+  "................................................................"
+  "................................................................"
+  "..........es...................................................."
+  "................................................................"
+  "..........................................e....................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "..........................................e.w..................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "...........................................s...................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "...........................................sw..................."
+  "................................................................"
+  "................................................................"
+  "...........s...................................................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".....................n...................n..n..................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".........................................n......................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".........................................n......................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".........................................n......................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".nsse.ne...n...................................................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".................................n.ww..........................."
+  "................................................................"
+  "................................................................"
+  ".neen......n..w................................................."
+  "................................................................"
+  "...................................e............................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".n..n..........................................................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".....................n...................n......................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".........n......................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".................................ns.w......n...................."
+  "................................................................"
+  "................................................................"
+  ".nesn......n...................................................."
+  "................................................................"
+  ".................................snn.......n...................."
+  "................................................................"
+  "................................................................"
+  ".........................................n......................"
+  "................................................................"
+  ".................................nnww......n..w................."
+  "................................................................"
+  "................................................................"
+  ".nnnn......n..w................................................."
+  "................................................................"
+  ".................................nnn.......n...................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".................................nn.n..........................."
+  "................................................................"
+  "................................................................"
+  ".ne.n..........................................................."
+  "................................................................"
+  ".................................n.............................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".n.ss..........................................................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "...................................ww..........................."
+  "................................................................"
+  "................................................................"
+  ".n.nn..........................................................."
+  "................................................................"
+  ".................................n.n............................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".n..n..........................................................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".....................n...................n.........n.........n.."
+  "................................................................"
+  ".....................................................w.........."
+  ".........w..w..................................................."
+  "................................................................"
+  ".....................n..w................n..w......n............"
+  "w..............................................................."
+  ".....................................................n.........."
+  ".........n....n....n.........n.................................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".......................s.................s.s...................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".....................n.s.......n.........n.sw......n............"
+  "................................................................"
+  "................................................................"
+  ".........n.s.......n............................................"
+  "................................................................"
+  ".........................................n......................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".........................................n..w..................."
+  "................................................................"
+  "................................................................"
+  ".........n......................................................"
+  "................................................................"
+  ".....................e...................e......................"
+  "................................................................"
+  "................................................................"
+  ".........e......................................................"
+  "................................................................"
+  ".........................................ee....................."
+  "................................................................"
+  "................................................................"
+  ".........e......................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".................................ee.w....w.w...................."
+  ".................................................g.............."
+  "................................................................"
+  ".eess......n...................................................."
+  "..................g............................................."
+  ".................................ee...se...n...................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".................................ee.w......w...................."
+  "................................................................"
+  "................................................................"
+  ".eeee......n...................................................."
+  "................................................................"
+  ".................................e.e.......n...................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".................................ee.e..........................."
+  "................................................................"
+  "................................................................"
+  ".e..e......n...................................................."
+  "................................................................"
+  ".................................ee............................."
+  "................................................................"
+  "................................................................"
+  ".....................ne..................ne........n............"
+  "................................................................"
+  "........................................................w......."
+  "............w......w............................................"
+  "................................................................"
+  "......................e.w......n..........e.w......n............"
+  "................................................................"
+  ".....................................................ne........."
+  ".........ne........n............................................"
+  "................................................................"
+  ".........................................s.s...................."
+  "................................................................"
+  ".................................ws.w....w.w...................."
+  "....................................................g..........."
+  "................................................................"
+  ".ssss...s..n...................................................."
+  "................................................................"
+  ".................................sss....s..n...................."
+  "................................................................"
+  "................................................................"
+  ".....................n.s.......n.........nes.......n............"
+  "................................................................"
+  ".................................wwsw......w...................."
+  "................................................................"
+  "................................................................"
+  ".nesw......n.sw................................................."
+  ".................g.............................................."
+  ".................................nes..n....n.s.................."
+  "................................................................"
+  "................................................................"
+  "..........................................e....................."
+  "................................................................"
+  ".................................we........n...................."
+  "................................................................"
+  "................................................................"
+  ".ne.w......n..w................................................."
+  "................................................................"
+  ".................................ne........n...................."
+  "................................................................"
+  "................................................................"
+  ".....................n...................n......................"
+  "................................................................"
+  "................................................................"
+  "............w..................................................."
+  "................................................................"
+  ".........................................n..w..................."
+  "................................................................"
+  "................................................................"
+  ".........n......................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".................................w..w......w...................."
+  "................................................................"
+  "................................................................"
+  ".s.ss......n...................................................."
+  "................................................................"
+  ".................................s.s............................"
+  "................................................................"
+  "................................................................"
+  ".........................................n......................"
+  "................................................................"
+  ".................................w.ww......n...................."
+  "................................................................"
+  "................................................................"
+  ".n.sw......n..w................................................."
+  "................................................................"
+  ".................................n.s.......n...................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".................................w..w..........................."
+  "................................................................"
+  "................................................................"
+  ".n..w......n...................................................."
+  "................................................................"
+  ".................................n.............................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "........................w...................w....w....w........."
+  "w..............................................................."
+  ".........................................................E......"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "...........................................s...................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "...........................................s...................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  ".......................sw..................sw.........w........."
+  "................................................................"
+  "................................................................"
+  "...........s...................................................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "............................................w..................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "..ess..e......w................................................."
+  "..................g............................................."
+  ".......................................e........................"
+  "................................................................"
+  "................................................................"
+  "..........................................e....................."
+  "................................................................"
+  "...................................ww..........................."
+  "................................................................"
+  "................................................................"
+  "..eee.........w................................................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "..e.e..........................................................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "......................e...................e....................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "..........................................e.w.........w........."
+  "................................................................"
+  "................................................................"
+  "..........e....................................................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "..................................s............................."
+  "................................................................"
+  "................................................................"
+  "..sss..es.....w................................................."
+  "................................................................"
+  "..................................ss...es......................."
+  "................................................................"
+  "................................................................"
+  "..........................................es...................."
+  "................................................................"
+  "..................................ww............................"
+  "................................................................"
+  "................................................................"
+  "..esw.......esw................................................."
+  "................................................................"
+  "..................................es........es.................."
+  "................................................................"
+  "................................................................"
+  "..........................................e....................."
+  "................................................................"
+  "..................................e.w..........................."
+  "................................................................"
+  "................................................................"
+  "..e.w.........w................................................."
+  "................................................................"
+  "..................................e............................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "............................................w..................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "...ss...s......................................................."
+  "................................................................"
+  "........................................s......................."
+  "................................................................"
+  "................................................................"
+  "...........................................s...................."
+  "................................................................"
+  "...................................sw..........................."
+  "................................................................"
+  "................................................................"
+  "...sw.........w................................................."
+  "................................................................"
+  "...................................s............................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "....w..........................................................."
+  "................................................................"
+  "................................................................"
+  "................................................................"
+  "................................................................";
@@ -17,21 +17,160 @@
  * This one had to be written from naught.
  *
  * How to compile:
- * gcc -Os -Wall -lsqlite3 -lm -o wumplus wumpus.c
+ * gcc -Os -Wall -o wumplus wumpus.c -lsqlite3 -lm -lpthread
  *
  * How to use to play the game:
  * ./wumplus
  *
+ * Add --raw to take every key as soon as it is pressed instead of waiting for
+ * Enter. The arrow keys move too, and the screen is redrawn in place where it
+ * changed instead of scrolling.
+ *
  * How to use to make the agent play:
  * ./wumplus --agent
  *
+ * Either mode takes --seed N to replay the same map (and agent choices).
+ * The agent also takes --speculate to plan its next move on another thread
+ * while the current one is carried out, and --move-budget-us N to give it only
+ * N microseconds to think about each move. --size N plays on an N by N map,
+ * and on big ones --hpa switches the agent to hierarchical pathfinding.
+ * --procedural makes the map up as the player gets to it instead of all at
+ * once, so --size can be just about anything.
+ *
+ * Compile with -DWUMPUS_PACKED_MAP to store the map in two bits per square,
+ * which is worth it when holding lots of games or really big maps. Compile
+ * with -DWUMPUS_TILED_KB to keep the kb in bit plane tiles instead of SQLite,
+ * then it only grows with the part of the map the agent has seen, and
+ * -lsqlite3 can be left off.
+ *
+ * The agent's habits can be changed with --shoot first|last|never (when to
+ * fire at a wumpus it has found), --pick random|nearest (which safe square to
+ * explore next), --repick (pick again every turn instead of walking all the
+ * way there) and --give-up N (head home after N steps). --tune N searches
+ * those for the best scoring mix, starting every candidate on N games and
+ * keeping only the best third each round. --jobs N plays that many games at
+ * once, it defaults to one per CPU.
+ *
+ * --train N FILE teaches the agent a policy from N games of Q-learning and
+ * writes it out as C. Build with -DWUMPUS_POLICY and the policy in policy.h,
+ * and --policy has the agent take its moves from the table wherever it has
+ * one instead of asking the kb, a table lookup instead of a search. A table
+ * that scores worse than the kb alone is not written. The one in policy.h
+ * came from --seed 1 --train 300000 with the tiled kb and took a few minutes.
+ *
+ * --lookahead N has the agent look N moves ahead before each move, weighing
+ * up how every move could turn out, and go against the kb when that looks
+ * clearly better. It is also how the agent decides to take a risk once the kb
+ * runs out of safe squares. Each look gets 50ms unless --move-budget-us says
+ * otherwise, it stops at the last depth it got all the way through.
+ *
+ * --spectate FILE lets other processes watch games as they are played, even
+ * headless ones from --bench or --tune, without slowing them down. Point it
+ * at a file in /dev/shm and run ./wumplus --watch FILE to see them.
+ *
+ * --make-maps N FILE makes N maps, starting at --seed and going up, and saves
+ * them to FILE. --maps FILE then has the agent play every one of them as fast
+ * as it can, --jobs at a time, without making any maps itself. Add --map N to
+ * play just the N'th one, counting from 0, yourself or with --agent.
+ *
+ * --games N plays N maps the same way without a file, the ones --seed on
+ * would make.
+ *
+ * To spread one run over more processes or machines, give each of them
+ * --shard I/N, I counting from 0, to play only the I'th of N slices of the
+ * maps, and --summary FILE to write how it went. Then ./wumplus --merge FILE...
+ * adds all of the summaries up and shows just what one run would have, apart
+ * from games/sec, which is for one process:
+ *
+ *   for i in 0 1 2 3; do ./wumplus --maps m --shard $i/4 --summary s$i & done
+ *   wait; ./wumplus --merge s0 s1 s2 s3
+ *
+ * With --games every shard needs the same --seed, the slices are of the seeds
+ * from there on. --merge fails if a shard is missing, --merge-partial FILE...
+ * shows what the ones that are there came to anyway.
+ *
+ * --enumerate has the agent play every single map the game can make at --size
+ * and tells exactly how likely it is to win, with no luck of the draw in it.
+ * The agent's own random choices still come from --seed, so the answer is
+ * exact for that seed and another one can come out a little different. A map
+ * and its mirror image along the diagonal are only played once, which is
+ * very nearly the same; --enumerate-all plays both. There are 47040 maps at
+ * --size 5, about 20 CPU seconds with the SQLite kb or a fifth of one with
+ * -DWUMPUS_TILED_KB, and 377 million at --size 6, tens of CPU hours with the
+ * SQLite kb or about one tiled.
+ *
+ * --kb-heap N gives the SQLite kb N megabytes up front to allocate everything
+ * from, its page cache included, instead of going to malloc() for every query.
+ * How much of it got used is shown when the program exits.
+ *
+ * --counters adds up what the CPU's hardware counters saw during every part of
+ * a turn, how many cycles and instructions it took, how often it missed the L1
+ * and last level caches and how many branches it got wrong, and shows them at
+ * the end of the game or benchmark. It needs perf_event_open(), so on Linux
+ * /proc/sys/kernel/perf_event_paranoid has to be 2 or less.
+ *
+ * --log FILE writes down everything that happens in every game as it is
+ * played: moves, bumps, food, shots, kills, gold and deaths, every action
+ * taken and everything the kb learns or forgets. --log-level 1 keeps just the
+ * first lot, 2 the actions as well. Games hand their events to a writer
+ * thread instead of waiting on the file, so big --maps runs can keep a log
+ * too. With --speculate what the planner tells the kb is not in it. Print a
+ * log with ./wumplus --read-log FILE.
+ *
+ * --hunt N FILE looks for the maps the agent does worst on, the rare ones
+ * random maps hardly ever turn up. It starts from the maps of --seed on, plays
+ * them --jobs at a time, keeps the worst third and makes the rest over from
+ * those with a pit, a wall, the gold, the wumpus or the supmuw moved, for N
+ * rounds. --cost steps|latency|kb|loss says what worst is: the most steps,
+ * the slowest decision, the most kb lookups a decision, or the furthest short
+ * of the best score the map allows. The worst maps it found are written to
+ * FILE, to be played again with --maps FILE.
+ *
+ * --ab N OPTIONS plays the agent as the command line sets it up (A) against
+ * the same agent with OPTIONS on top (B), like --ab 5000 "--shoot last", on
+ * the same maps, and says if B scores better, worse or no different. The two
+ * games on a map are compared with each other instead of adding up each side,
+ * so the luck of the maps cancels out, and Wald's sequential test stops as
+ * soon as it is 95% sure either way. N is only the most maps it may take.
+ * --ab-delta N is the smallest difference in score a game that is worth
+ * finding, 25 by default. It plays the maps from --seed on, or the ones of
+ * --maps FILE. The wins, steps and time a decision are compared as well.
+ *
+ * How to benchmark the agent against the checked-in corpus:
+ * ./wumplus --bench bench/corpus.txt
+ *
+ * The corpus is a list of seeded maps in tiers along with the outcome the
+ * agent got on each of them. The benchmark plays every map headless and tells
+ * you if the agent got faster, slower, better or worse, and exits with 1 if it
+ * got worse. The corpus is played several times and the median pass is the
+ * speed that counts, but the perf lines are only good for the machine they
+ * were recorded on, so being slower only fails the run with --bench-strict.
+ * Once a change is known to be good, record the new outcomes with
+ * --bench-update instead. Put --skip-impossible before either of them to
+ * leave out maps nobody can win.
+ *
  */
 #include <stdio.h>
 #include <time.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef WUMPUS_TILED_KB
 #include <sqlite3.h>
+#endif
 #include <math.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <signal.h>
+#include <termios.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <linux/perf_event.h>
 
 /* Constants for map elements */
 #define MAP_SIZE 14
@@ -44,6 +183,35 @@
 #define MAP_GOLD 'G'
 #define MAP_SUPMUW 'S'
 
+/*
+ * Packed map terrain, four squares to a byte. Only walls and pits can be
+ * anywhere on the map, there is just one wumpus, gold and supmuw so those are
+ * kept as coordinates instead.
+ */
+#define MAP_CELL_EMPTY 0
+#define MAP_CELL_WALL 1
+#define MAP_CELL_PIT 2
+
+/* kinds of maps the generator can make */
+#define MAP_KIND_RANDOM 0
+#define MAP_KIND_MAZE 1
+#define MAP_KIND_PROCEDURAL 2
+
+/*
+ * Procedural maps are made MAP_CHUNK squares on a side at a time, the first
+ * time anything looks at them, from the game seed and where the chunk is. The
+ * same seed always makes the same chunk no matter when it gets made.
+ */
+#define MAP_CHUNK_BITS 6
+#define MAP_CHUNK (1 << MAP_CHUNK_BITS)
+/* the most of a procedural map print_map() shows, around the player */
+#define MAP_VIEW 32
+
+/* what it takes to win a map, see classify_map() */
+#define MAP_CLASS_SOLVABLE 0
+#define MAP_CLASS_RISKY 1
+#define MAP_CLASS_IMPOSSIBLE 2
+
 /* Constants for percepts */
 #define PERCEPT_BUMP 1
 #define PERCEPT_SMELL 2
@@ -73,32 +241,850 @@
 #define SCORE_FOOD 100
 #define SCORE_MIN -1000
 
-/* queue elements for determining a path to a place, needs x,y in one bucket */
+/* a square on the map, needs x,y in one bucket */
 typedef struct COORD {
   int x, y;
 } coordinate;
 
+typedef struct CHUNK {
+  int cx, cy;
+  struct CHUNK *next;
+  char cells[MAP_CHUNK * MAP_CHUNK];
+} chunk;
+
+/*
+ * The search shortest_path() does. Every row of the map is a run of words
+ * with a bit per square, square x of row y is bit x % 64 of word
+ * y * words + x / 64. front is the layer of the search that is n steps out,
+ * only on rows top to bottom, and next the one after it.
+ */
+typedef struct WAVEFRONT {
+  int n, words, top, bottom;
+  unsigned long long *open, *seen, *front, *next;
+} wavefront;
+
+/*
+ * Hierarchical pathfinding, see hpa_shortest_path(). The map is cut into
+ * clusters HPA_CLUSTER squares on a side, and each cluster keeps what the kb
+ * says about its squares along with the entrances on its edges. A side of 16
+ * squares has at most 8 runs of open squares, so 4 sides have at most 32.
+ */
+#define HPA_CLUSTER 16
+#define HPA_ENTRANCES (4 * HPA_CLUSTER / 2)
+#define HPA_SAFE 1
+#define HPA_WALL 2
+
+typedef struct CLUSTER {
+  unsigned char cells[HPA_CLUSTER * HPA_CLUSTER];
+  int dirty, entrances;
+  coordinate entrance[HPA_ENTRANCES];
+  /* steps between two entrances inside the cluster, -1 for no way */
+  short int dist[HPA_ENTRANCES][HPA_ENTRANCES];
+} cluster;
+
+typedef struct PATHFINDER {
+  /* clusters on a side, made when the kb first learns about them */
+  int width;
+  cluster **clusters;
+  /* search state per entrance, only good where seen matches stamp */
+  int stamp, *seen, *cost, *from;
+  long long *heap;
+  int heap_size, heap_cap;
+} pathfinder;
+
+#ifdef WUMPUS_TILED_KB
+/*
+ * The tiled kb. Facts live in tiles of KB_TILE by KB_TILE squares with a bit
+ * plane for every kind of sentence, one word to a row. Tiles come out of an
+ * arena KB_ARENA tiles at a time the first time a fact is put in them and are
+ * found through a small hash table on their tile coordinates.
+ */
+#define KB_TILE_BITS 6
+#define KB_TILE (1 << KB_TILE_BITS)
+#define KB_SENTENCES 12
+#define KB_ARENA 16
+
+typedef struct KB_TILE_PLANES {
+  int tx, ty;
+  unsigned long long planes[KB_SENTENCES][KB_TILE];
+} kb_tile;
+
+typedef struct KNOWLEDGE {
+  /* open addressing on the tile coordinates, -1 for an empty slot */
+  int *slots, slot_count;
+  /* the arena, tiles never move once they are made */
+  kb_tile **blocks;
+  int tiles, block_count;
+  /* safe squares in the order they were learned, see kb_insert() */
+  coordinate *safe;
+  int safe_count, safe_cap;
+} knowledge;
+#else
+typedef sqlite3 knowledge;
+#endif
+
+/* maps bigger than this are too big for oracle_score() */
+#define ORACLE_MAXSIZE 128
+
+/*
+ * Latency histogram, HDR style. Values are bucketed by their highest bit and
+ * then split linearly into 2^HIST_SUB_BITS sub-buckets, so every bucket is
+ * within about 3% of the values in it no matter how big they get. Recording is
+ * a couple of shifts and an increment. The slowest few values are kept along
+ * with the seed and turn they came from so they can be replayed.
+ */
+#define HIST_SUB_BITS 5
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS) << HIST_SUB_BITS)
+#define HIST_WORST 3
+
+typedef struct SLOWEST {
+  long long ns;
+  unsigned int seed;
+  int turn;
+} slowest;
+
+typedef struct HISTOGRAM {
+  long long count, max;
+  unsigned int buckets[HIST_BUCKETS];
+  slowest worst[HIST_WORST];
+} histogram;
+
+/* the agent's habits, see kb_ask_action() and run_tune() */
+#define SHOOT_FIRST 0
+#define SHOOT_LAST 1
+#define SHOOT_NEVER 2
+#define PICK_RANDOM 0
+#define PICK_NEAREST 1
+
+typedef struct TUNING {
+  /* when to shoot a wumpus it has found, how to pick where to explore */
+  int shoot, pick;
+  /* pick a new square every turn, head home after this many steps or 0 */
+  int repick, give_up;
+} tuning;
+
+static const char *shoot_names[] = { "first", "last", "never" };
+static const char *pick_names[] = { "random", "nearest" };
+
+/* rounds of the autotuner keep the best 1 in TUNE_KEEP of the candidates */
+#define TUNE_KEEP 3
+
+/*
+ * --ab stops when Wald's test has AB_ERROR chance of being wrong either way,
+ * but not before AB_MIN pairs so the spread of the differences is known. the
+ * games are played AB_BATCH pairs at a time.
+ */
+#define AB_DELTA 25
+#define AB_ERROR 0.05
+#define AB_MIN 30
+#define AB_BATCH 64
+
+/* what --ab compares, and what it can tell */
+#define AB_SCORE 0
+#define AB_WON 1
+#define AB_STEPS 2
+#define AB_DECISION 3
+#define AB_METRICS 4
+#define AB_UNDECIDED 0
+#define AB_BETTER 1
+#define AB_WORSE 2
+#define AB_SAME 3
+
+static const char *ab_metric_names[] = { "score", "won %", "steps", "us/move" };
+static const char *ab_verdicts[] = {
+  "undecided", "B is better", "B is worse", "no difference"
+};
+
+/* what makes a map bad for --hunt, see hunt_cost() */
+#define HUNT_STEPS 0
+#define HUNT_LATENCY 1
+#define HUNT_KB 2
+#define HUNT_LOSS 3
+
+static const char *cost_names[] = { "steps", "latency", "kb", "loss" };
+
+/*
+ * The learned policy, see run_train(). What the agent knows about the four
+ * squares next to it, the percepts where it stands, the gold, its arrow and
+ * which way it should be heading get packed into a state number by
+ * policy_state(). The generated policy.h has the best of policy_actions for
+ * every state, '.' being to ask the kb like there was no table.
+ */
+#define POLICY_STATES (256 * 8 * 2 * 2 * 5)
+#define POLICY_ACTIONS 10
+/* a move now is worth twice one a move later, the score is too noisy further */
+#define POLICY_GAMMA .5
+/* times an action has to be tried before it can be the best one */
+#define POLICY_TRIED 200
+/* what asking the kb costs, in points, so the table does what it can */
+#define POLICY_ASK 1
+/* games a new table has to score at least as well as the kb on, unseen ones */
+#define POLICY_CHECK 500
+static const char policy_actions[POLICY_ACTIONS + 1] = "neswNESWg.";
+#ifdef WUMPUS_POLICY
+#include "policy.h"
+#endif
+
+/* the parts of a turn that get timed, see phase_names */
+#define PHASE_TURN 0
+#define PHASE_DECIDE 1
+#define PHASE_SCAN 2
+#define PHASE_PATH 3
+#define PHASE_ACT 4
+#define PHASE_TELL 5
+#define PHASE_SENSE 6
+#define PHASE_DRAW 7
+#define PHASES 8
+
+static const char *phase_names[PHASES] = {
+  /* all of agent_input() */
+  "turn",
+  /* kb_ask_action(), or picking up the planner's answer */
+  "decide",
+  /* has_unvisited_safe_squares() */
+  "scan",
+  /* shortest_path() */
+  "path",
+  /* carrying out the action */
+  "act",
+  /* kb_tell(), part of process_percepts() */
+  "tell",
+  /* all of process_percepts() */
+  "sense",
+  /* showing the map, percepts and score, or the --raw screen */
+  "draw"
+};
+
+/*
+ * Hardware counters for --counters, see pmu_read(). Every phase above also
+ * adds up what the CPU counted while it ran, so a slow phase can be told apart
+ * as too many instructions, too many cache misses or too many mispredicted
+ * branches. Only the game's own code is counted, not the kernel's.
+ */
+#define PMU_CYCLES 0
+#define PMU_INSTRUCTIONS 1
+#define PMU_L1D_MISSES 2
+#define PMU_LLC_MISSES 3
+#define PMU_BRANCH_MISSES 4
+#define PMU_EVENTS 5
+
+static const char *pmu_names[PMU_EVENTS] = {
+  "cycles", "instr", "L1d miss", "LLC miss", "br miss"
+};
+
+typedef struct PMU_COUNT {
+  unsigned long long count[PMU_EVENTS];
+} pmu_count;
+
+/*
+ * The spectator stream, see spectate_publish() and run_watch(). One game at a
+ * time writes a frame for every turn into a ring of SPECTATE_FRAMES in a
+ * shared file, and any number of viewers read them out. The game never waits
+ * on a viewer. A frame's seq is odd while it is being written and 2 * (n + 1)
+ * once it holds frame n, so a viewer that copied one while it changed, or
+ * fell a whole ring behind, can tell and skips ahead.
+ */
+#define SPECTATE_FRAMES 1024
+#define SPECTATE_DELTAS 16
+#define SPECTATE_MAGIC 0x2b4d5557
+
+/* a fact the kb learned, or forgot when the sentence is negative */
+typedef struct KB_DELTA {
+  int sentence, x, y;
+} kb_delta;
+
+typedef struct FRAME {
+  unsigned long long seq;
+  unsigned int seed;
+  int turn, x, y, percepts, score, arrows, has_gold;
+  /* the command that led here, 0 for the start of a game */
+  char action;
+  /* every change is counted, only the first SPECTATE_DELTAS are kept */
+  int deltas;
+  kb_delta delta[SPECTATE_DELTAS];
+} frame;
+
+typedef struct RING {
+  unsigned int magic, frame_size;
+  /* frames ever published, only the game writes it */
+  unsigned long long head;
+  frame frames[SPECTATE_FRAMES];
+} ring;
+
+/*
+ * The event log for --log, see log_event() and log_writer(). Every thread
+ * puts its events in a ring of its own without taking a lock, and the writer
+ * thread copies them out to the file behind it. A game never waits on the
+ * writer, if its ring is full the event is dropped and counted. The file is a
+ * log_header and then one event after another.
+ */
+#define LOG_MAGIC 0x2b4c4f47
+#define LOG_EVENTS 16384
+
+/* how much gets logged, every level has the ones below it too */
+#define LOG_GAME 1
+#define LOG_AGENT 2
+#define LOG_KB 3
+
+#define EVENT_MOVE 0
+#define EVENT_BUMP 1
+#define EVENT_FOOD 2
+#define EVENT_SHOOT 3
+#define EVENT_KILL 4
+#define EVENT_GOLD 5
+#define EVENT_DEATH 6
+#define EVENT_ACTION 7
+#define EVENT_KB 8
+#define EVENT_TYPES 9
+
+static const char *event_names[EVENT_TYPES] = {
+  "move", "bump", "food", "shoot", "kill", "gold", "death", "action", "kb"
+};
+static const int event_levels[EVENT_TYPES] = {
+  LOG_GAME, LOG_GAME, LOG_GAME, LOG_GAME, LOG_GAME, LOG_GAME, LOG_GAME,
+  LOG_AGENT, LOG_KB
+};
+
+typedef struct LOG_HEADER {
+  unsigned int magic, event_size;
+} log_header;
+
+/*
+ * something that happened at x, y, steps into the game. value is the command
+ * for EVENT_ACTION, the arrows left for EVENT_SHOOT and the sentence for
+ * EVENT_KB, negative when the kb forgot it.
+ */
+typedef struct EVENT {
+  unsigned int seed;
+  int steps, type, x, y, value;
+} event;
+
+typedef struct EVENT_RING {
+  struct EVENT_RING *next;
+  /* events ever put in, only its thread moves it, and ever written out */
+  unsigned long long head, tail;
+  /* set once its thread is gone, it is freed when it has been written out */
+  int closed;
+  long long dropped;
+  event events[LOG_EVENTS];
+} event_ring;
+
+/*
+ * Map files from --make-maps, see map_file_open(). A header and then count
+ * records of record_size bytes, each with the terrain of one map packed four
+ * squares to a byte just like WUMPUS_PACKED_MAP keeps it, so a game takes its
+ * map right out of the file instead of making it. Everything init_game() would
+ * have worked out is in there too, the rng included, so a map from the file
+ * plays the same game as its seed does.
+ */
+#define MAPS_MAGIC 0x2b4d4150
+
+typedef struct MAPS_HEADER {
+  unsigned int magic;
+  /* how every map in the file was made */
+  int size, kind;
+  double pit_ratio, wall_ratio;
+  int count, record_size;
+} maps_header;
+
+typedef struct MAP_RECORD {
+  /* the seed that made the map and where the game's rng was after that */
+  unsigned int seed, rng;
+  int oracle;
+  signed char map_class, supmuw_neighbors_wumpus;
+  /* -1 if there is none */
+  short int wumpus_x, wumpus_y, gold_x, gold_y, supmuw_x, supmuw_y;
+  unsigned char cells[];
+} map_record;
+
+/*
+ * Lookahead, see lookahead_action(). What the agent believes is hashed the
+ * Zobrist way: every kb fact, the player's square, the gold and the arrows
+ * have a random key and the hash is all of them xor'd together, so a fact
+ * going in or out of the kb is one xor. The keys come from zobrist_key()
+ * instead of a table since the map can be any size. Values the search worked
+ * out are kept in a transposition table of TT_WAYS entry buckets, each one a
+ * cache line.
+ */
+#define TT_BITS 14
+#define TT_WAYS 4
+#define ZOBRIST_PLAYER (PERCEPT_DESTINATION << 1)
+#define ZOBRIST_GOLD (PERCEPT_DESTINATION << 2)
+#define ZOBRIST_ARROWS (PERCEPT_DESTINATION << 3)
+/* outcomes less likely than this are not looked into */
+#define LOOKAHEAD_PRUNE .01
+/* how much better than the kb's choice another one has to look */
+#define LOOKAHEAD_MARGIN .5
+/* how long a look ahead can take without --move-budget-us, in ns */
+#define LOOKAHEAD_BUDGET 50000000LL
+
+typedef struct TT_ENTRY {
+  unsigned long long key;
+  float value;
+  /* how deep the value goes, the search that stored it and its best action */
+  short int depth;
+  unsigned char age;
+  char action;
+} tt_entry;
+
 /*
  * struct for managing the whole game
  * i wasn't going to make this global, but somehow passing a pointer to one
  * of these structs around somehow causes the whole thing to get stupidly
- * corrupted and cause segfaults...
+ * corrupted and cause segfaults... every thread gets its own, though.
  */
-struct WUMPLUS {
+__thread struct WUMPLUS {
   /* general settings */
   int x, y, arrows, percepts, score, steps_taken, dest_x, dest_y;
   /* flags */
-  short int has_food, has_gold, supmuw_neighbors_wumpus, use_agent;
-  /* the map */
-  char map[MAP_SIZE][MAP_SIZE];
-  /* the knowledge base */
-  sqlite3 *db;
+  short int has_food, has_gold, supmuw_neighbors_wumpus, use_agent, quiet, quit;
+  short int heard_scream, out_of_time, use_hpa, publishing;
+  short int use_counters, log_level;
+  /* how the map is made, the seed replays the whole game */
+  int size, kind, map_class, oracle;
+  double pit_ratio, wall_ratio;
+  unsigned int seed, rng;
+  /* the map, size * size cells, use map_at() and map_put() */
+#ifdef WUMPUS_PACKED_MAP
+  unsigned char *map;
+  coordinate wumpus, gold, supmuw;
+#else
+  char *map;
+#endif
+  /* chunks of a procedural map made so far, hashed on the chunk coordinates */
+  chunk **chunks;
+  int chunk_slots, chunk_count;
+  /* counts every change to the map, so a copy can tell it is out of date */
+  int map_changes;
+  /* the farthest the player has been from the top left, see shortest_path() */
+  int reach;
+  /* number of agent decisions and the time spent making them */
+  int decisions, timeouts;
+  long long decision_ns;
+  /* and how often they looked something up in the kb, see kb_found() */
+  long long kb_lookups;
+  /* how long the agent gets for each decision and when time is up, or 0 */
+  long long move_budget, deadline;
+  /* how long each part of the agent's turns took */
+  histogram latency[PHASES];
+  /* and what the hardware counted while they ran, with --counters */
+  pmu_count counters[PHASES];
+  /* the agent's habits */
+  tuning tune;
+  /* the learned policy it follows wherever that has a move, or NULL */
+  const char *policy;
+  /* where the policy is heading and the steps there, see policy_route() */
+  coordinate route_to;
+  int route_gold, route_n, route_cells, *route;
+  /* the knowledge base, its zobrist hash, and the pathfinder's view of it */
+  knowledge *db;
+  unsigned long long kb_hash;
+  pathfinder *hpa;
+  /* how many moves ahead the agent looks, 0 to just ask the kb */
+  int lookahead;
+  /* the map to play from a --maps file, or NULL to make one up */
+  const map_record *preset;
+  /* the next spectator frame, filled in over the turn when publishing */
+  frame spectate;
 } game;
 
+/*
+ * The lookahead search of the thread's game. While it runs every change to
+ * the kb is written down so it can be undone on the way back up.
+ */
+__thread struct LOOKAHEAD {
+  /* 1 << TT_BITS buckets, made for each game that looks ahead */
+  tt_entry *table;
+  unsigned char age;
+  kb_delta *journal;
+  int journal_len, journal_cap, searching, undoing;
+  /* home_distance()'s search, kept from one call to the next */
+  int *dist, *queue, cells;
+  /* squares the agent has not been to, for the odds of what is in them */
+  double unvisited;
+  long long nodes, hits;
+} look;
+
+/*
+ * The thread's hardware counters, opened the first time they are read. They
+ * are one group so the kernel always counts all of them at once, and a read of
+ * the first one gets them all.
+ */
+__thread struct PMU {
+  /* 0 until opened, 1 if counting, -1 if there are no counters */
+  int state, leader;
+  /* where each event is in a read of the group, or -1 if it can't be counted */
+  int slot[PMU_EVENTS];
+} pmu;
+
+/* how an action turned out, as far as the agent can tell */
+typedef struct OUTCOME {
+  int x, y, percepts, arrows, has_gold, heard_scream;
+} outcome;
+
+/* the most ways one action can turn out, see speculate_outcomes() */
+#define SPECULATE_MAX 24
+/* how many of the likeliest of those the planner works out */
+#define SPECULATE_TRIES 2
+
+/*
+ * Speculative planning. While an action is carried out, the planner thread
+ * works out the agent's next decision for the likeliest ways the action could
+ * turn out, each on its own copy of the kb. Once the real percepts are in, the
+ * game takes the kb and decision for that outcome instead of thinking it over
+ * again, if the planner is done with it by then. Only one game at a time can
+ * speculate.
+ */
+struct SPECULATION {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake, done;
+  /* the thread is up, a job is being worked on, it is for the current turn */
+  int running, busy, active, cancel, wanted, count;
+  /* turns the planner saw coming, turns it did not, and ones it was late for */
+  int hits, misses, late;
+  char action;
+  struct WUMPLUS before;
+  knowledge *kb;
+  /* the planner's own copy of the map, see speculate_map() */
+#ifdef WUMPUS_PACKED_MAP
+  unsigned char *map;
+#else
+  char *map;
+#endif
+  chunk **chunks;
+  int chunk_slots, chunk_count, map_changes;
+  outcome outcomes[SPECULATE_MAX];
+  int started[SPECULATE_MAX], ready[SPECULATE_MAX];
+  char decisions[SPECULATE_MAX];
+  knowledge *kbs[SPECULATE_MAX];
+  int dest_x[SPECULATE_MAX], dest_y[SPECULATE_MAX];
+  unsigned int rng[SPECULATE_MAX];
+  unsigned long long kb_hash[SPECULATE_MAX];
+} spec;
+
+/* one tier of maps in the benchmark corpus and how to generate them */
+typedef struct TIER {
+  const char *name;
+  int size, kind;
+  double pit_ratio, wall_ratio;
+} tier;
+
+static const tier bench_tiers[] = {
+  /* the normal game */
+  { "default", MAP_SIZE, MAP_KIND_RANDOM, .15, .10 },
+  /* twice as many pits, the agent has to guess a lot more */
+  { "pits", MAP_SIZE, MAP_KIND_RANDOM, .30, .10 },
+  /* corridors everywhere, long paths for shortest_path() */
+  { "maze", 15, MAP_KIND_MAZE, .04, .10 },
+  /* bigger than normal, most of the cost is in the kb */
+  { "large", 24, MAP_KIND_RANDOM, .15, .10 }
+};
+#define BENCH_TIERS (int)(sizeof(bench_tiers) / sizeof(bench_tiers[0]))
+
+/* changes smaller than this are noise, even the median moves up to 20% */
+#define BENCH_NOISE .25
+/* times the corpus is played, the median pass is the one that counts */
+#define BENCH_PASSES 9
+
+/* totals for one class of map, see classify_map() */
+typedef struct BENCH_CLASS {
+  int games, wins;
+  long long score, oracle;
+} bench_class;
+
+/* totals for one tier of the corpus */
+typedef struct BENCH_TOTAL {
+  int games, wins, golden, golden_wins, changed, decisions;
+  long long score, steps, golden_score, golden_steps, ns, decision_ns;
+  double perf_gps, perf_us;
+} bench_total;
+
+/*
+ * What a run over a --maps file or --games came to, see run_maps(). With
+ * --shard each process plays a slice of the maps and writes one of these out
+ * with --summary, and --merge adds them up into what one run over all of them
+ * would have shown. Everything in it adds up: scores and steps get a count
+ * for every value they can have instead of a sketch, so even the percentiles
+ * come out the same, and the latency histograms merge bucket by bucket.
+ */
+#define SUMMARY_MAGIC 0x2b4d5355
+/* scores from -SUMMARY_SCORES / 2 up, anything further out is counted last */
+#define SUMMARY_SCORES 4096
+#define SUMMARY_STEPS (MAP_MAXSTEPS + 2)
+
+typedef struct SUMMARY {
+  unsigned int magic, size;
+  /* which slice of the maps this is, and how many maps there are in all */
+  int shard, shards, maps;
+  /* the first seed of a run without a --maps file */
+  unsigned int seed;
+  bench_total total;
+  bench_class classes[MAP_CLASS_IMPOSSIBLE + 1];
+  unsigned int scores[SUMMARY_SCORES], steps[SUMMARY_STEPS];
+  histogram latency[PHASES];
+} summary;
+
+/*
+ * The autotuner, see run_tune(). Each round the games every surviving
+ * candidate still has to play are lined up as jobs, and the tuning threads
+ * take them off the list one at a time.
+ */
+struct TUNER {
+  pthread_mutex_t lock;
+  /* how every game is set up apart from its seed and habits */
+  struct WUMPLUS settings;
+  tuning *configs;
+  /* total score and games played so far for each candidate */
+  long long *sums;
+  int *played;
+  /* the games of the current round */
+  int *job_config, *job_seed, jobs, next;
+} tuner;
+
+/*
+ * The search for bad maps, see run_hunt(). Each round the hunting threads
+ * play every map of the population, the worst 1 in TUNE_KEEP stay and the
+ * rest are made over from them. A map that is played again keeps the lowest
+ * cost it got, so one that was only slow by bad luck doesn't stay on top.
+ */
+#define HUNT_POPULATION 48
+
+typedef struct HUNT_CANDIDATE {
+  map_record *map;
+  double cost;
+  int played;
+} hunt_candidate;
+
+struct HUNTER {
+  pthread_mutex_t lock;
+  /* the settings the population's maps are played with */
+  struct WUMPLUS settings;
+  int cost, next;
+  /* where the changes to the maps come from, not the games' own rng */
+  unsigned int rng;
+  hunt_candidate candidates[HUNT_POPULATION];
+} hunter;
+
+/*
+ * The A/B comparison, see run_ab(). Both set ups play the i'th map of the run
+ * one after the other on the same thread and put what they got in the i'th
+ * pair, the threads take the maps of a batch one at a time.
+ */
+typedef struct AB_PAIR {
+  double a[AB_METRICS], b[AB_METRICS];
+} ab_pair;
+
+struct COMPARISON {
+  pthread_mutex_t lock;
+  struct WUMPLUS a, b;
+  ab_pair *pairs;
+  int next, last;
+} comparison;
+
+/*
+ * The --raw screen, see screen_draw(). It owns the last SCREEN_LINES lines of
+ * the terminal: the percepts, the score, what happened on the last turn and
+ * the prompt the cursor waits at. Every line is remembered as it was last
+ * drawn so only the ones that changed get sent again.
+ */
+#define SCREEN_LINES 8
+#define SCREEN_MESSAGES (SCREEN_LINES - 3)
+#define SCREEN_WIDTH 80
+#define SCREEN_PROMPT "Enter a Command (?): "
+
+struct SCREEN {
+  int active;
+  struct termios saved;
+  char lines[SCREEN_LINES][SCREEN_WIDTH];
+  /* everything message() said since the last draw */
+  char pending[SCREEN_MESSAGES * SCREEN_WIDTH];
+  int pending_len;
+} screen;
+
+/* the shared ring for --spectate, and whether a game is writing to it */
+struct SPECTATOR {
+  ring *ring;
+  int busy;
+} spectator;
+
+/* the --log file, the thread writing it and the rings of every thread */
+struct EVENT_LOG {
+  FILE *fp;
+  pthread_t thread;
+  pthread_key_t key;
+  pthread_mutex_t lock;
+  event_ring *rings;
+  int running;
+  long long written, dropped;
+} event_log;
+
+/* the thread's ring, made the first time it logs something */
+__thread event_ring *log_ring;
+
+/*
+ * The --maps file, mapped in read only and shared by every thread. With no
+ * --map picked out the agent plays all of them, see run_maps(). --games uses
+ * it without a file, header is NULL then.
+ */
+struct MAPFILE {
+  maps_header *header;
+  size_t bytes;
+  pthread_mutex_t lock;
+  /* how every game is set up apart from its map */
+  struct WUMPLUS settings;
+  /* the next map to play, the one after the last, and how they went */
+  int next, last;
+  summary results;
+} map_file;
+
+/*
+ * --enumerate, see run_enumerate(). Every map the generator could make at the
+ * current size is played once, along with the chance of the generator making
+ * it, so what comes out is the agent's real win rate instead of an estimate,
+ * for the random choices the agent makes from the seed. A map and its mirror
+ * image along the diagonal through (1,1) are the same map to the game, so
+ * only one of them is played for both unless mirrors is set. The agent breaks
+ * ties in its own order, so a mirror image doesn't always play out quite the
+ * same.
+ */
+struct ENUMERATION {
+  pthread_mutex_t lock;
+  /* the settings for the maps enumerate_map() makes */
+  struct WUMPLUS settings;
+  int jobs, next_thread, mirrors;
+  /* the most pits and walls, and the squares they can go on */
+  int pit_max, wall_max, squares;
+  coordinate *inside;
+  /* maps the generator can make, and how many of them were played */
+  long long maps, played;
+  /* the chances of all of them, and of winning, dying or losing otherwise */
+  double chance, won, died, lost, score;
+  double class_chance[MAP_CLASS_IMPOSSIBLE + 1];
+  double class_won[MAP_CLASS_IMPOSSIBLE + 1];
+} enumeration;
+
+/* one thread's walk through every map, see enumerate_square() */
+typedef struct ENUMERATOR {
+  /* which thread, and what is on each of enumeration.inside */
+  int thread;
+  char *kinds;
+  /* the chance of each map with this many pits and walls */
+  double chance;
+  /* maps left after the mirror images, counted the same on every thread */
+  long long distinct, played;
+  map_record *record;
+  double total, won, died, lost, score;
+  double class_chance[MAP_CLASS_IMPOSSIBLE + 1];
+  double class_won[MAP_CLASS_IMPOSSIBLE + 1];
+} enumerator;
+
+#ifndef WUMPUS_TILED_KB
+/*
+ * The SQLite heap for --kb-heap, see kb_heap_malloc(). Without it SQLite goes
+ * to malloc() for every statement the kb runs and every page its tables grow
+ * by, and with lots of games going at once they all queue up for the system
+ * allocator. Instead it gets one block up front, cut into pieces of a power of
+ * two bytes as they are first wanted. A freed piece is kept for the next one
+ * of its size, by the thread that freed it until it has KB_HEAP_CACHE of them
+ * and on the shared lists after that, so once the games are warmed up nothing
+ * goes back to malloc(). Every piece starts with a word saying how big it is.
+ */
+#define KB_HEAP_MIN_BITS 4
+#define KB_HEAP_CLASSES 16
+#define KB_HEAP_CACHE 64
+/* a quarter of the heap is for the page cache, which has pages this big */
+#define KB_HEAP_PAGE 4096
+/* and every connection gets this many lookaside slots of this many bytes */
+#define KB_LOOKASIDE_SLOT 128
+#define KB_LOOKASIDE_SLOTS 64
+
+typedef struct KB_PIECE {
+  struct KB_PIECE *next;
+} kb_piece;
+
+struct KB_HEAP {
+  pthread_mutex_t lock;
+  /* the part cut into pieces, and how much of it has been */
+  char *base;
+  size_t size, top;
+  kb_piece *free[KB_HEAP_CLASSES];
+  /* bytes of pieces handed out now and at most, the biggest ask */
+  long long in_use, peak, largest;
+  /* asks too big for a piece or made when the heap was all cut up */
+  long long overflows;
+  /* what the lookaside of every connection did, added up as they close */
+  long long lookaside_hits, lookaside_misses;
+  /* the page cache, right after the pieces */
+  int page_size, page_count;
+} kb_heap;
+
+/* the pieces a thread freed and is keeping for itself */
+__thread struct KB_CACHE {
+  kb_piece *free[KB_HEAP_CLASSES];
+  int count[KB_HEAP_CLASSES];
+} kb_cache;
+
+/*
+ * What kb_found() has already asked SQLite about the thread's kb, so asking
+ * the same thing again in a turn is a lookup instead of a query. Open
+ * addressing on sentence, x and y, kept at most half full, with sentence 0
+ * for an empty slot. kb_insert() and kb_delete() write through it. It starts
+ * over whenever kb_found() is asked about another kb, and is thrown away
+ * when its kb is closed or another one is opened where it was.
+ */
+#define KB_MEMO_SLOTS 256
+
+typedef struct KB_MEMO_ENTRY {
+  int sentence, x, y, found;
+} kb_memo_entry;
+
+__thread struct KB_MEMO {
+  knowledge *db;
+  kb_memo_entry *slots;
+  /* complete when every fact is in it, see kb_memo_load() */
+  int slot_count, count, complete;
+} kb_memo;
+#endif
+
+/*
+ * What the agent can work out from the 3x3 squares around it, see
+ * kb_inferrances(). Something known about those squares is 9 bits, one for
+ * each square, AROUND(dx, dy) being the one dx, dy from the player. The rules
+ * only need the corners with the percept and the sides known to be safe, which
+ * infer_index() packs into 8 bits, so infer_table has the squares they find
+ * the percept's cause on for every one of those neighbourhoods. It is made by
+ * infer_init() from the rules before any game is played.
+ */
+#define AROUND(dx, dy) (1 << (((dy) + 1) * 3 + (dx) + 1))
+#define INFER_STATES 256
+
+unsigned short infer_table[INFER_STATES];
+
 /* map initialization functions */
+int game_rand();
+size_t map_bytes();
+char map_at(int, int);
+void map_put(int, int, char);
+unsigned int map_chunk_hash(int, int);
+chunk *map_chunk_at(int, int);
+void map_chunk_fill(chunk *);
+void map_chunks_free();
+void map_chunks_release(chunk **, int);
 int random_map_coordinate();
 void random_map_x_y(int *, int *);
+void carve_maze();
+int deadly(int, int);
+int percept_free(int, int);
+int classify_map();
+int oracle_score();
+const char *word_from_class(int);
 void init_game();
+void make_map();
+void map_from_record(const map_record *);
+void map_to_record(map_record *);
+void end_game();
+void play_game();
 
 /* interaction functions */
 void process_percepts();
@@ -106,14 +1092,24 @@ void unknown_action();
 
 /* player inputs */
 void process_player_command(char);
+int command_direction(char);
 void user_input();
 void agent_input();
+void raw_begin();
+void raw_end();
+void raw_signal(int);
+char raw_key();
 
 /* game outputs */
+void message(const char *, ...);
 void print_help();
 void print_map();
 void print_percepts();
 void print_score();
+void print_analysis();
+void format_percepts(char *, size_t);
+void format_score(char *, size_t);
+void screen_draw();
 
 /* game helpers */
 int player_dead();
@@ -129,10 +1125,40 @@ void action_grab();
 void action_quit();
 
 /* agent stuff, yeah, there's a lot... */
+#ifndef WUMPUS_TILED_KB
+int kb_heap_init(int);
+static int kb_heap_class(int);
+static void kb_heap_raise(long long *, long long);
+static void *kb_heap_malloc(int);
+static void kb_heap_free(void *);
+static void *kb_heap_realloc(void *, int);
+static int kb_heap_size(void *);
+static int kb_heap_roundup(int);
+static int kb_heap_start(void *);
+static void kb_heap_stop(void *);
+void kb_heap_report();
+#endif
 void kb_init();
 void kb_close();
+knowledge *kb_clone(knowledge *);
+void kb_release(knowledge *);
+#ifdef WUMPUS_TILED_KB
+unsigned int kb_tile_hash(knowledge *, int, int);
+void kb_tile_grow(knowledge *);
+kb_tile *kb_tile_at(knowledge *, int, int, int);
+#else
+kb_memo_entry *kb_memo_at(int, int, int);
+void kb_memo_fill(int, int, int, int);
+static int kb_memo_load_callback(void *, int, char **, char **);
+void kb_memo_load();
+void kb_memo_forget(knowledge *);
 static int kb_found_callback(void *, int, char **, char **);
+static int kb_around_callback(void *, int, char **, char **);
+static int passable_callback(void *, int, char **, char **);
+#endif
 int kb_found(int, int, int);
+int kb_around(int, int, int);
+void kb_passable(wavefront *);
 int visited(int, int);
 int safe(int, int);
 int wall(int, int);
@@ -140,1265 +1166,7452 @@ int glitter(int, int);
 int smell(int, int);
 void kb_insert(int, int, int);
 void kb_delete(int, int, int);
-void check_corner(int, int, int, int);
-void kb_inferrances(int, int);
+void kb_changed(int, int, int);
+void kb_bumped(int, int);
+void kb_killed(int, int);
+void kb_grabbed();
+int infer_corners(int, int);
+int infer_index(int, int);
+void infer_init();
+void kb_inferrances(int, int, int *, int *);
 void kb_tell();
 void remove_destination();
 int has_destination();
 int at_destination();
 int at_start();
+#ifndef WUMPUS_TILED_KB
 static int huss_callback(void *, int, char **, char **);
+#else
+static int huss_compare(const void *, const void *);
+#endif
 int has_unvisited_safe_squares();
 char relative_direction(int, int);
 char shortest_path();
+int wavefront_at(wavefront *, unsigned long long *, int, int);
+int wavefront_spread(wavefront *);
+int hpa_passable(int, int);
+void hpa_init();
+void hpa_free();
+void hpa_touch(int, int, int, int);
+void hpa_local_bfs(int, int, int, int, int *);
+void hpa_side_entrances(cluster *, int, int, int, int, int, int);
+void hpa_rebuild(int, int);
+cluster *hpa_cluster_at(int, int);
+int hpa_entrance_at(cluster *, int, int);
+void hpa_push(int, int);
+long long hpa_pop();
+char hpa_shortest_path();
 int wumpus_nearby(coordinate *);
+int deadline_passed();
+char fallback_action();
 char kb_ask_action();
+#ifndef WUMPUS_TILED_KB
+static int heading_callback(void *, int, char **, char **);
+#endif
+void policy_route();
+int policy_route_at(int, int);
+int policy_step();
+int policy_heading(int);
+int policy_view(int, int, int);
+int policy_state();
+char policy_lookup(const char *);
+#ifndef WUMPUS_TILED_KB
+static void game_random_sql(sqlite3_context *, int, sqlite3_value **);
+#endif
 char *word_from_percept(int);
+#ifdef WUMPUS_TILED_KB
+static int kb_dump_compare(const void *, const void *);
+#else
 static int kb_dump_callback(void *, int, char **, char **);
+#endif
 void kb_dump();
 
-/* list / queue functions (SQL based!) */
-void queue_make_empty(const char *);
-static int queue_empty_callback(void *, int, char **, char **);
-int queue_empty(const char *);
-void queue_enqueue(const char *, coordinate *);
-static int dequeue_callback(void *, int, char **, char **);
-void queue_dequeue(const char *, coordinate *);
+/* speculative planning */
+void speculate_init();
+void speculate_stop();
+void speculate_add(outcome *, int *, int, int, int, int, int, int);
+int speculate_outcomes(char, outcome *);
+int speculate_likeliest(char, outcome *, int);
+void speculate_map();
+void outcome_apply(char, outcome *);
+void speculate_start(char);
+static void *speculate_thread(void *);
+void speculate_arrived();
+char speculate_adopt();
+void speculate_abandon();
+
+/* latency histograms */
+int hist_index(long long);
+long long hist_value(int);
+void hist_record(histogram *, long long);
+void hist_merge(histogram *, histogram *);
+long long hist_percentile(histogram *, double);
+void print_latency(histogram *);
+
+/* hardware counters */
+int pmu_open();
+void pmu_read(pmu_count *);
+void pmu_add(int, pmu_count *);
+void pmu_merge(pmu_count *, pmu_count *);
+void print_counters(pmu_count *, histogram *);
+
+/* benchmarking */
+long long now_ns();
+const tier *find_tier(const char *);
+void use_tier(const tier *);
+int run_bench(const char *, int, int, int);
+int game_jobs(const char *, int);
+void run_threads(int, void *(*)(void *));
+
+/* map files */
+int map_file_open(const char *);
+const map_record *map_file_record(int);
+int run_make_maps(int, const char *);
+static void *maps_thread(void *);
+int run_maps(int, int, int, int, const char *);
+void summary_add(summary *);
+void summary_merge(summary *, summary *);
+int summary_percentile(unsigned int *, int, long long, double);
+void print_summary(summary *);
+int run_merge(int, char **, int);
+
+/* exhaustive enumeration */
+double choose(int, int);
+void enumerate_square(enumerator *, int, int, int, int);
+void enumerate_map(enumerator *);
+static void *enumerate_thread(void *);
+int run_enumerate(int, int);
+
+/* autotuning */
+int find_name(const char **, int, const char *);
+void print_tuning(tuning *);
+static void *tune_thread(void *);
+static int tune_compare(const void *, const void *);
+int run_tune(int, int);
+
+/* adversarial search */
+double hunt_cost();
+static void *hunt_thread(void *);
+static int hunt_compare(const void *, const void *);
+int hunt_find(char, int *, int *);
+void hunt_mutate(map_record *);
+int run_hunt(int, const char *, int);
+
+/* A/B comparison */
+int agent_option(struct WUMPLUS *, int, char **, int);
+int ab_parse(struct WUMPLUS *, const char *);
+void ab_play(struct WUMPLUS *, int, double *);
+static void *ab_thread(void *);
+int ab_verdict(int, double, double, double);
+int run_ab(int, const char *, double, int);
+
+/* lookahead */
+unsigned long long zobrist_key(int, int, int);
+unsigned long long belief_hash();
+tt_entry *tt_probe(unsigned long long);
+void tt_store(unsigned long long, double, int, char);
+void lookahead_journal(int, int, int);
+void lookahead_undo(int);
+#ifndef WUMPUS_TILED_KB
+static int kb_count_callback(void *, int, char **, char **);
+#endif
+int visited_count();
+int safe_unvisited();
+int home_distance();
+double death_chance(int, int);
+double percept_chance(int, int, int);
+double outcome_chances(char, outcome *, int, double *);
+double lookahead_leaf();
+int lookahead_allowed(char);
+double lookahead_q(char, int);
+double lookahead_value(int);
+char lookahead_action();
+
+/* spectator stream */
+int spectate_open(const char *);
+void spectate_begin();
+void spectate_delta(int, int, int);
+void spectate_publish();
+void spectate_end();
+int run_watch(const char *);
+
+/* event log */
+int log_open(const char *);
+event_ring *log_attach();
+static void log_detach(void *);
+void log_event(int, int, int, int);
+int log_drain();
+static void *log_writer(void *);
+void log_close();
+int run_read_log(const char *);
+
+/* policy training */
+int policy_allowed(int, int);
+int policy_best(float *, int *, int);
+long long policy_check(struct WUMPLUS *, const char *, unsigned int);
+int run_train(int, const char *);
 
 /*
- * This is the main game loop. Checks for the command line argument and runs
+ * This is the main game loop. Checks for the command line arguments and runs
  * the input loop.
  */
 int main(int argc, char **argv)
 {
+  int i, skip_impossible = 0, update = 0, res = 0, tune = 0, jobs = 0;
+  int train = 0, raw = 0, make_maps = 0, map = -1, shard = 0, shards = 1;
+  int merges = 0, enumerate = 0, log_level = LOG_KB, hunt = 0, ab = 0, taken;
+  int games = 0, partial = 0, strict = 0;
+  double ab_delta = AB_DELTA;
+#ifndef WUMPUS_TILED_KB
+  int kb_heap_mb = 0;
+#endif
+  char *bench = NULL, *policy = NULL, *watch = NULL, *maps = NULL;
+  char *results = NULL, **merge = NULL, *log_path = NULL, *read_log = NULL;
+  char *hunted = NULL, *versus = NULL;
   game.use_agent = 0;
-  /* check for agent usage */
-  if(argc == 2 && strcmp(argv[1], "--agent") == 0)
-    game.use_agent = 1;
-  
-  printf("Wum+ By Andrew Coleman <mercury at penguincoder dot org>\n");
-  printf("Scoring:\n");
-  printf(" Move (%d), Death (%d), Shoot (%d)\n", SCORE_MOVE, SCORE_DEATH,
-    SCORE_SHOOT);
-  printf(" Food (%d), Gold (%d), Kill Wumpus(%d)\n", SCORE_FOOD, SCORE_GOLD,
-    SCORE_KILL);
-  printf("Available Percepts: [Bump,Smell,Breeze,Moo,Glitter,Dead]\n");
-  printf("Losing Conditions: Score < %d or Steps > %d or Dead\n",
-    SCORE_MIN, MAP_MAXSTEPS);
-  printf("Winning Conditions: Gold and Player in starting position (1,1).\n");
-  printf("Invocate program with --agent to run as F.O.L. agent\n");
-  
-  /* initialize game */
-  srand(time(NULL));
-  init_game();
+  game.quiet = 0;
+  game.seed = time(NULL);
+  use_tier(&bench_tiers[0]);
+  infer_init();
   
-  /* main game loop */
-  process_percepts();
-  do
+  /* check for agent usage and the rest of the options */
+  for(i = 1; i < argc; i++)
   {
-    printf("\n");
-    /* pretty map it if we are using */
-    if(game.use_agent)
-      print_map();
-    /* show the user */
-    print_percepts();
-    /* remove this now, otherwise it sticks */
-    if(game.percepts & PERCEPT_BUMP)
-      game.percepts ^= PERCEPT_BUMP;
-    /* show the score */
-    print_score();
-    /* get the requested action */
-    game.use_agent ? agent_input() : user_input();
-    /* figure out what's going on */
-    process_percepts();
-  } while(!has_won() && !has_lost());
-  
-  /* fin */
-  action_quit();
-  return 0;
-}
-
-/* Returns a valid random coordinate for the map, not including a wall */
-int random_map_coordinate()
-{
-  return (rand() % (MAP_SIZE - 2)) + 1;
-}
-
-/* Randomly places the coordinate pair to an empty spot in the map */
-void random_map_x_y(int *map_x, int *map_y)
-{
-  int x = 0, y = 0;
-  do {
-    x = random_map_coordinate(); y = random_map_coordinate();
-  } while((x == 1 && y == 1) || game.map[x][y] != MAP_EMPTY);
-  *map_x = x; *map_y = y;
-}
-
-/* Intialize map with randomly placed obstackles */
-void init_game()
-{
-  int i, j, num_pits, num_walls, x, y;
-  
-  /* flag for determining if the supmuw is next to the wumpus. */
-  game.supmuw_neighbors_wumpus = 0;
-  
-  /* First create a Clean Slate */
-  for(j = 0; j < MAP_SIZE; j++)
-    for(i = 0; i < MAP_SIZE; i++)
-      game.map[i][j] = MAP_EMPTY;
-  
-  /* Place player at (1,1) */
-  game.x = 1;
-  game.y = 1;
-  game.has_food = 0;
-  game.has_gold = 0;
-  game.arrows = 1;
-  game.percepts = 0;
-  game.score = 0;
-  game.steps_taken = 0;
-  game.dest_x = -1;
-  game.dest_y = -1;
+    if(strcmp(argv[i], "--agent") == 0)
+      game.use_agent = 1;
+    else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+      game.seed = strtoul(argv[++i], NULL, 10);
+    else if(strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+      bench = argv[++i];
+    else if(strcmp(argv[i], "--bench-update") == 0 && i + 1 < argc)
+    {
+      bench = argv[++i];
+      update = 1;
+    }
+    else if(strcmp(argv[i], "--skip-impossible") == 0)
+      skip_impossible = 1;
+    else if(strcmp(argv[i], "--bench-strict") == 0)
+      strict = 1;
+    else if(strcmp(argv[i], "--speculate") == 0)
+      speculate_init();
+    else if(strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+      game.size = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--procedural") == 0)
+      game.kind = MAP_KIND_PROCEDURAL;
+    else if(strcmp(argv[i], "--raw") == 0)
+      raw = 1;
+    else if(strcmp(argv[i], "--counters") == 0)
+      game.use_counters = 1;
+    else if(strcmp(argv[i], "--make-maps") == 0 && i + 2 < argc)
+    {
+      make_maps = atoi(argv[++i]);
+      maps = argv[++i];
+    }
+    else if(strcmp(argv[i], "--maps") == 0 && i + 1 < argc)
+      maps = argv[++i];
+    else if(strcmp(argv[i], "--map") == 0 && i + 1 < argc)
+      map = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--games") == 0 && i + 1 < argc)
+      games = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--shard") == 0 && i + 1 < argc &&
+            sscanf(argv[i + 1], "%d/%d", &shard, &shards) == 2 &&
+            shard >= 0 && shard < shards)
+      i++;
+    else if(strcmp(argv[i], "--summary") == 0 && i + 1 < argc)
+      results = argv[++i];
+    else if(strcmp(argv[i], "--hunt") == 0 && i + 2 < argc)
+    {
+      hunt = atoi(argv[++i]);
+      hunted = argv[++i];
+    }
+    else if(strcmp(argv[i], "--cost") == 0 && i + 1 < argc &&
+            (hunter.cost = find_name(cost_names, 4, argv[i + 1])) >= 0)
+      i++;
+    else if(strcmp(argv[i], "--ab") == 0 && i + 2 < argc)
+    {
+      ab = atoi(argv[++i]);
+      versus = argv[++i];
+    }
+    else if(strcmp(argv[i], "--ab-delta") == 0 && i + 1 < argc)
+      ab_delta = atof(argv[++i]);
+    else if(strcmp(argv[i], "--enumerate") == 0)
+      enumerate = 1;
+    else if(strcmp(argv[i], "--enumerate-all") == 0)
+      enumerate = 2;
+    /* everything after it is a file to merge */
+    else if((strcmp(argv[i], "--merge") == 0 ||
+             strcmp(argv[i], "--merge-partial") == 0) && i + 1 < argc)
+    {
+      partial = strcmp(argv[i], "--merge-partial") == 0;
+      merge = argv + i + 1;
+      merges = argc - i - 1;
+      i = argc;
+    }
+#ifndef WUMPUS_TILED_KB
+    else if(strcmp(argv[i], "--kb-heap") == 0 && i + 1 < argc)
+      kb_heap_mb = atoi(argv[++i]);
+#endif
+    else if(strcmp(argv[i], "--spectate") == 0 && i + 1 < argc)
+    {
+      if(spectate_open(argv[++i]))
+        return 1;
+    }
+    else if(strcmp(argv[i], "--watch") == 0 && i + 1 < argc)
+      watch = argv[++i];
+    else if(strcmp(argv[i], "--log") == 0 && i + 1 < argc)
+      log_path = argv[++i];
+    else if(strcmp(argv[i], "--log-level") == 0 && i + 1 < argc)
+      log_level = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--read-log") == 0 && i + 1 < argc)
+      read_log = argv[++i];
+    else if(strcmp(argv[i], "--tune") == 0 && i + 1 < argc)
+      tune = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+      jobs = atoi(argv[++i]);
+    else if(strcmp(argv[i], "--train") == 0 && i + 2 < argc)
+    {
+      train = atoi(argv[++i]);
+      policy = argv[++i];
+    }
+    /* the ones that change how the agent plays */
+    else if((taken = agent_option(&game, argc, argv, i)) > 0)
+      i += taken - 1;
+    else
+    {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return 1;
+    }
+  }
   
-  /* Create walls around perimeter of map. one loop. figure it out. */
-  for(i = 0; i < MAP_SIZE; i++)
+  if(game.size < 4)
   {
-    game.map[i][0] = MAP_WALL;
-    game.map[i][MAP_SIZE - 1] = MAP_WALL;
-    game.map[0][i] = MAP_WALL;
-    game.map[MAP_SIZE - 1][i] = MAP_WALL;
+    fprintf(stderr, "The map has to be at least 4 squares on a side\n");
+    return 1;
   }
+  /* the planner would share the pathfinder with the game */
+  if(game.use_hpa && spec.running)
+  {
+    fprintf(stderr, "--hpa and --speculate can not be used together\n");
+    return 1;
+  }
+  /* the planner only knows how to ask the kb */
+  if(game.lookahead && spec.running)
+  {
+    fprintf(stderr, "--lookahead and --speculate can not be used together\n");
+    return 1;
+  }
+  /* the pathfinder has room for every cluster of the map up front */
+  if(game.use_hpa && game.kind == MAP_KIND_PROCEDURAL)
+  {
+    fprintf(stderr, "--hpa needs the whole map, it can not be procedural\n");
+    return 1;
+  }
+  /* the keys come from a person */
+  if(raw && (game.use_agent || bench || tune > 0 || train > 0))
+  {
+    fprintf(stderr, "--raw is only for playing the game yourself\n");
+    return 1;
+  }
+  /* the tuning and training threads have nowhere to report them */
+  if(game.use_counters && (tune > 0 || train > 0 || watch ||
+     (maps && map < 0)))
+  {
+    fprintf(stderr, "--counters is only for a game or --bench\n");
+    return 1;
+  }
+  if(raw && !isatty(STDIN_FILENO))
+  {
+    fprintf(stderr, "--raw needs a terminal to read keys from\n");
+    return 1;
+  }
+  /* those all make their own maps */
+  if(maps && (bench || tune > 0 || train > 0))
+  {
+    fprintf(stderr, "--maps can not be used with --bench, --tune or --train\n");
+    return 1;
+  }
+  if(make_maps > 0 && game.kind == MAP_KIND_PROCEDURAL)
+  {
+    fprintf(stderr, "--make-maps needs the whole map, it can not be "
+      "procedural\n");
+    return 1;
+  }
+  if(map >= 0 && (!maps || make_maps > 0))
+  {
+    fprintf(stderr, "--map picks one out of --maps FILE\n");
+    return 1;
+  }
+  /* the enumeration knows how the random maps are made, not the others */
+  if(enumerate && (game.kind != MAP_KIND_RANDOM || maps || bench ||
+     tune > 0 || train > 0))
+  {
+    fprintf(stderr, "--enumerate makes its own maps, like the random ones\n");
+    return 1;
+  }
+  if(hunt > 0 && (game.kind == MAP_KIND_PROCEDURAL || maps || bench ||
+     tune > 0 || train > 0 || make_maps > 0 || enumerate))
+  {
+    fprintf(stderr, "--hunt makes its own maps, and needs the whole map\n");
+    return 1;
+  }
+  if(ab > 0 && (map >= 0 || make_maps > 0 || bench || tune > 0 ||
+     train > 0 || enumerate || hunt > 0 || ab_delta <= 0))
+  {
+    fprintf(stderr, "--ab plays seeds from --seed or a --maps FILE, and "
+      "--ab-delta has to be more than 0\n");
+    return 1;
+  }
+  if(games < 0 || (games && (maps || bench || tune > 0 || train > 0 ||
+     enumerate || hunt > 0 || ab > 0)))
+  {
+    fprintf(stderr, "--games N plays N maps from --seed on, nothing else\n");
+    return 1;
+  }
+  if((shards > 1 || results) && ((!maps && !games) || map >= 0 ||
+     make_maps > 0))
+  {
+    fprintf(stderr, "--shard and --summary are for playing a --maps file or "
+      "--games\n");
+    return 1;
+  }
+  if(log_level < LOG_GAME || log_level > LOG_KB)
+  {
+    fprintf(stderr, "--log-level is %d, %d or %d\n", LOG_GAME, LOG_AGENT,
+      LOG_KB);
+    return 1;
+  }
+#ifndef WUMPUS_TILED_KB
+  /* SQLite has to be given its memory before anything else uses it */
+  if(kb_heap_mb > 0 && kb_heap_init(kb_heap_mb))
+    return 1;
+#endif
+  
+  if(watch)
+    return run_watch(watch);
+  if(merge)
+    return run_merge(merges, merge, partial);
+  if(read_log)
+    return run_read_log(read_log);
+  if(log_path)
+  {
+    if(log_open(log_path))
+      return 1;
+    game.log_level = log_level;
+  }
+  if(enumerate)
+  {
+    if(!(jobs = game_jobs("enumerate", jobs)))
+      return 1;
+    return run_enumerate(jobs, enumerate == 2);
+  }
+  if(hunt > 0)
+  {
+    if(!(jobs = game_jobs("hunt", jobs)))
+      return 1;
+    return run_hunt(hunt, hunted, jobs);
+  }
+  if(make_maps > 0)
+    return run_make_maps(make_maps, maps);
+  if(maps && map_file_open(maps))
+    return 1;
+  if(ab > 0)
+  {
+    if(!(jobs = game_jobs("ab", jobs)))
+      return 1;
+    return run_ab(ab, versus, ab_delta, jobs);
+  }
+  if((maps && map < 0) || games)
+  {
+    if(!(jobs = game_jobs(maps ? "maps" : "games", jobs)))
+      return 1;
+    return run_maps(games, jobs, shard, shards, results);
+  }
+  if(maps && (game.preset = map_file_record(map)) == NULL)
+  {
+    fprintf(stderr, "There are only %d maps in %s\n", map_file.header->count,
+      maps);
+    return 1;
+  }
+  if(game.preset)
+    game.seed = game.preset->seed;
+  if(bench)
+  {
+    res = run_bench(bench, update, skip_impossible, strict);
+    speculate_stop();
+    return res;
+  }
+  if(tune > 0)
+  {
+    if(!(jobs = game_jobs("tune", jobs)))
+      return 1;
+    return run_tune(tune, jobs);
+  }
+  if(train > 0)
+  {
+    res = run_train(train, policy);
+    speculate_stop();
+    return res;
+  }
+  
+  printf("Wum+ By Andrew Coleman <mercury at penguincoder dot org>\n");
+  printf("Scoring:\n");
+  printf(" Move (%d), Death (%d), Shoot (%d)\n", SCORE_MOVE, SCORE_DEATH,
+    SCORE_SHOOT);
+  printf(" Food (%d), Gold (%d), Kill Wumpus(%d)\n", SCORE_FOOD, SCORE_GOLD,
+    SCORE_KILL);
+  printf("Available Percepts: [Bump,Smell,Breeze,Moo,Glitter,Dead]\n");
+  printf("Losing Conditions: Score < %d or Steps > %d or Dead\n",
+    SCORE_MIN, MAP_MAXSTEPS);
+  printf("Winning Conditions: Gold and Player in starting position (1,1).\n");
+  printf("Invocate program with --agent to run as F.O.L. agent\n");
+  printf("Seed: %u\n", game.seed);
+  
+  /* initialize game */
+  init_game();
+  if(raw)
+    raw_begin();
+  
+  /* main game loop */
+  play_game();
+  
+  /* fin */
+  raw_end();
+  print_analysis();
+  end_game();
+  speculate_stop();
+  return 0;
+}
+
+/*
+ * Plays one game from the current position until the player wins, loses or
+ * quits. Nothing is shown when game.quiet is set, which is how the benchmark
+ * runs many games back to back.
+ */
+void play_game()
+{
+  long long started;
+  pmu_count began;
+  
+  spectate_begin();
+  process_percepts();
+  spectate_publish();
+  do
+  {
+    started = now_ns();
+    pmu_read(&began);
+    if(screen.active)
+      screen_draw();
+    else if(!game.quiet)
+    {
+      printf("\n");
+      /* pretty map it if we are using */
+      if(game.use_agent)
+        print_map();
+      /* show the user */
+      print_percepts();
+    }
+    /* remove this now, otherwise it sticks */
+    if(game.percepts & PERCEPT_BUMP)
+      game.percepts ^= PERCEPT_BUMP;
+    /* show the score */
+    if(!game.quiet && !screen.active)
+      print_score();
+    if(!game.quiet)
+    {
+      hist_record(&game.latency[PHASE_DRAW], now_ns() - started);
+      pmu_add(PHASE_DRAW, &began);
+    }
+    /* get the requested action */
+    game.use_agent ? agent_input() : user_input();
+    if(game.quit)
+      break;
+    /* figure out what's going on */
+    process_percepts();
+    spectate_publish();
+  } while(!has_won() && !has_lost());
+  
+  /* nobody is going to ask about the guesses for the next move */
+  speculate_abandon();
+  spectate_end();
+}
+
+/*
+ * Random numbers for the game. Every game keeps its own generator state seeded
+ * from game.seed so the same seed always gives the same map and the same game.
+ */
+int game_rand()
+{
+  return rand_r(&game.rng);
+}
+
+/* how much memory the map takes */
+size_t map_bytes()
+{
+#ifdef WUMPUS_PACKED_MAP
+  return (game.size * game.size + 3) / 4;
+#else
+  return game.size * game.size;
+#endif
+}
+
+/* what is on the map at x, y */
+char map_at(int x, int y)
+{
+  if(game.kind == MAP_KIND_PROCEDURAL)
+    return map_chunk_at(x, y)->cells[(x & (MAP_CHUNK - 1)) * MAP_CHUNK +
+      (y & (MAP_CHUNK - 1))];
+#ifdef WUMPUS_PACKED_MAP
+  static const char terrain[4] = { MAP_EMPTY, MAP_WALL, MAP_PIT, MAP_EMPTY };
+  int i = x * game.size + y, cell = (game.map[i >> 2] >> ((i & 3) * 2)) & 3;
+  if(cell != MAP_CELL_EMPTY)
+    return terrain[cell];
+  if(x == game.wumpus.x && y == game.wumpus.y)
+    return MAP_WUMPUS;
+  if(x == game.gold.x && y == game.gold.y)
+    return MAP_GOLD;
+  if(x == game.supmuw.x && y == game.supmuw.y)
+    return MAP_SUPMUW;
+  return MAP_EMPTY;
+#else
+  return game.map[x * game.size + y];
+#endif
+}
+
+/*
+ * puts something onto the map at x, y. with a packed map the wumpus, gold and
+ * supmuw just move there, and anything else put on top of them removes them.
+ */
+void map_put(int x, int y, char c)
+{
+#ifdef WUMPUS_PACKED_MAP
+  int i = x * game.size + y, cell = MAP_CELL_EMPTY;
+  coordinate *entity = NULL;
+#endif
+  
+  game.map_changes++;
+  if(game.kind == MAP_KIND_PROCEDURAL)
+  {
+    map_chunk_at(x, y)->cells[(x & (MAP_CHUNK - 1)) * MAP_CHUNK +
+      (y & (MAP_CHUNK - 1))] = c;
+    return;
+  }
+#ifdef WUMPUS_PACKED_MAP
+  if(c == MAP_WUMPUS)
+    entity = &game.wumpus;
+  else if(c == MAP_GOLD)
+    entity = &game.gold;
+  else if(c == MAP_SUPMUW)
+    entity = &game.supmuw;
+  else if(c == MAP_WALL)
+    cell = MAP_CELL_WALL;
+  else if(c == MAP_PIT)
+    cell = MAP_CELL_PIT;
+  
+  /* whatever was here is gone now */
+  if(x == game.wumpus.x && y == game.wumpus.y)
+    game.wumpus.x = game.wumpus.y = -1;
+  if(x == game.gold.x && y == game.gold.y)
+    game.gold.x = game.gold.y = -1;
+  if(x == game.supmuw.x && y == game.supmuw.y)
+    game.supmuw.x = game.supmuw.y = -1;
+  if(entity)
+  {
+    entity->x = x;
+    entity->y = y;
+  }
+  game.map[i >> 2] = (game.map[i >> 2] & ~(3 << ((i & 3) * 2))) |
+    (cell << ((i & 3) * 2));
+#else
+  game.map[x * game.size + y] = c;
+#endif
+}
+
+/* where a chunk goes in the chunk table, before masking */
+unsigned int map_chunk_hash(int cx, int cy)
+{
+  return ((unsigned int)cx * 73856093u) ^ ((unsigned int)cy * 19349663u);
+}
+
+/*
+ * Finds the chunk of a procedural map holding x, y, making it if nobody has
+ * looked there yet. The table doubles once it holds as many chunks as slots.
+ */
+chunk *map_chunk_at(int x, int y)
+{
+  int cx = x >> MAP_CHUNK_BITS, cy = y >> MAP_CHUNK_BITS, i;
+  unsigned int h = map_chunk_hash(cx, cy), slot;
+  chunk *c, *next, **slots;
+  
+  for(c = game.chunks[h & (game.chunk_slots - 1)]; c; c = c->next)
+    if(c->cx == cx && c->cy == cy)
+      return c;
+  
+  if(game.chunk_count == game.chunk_slots)
+  {
+    slots = calloc(2 * game.chunk_slots, sizeof(chunk *));
+    for(i = 0; i < game.chunk_slots; i++)
+      for(c = game.chunks[i]; c; c = next)
+      {
+        next = c->next;
+        slot = map_chunk_hash(c->cx, c->cy) & (2 * game.chunk_slots - 1);
+        c->next = slots[slot];
+        slots[slot] = c;
+      }
+    free(game.chunks);
+    game.chunks = slots;
+    game.chunk_slots *= 2;
+  }
+  
+  c = malloc(sizeof(chunk));
+  if(c == NULL)
+  {
+    fprintf(stderr, "MAP_CHUNK_AT: out of memory\n");
+    exit(1);
+  }
+  c->cx = cx;
+  c->cy = cy;
+  map_chunk_fill(c);
+  c->next = game.chunks[h & (game.chunk_slots - 1)];
+  game.chunks[h & (game.chunk_slots - 1)] = c;
+  game.chunk_count++;
+  game.map_changes++;
+  return c;
+}
+
+/*
+ * Makes up the squares of a chunk. Every square gets a pit or a wall with
+ * half of game.pit_ratio and game.wall_ratio, which is what a random map gets
+ * on average, from a generator seeded by the game seed and chunk coordinates.
+ * The wumpus, gold and supmuw are put down later by init_game().
+ */
+void map_chunk_fill(chunk *c)
+{
+  unsigned int rng, pits, walls, r;
+  int i, j, x, y;
+  char cell;
+  
+  rng = game.seed ^ ((unsigned int)c->cx * 0x9e3779b9u) ^
+    ((unsigned int)c->cy * 0x85ebca6bu);
+  rng ^= rng >> 16; rng *= 0x7feb352du;
+  rng ^= rng >> 15; rng *= 0x846ca68bu;
+  rng ^= rng >> 16;
+  pits = game.pit_ratio / 2 * RAND_MAX;
+  walls = pits + game.wall_ratio / 2 * RAND_MAX;
+  
+  for(i = 0; i < MAP_CHUNK; i++)
+    for(j = 0; j < MAP_CHUNK; j++)
+    {
+      x = (c->cx << MAP_CHUNK_BITS) + i;
+      y = (c->cy << MAP_CHUNK_BITS) + j;
+      r = rand_r(&rng);
+      if(x <= 0 || y <= 0 || x >= game.size - 1 || y >= game.size - 1)
+        cell = MAP_WALL;
+      else if(x == 1 && y == 1)
+        cell = MAP_EMPTY;
+      else if(r < pits)
+        cell = MAP_PIT;
+      else if(r < walls)
+        cell = MAP_WALL;
+      else
+        cell = MAP_EMPTY;
+      c->cells[i * MAP_CHUNK + j] = cell;
+    }
+}
+
+/* throws away every chunk of a procedural map */
+void map_chunks_free()
+{
+  map_chunks_release(game.chunks, game.chunk_slots);
+  game.chunks = NULL;
+  game.chunk_slots = game.chunk_count = 0;
+}
+
+/* frees a chunk table that is not the game's, see speculate_map() */
+void map_chunks_release(chunk **chunks, int slots)
+{
+  int i;
+  chunk *c, *next;
+  
+  for(i = 0; i < slots; i++)
+    for(c = chunks[i]; c; c = next)
+    {
+      next = c->next;
+      free(c);
+    }
+  free(chunks);
+}
+
+/* Returns a valid random coordinate for the map, not including a wall */
+int random_map_coordinate()
+{
+  return (game_rand() % (game.size - 2)) + 1;
+}
+
+/* Randomly places the coordinate pair to an empty spot in the map */
+void random_map_x_y(int *map_x, int *map_y)
+{
+  int x = 0, y = 0;
+  do {
+    x = random_map_coordinate(); y = random_map_coordinate();
+  } while((x == 1 && y == 1) || map_at(x, y) != MAP_EMPTY);
+  *map_x = x; *map_y = y;
+}
+
+/*
+ * Fills the inside of the map with walls and digs a maze out of it with a
+ * randomized depth first search from (1,1). Rooms are on the odd coordinates
+ * and the walls between them on the even ones. A perfect maze only has one way
+ * through it so game.wall_ratio of the remaining inside walls get knocked down
+ * again to make some loops.
+ */
+void carve_maze()
+{
+  int i, j, n = 0, top = 0, x, y, dir, tries;
+  int dx[4] = { 0, 2, 0, -2 }, dy[4] = { -2, 0, 2, 0 };
+  coordinate *stack = malloc(sizeof(coordinate) * game.size * game.size);
+  
+  for(j = 1; j < game.size - 1; j++)
+    for(i = 1; i < game.size - 1; i++)
+      map_put(i, j, MAP_WALL);
+  
+  map_put(1, 1, MAP_EMPTY);
+  stack[top].x = 1; stack[top].y = 1; top++;
+  while(top > 0)
+  {
+    x = stack[top - 1].x; y = stack[top - 1].y;
+    /* count the rooms next to this one that are still solid */
+    n = 0;
+    for(dir = 0; dir < 4; dir++)
+      if(x + dx[dir] > 0 && x + dx[dir] < game.size - 1 &&
+         y + dy[dir] > 0 && y + dy[dir] < game.size - 1 &&
+         map_at(x + dx[dir], y + dy[dir]) == MAP_WALL)
+        n++;
+    if(n == 0)
+    {
+      top--;
+      continue;
+    }
+    /* pick one of them and dig through to it */
+    n = game_rand() % n;
+    for(dir = 0; dir < 4; dir++)
+    {
+      if(x + dx[dir] > 0 && x + dx[dir] < game.size - 1 &&
+         y + dy[dir] > 0 && y + dy[dir] < game.size - 1 &&
+         map_at(x + dx[dir], y + dy[dir]) == MAP_WALL && n-- == 0)
+        break;
+    }
+    map_put(x + dx[dir] / 2, y + dy[dir] / 2, MAP_EMPTY);
+    map_put(x + dx[dir], y + dy[dir], MAP_EMPTY);
+    stack[top].x = x + dx[dir]; stack[top].y = y + dy[dir]; top++;
+  }
+  free(stack);
+  
+  /* knock down some walls so there is more than one way around */
+  n = (int)((game.size - 2) * (game.size - 2) * game.wall_ratio);
+  for(i = 0, tries = 0; i < n && tries < n * 100; tries++)
+  {
+    x = random_map_coordinate(); y = random_map_coordinate();
+    if(map_at(x, y) == MAP_WALL)
+    {
+      map_put(x, y, MAP_EMPTY);
+      i++;
+    }
+  }
+}
+
+/* would walking onto x, y kill you right now? */
+int deadly(int x, int y)
+{
+  char c = map_at(x, y);
+  return c == MAP_PIT || c == MAP_WUMPUS ||
+    (c == MAP_SUPMUW && game.supmuw_neighbors_wumpus);
+}
+
+/* is x, y a square with no smell and no breeze, like kb_tell() checks for */
+int percept_free(int x, int y)
+{
+  int i, dx[4] = { -1, 1, 0, 0 }, dy[4] = { 0, 0, -1, 1 };
+  char c;
+  for(i = 0; i < 4; i++)
+  {
+    c = map_at(x + dx[i], y + dy[i]);
+    if(c == MAP_PIT || c == MAP_WUMPUS ||
+       (c == MAP_SUPMUW && game.supmuw_neighbors_wumpus))
+      return 0;
+  }
+  return 1;
+}
+
+/*
+ * Figures out what it takes to win the map with a couple of flood fills from
+ * (1,1), cheap enough to do for every map made.
+ *
+ * The first fill only walks out of squares with no smell and no breeze, which
+ * are the squares that tell the agent all of their neighbors are safe. If it
+ * reaches the gold, the map can be won without ever guessing.
+ *
+ * The second fill goes anywhere but walls and pits, the beasts can be shot out
+ * of the way (one arrow is assumed to be enough). If that reaches the gold the
+ * map can be won, but only by taking a chance on squares that are not known
+ * to be safe. Otherwise the gold can not be had at all.
+ */
+int classify_map()
+{
+  int n = game.size, i, x, y, head, tail, pass, dir;
+  int dx[4] = { -1, 1, 0, 0 }, dy[4] = { 0, 0, -1, 1 };
+  int *queue = malloc(sizeof(int) * n * n);
+  char *seen = malloc(n * n), c;
+  
+  for(pass = 0; pass < 2; pass++)
+  {
+    memset(seen, 0, n * n);
+    head = tail = 0;
+    queue[tail++] = 1 * n + 1;
+    seen[1 * n + 1] = 1;
+    while(head < tail)
+    {
+      x = queue[head] / n; y = queue[head] % n; head++;
+      if(map_at(x, y) == MAP_GOLD)
+      {
+        free(queue);
+        free(seen);
+        return pass == 0 ? MAP_CLASS_SOLVABLE : MAP_CLASS_RISKY;
+      }
+      if(pass == 0 && !percept_free(x, y))
+        continue;
+      for(dir = 0; dir < 4; dir++)
+      {
+        i = (x + dx[dir]) * n + y + dy[dir];
+        c = map_at(x + dx[dir], y + dy[dir]);
+        if(seen[i] || c == MAP_WALL || c == MAP_PIT)
+          continue;
+        seen[i] = 1;
+        queue[tail++] = i;
+      }
+    }
+  }
+  free(queue);
+  free(seen);
+  return MAP_CLASS_IMPOSSIBLE;
+}
+
+/*
+ * The best score anyone could get on this map if they could see the whole
+ * thing. This is a breadth-first search over the map like shortest_path(),
+ * only the state also has to remember if the gold has been grabbed, if the
+ * supmuw has handed over food and what the arrow has been used on. Shooting
+ * does not take a step so those edges go to the front of the queue.
+ *
+ * The game can end anywhere, by quitting or by getting back to (1,1) with the
+ * gold, so the score is the best one of any state the search gets to. The
+ * gold pays as soon as it is grabbed, so quitting right there beats walking
+ * it home, and quitting on the spot scores 0 on any map.
+ */
+int oracle_score()
+{
+  int n = game.size, cells = n * n, states = cells * 12, cap = states * 2;
+  int *dist = malloc(sizeof(int) * states), *deque = malloc(sizeof(int) * cap);
+  int head = 0, tail = 0, s, t, x, y, gold, food, arrow, dir, d, score;
+  int best = 0, x2, y2, gold2, food2, killed;
+  int dx[4] = { -1, 1, 0, 0 }, dy[4] = { 0, 0, -1, 1 };
+  char c;
+  
+  for(s = 0; s < states; s++)
+    dist[s] = -1;
+  /* state is ((arrow * 2 + food) * 2 + gold) * cells + square */
+  s = 1 * n + 1;
+  dist[s] = 0;
+  deque[tail++] = s;
+  while(head != tail)
+  {
+    s = deque[head]; head = (head + 1) % cap;
+    x = (s % cells) / n; y = s % n;
+    gold = (s / cells) & 1; food = (s / cells / 2) & 1;
+    arrow = s / cells / 4;
+    d = dist[s];
+    score = -d + gold * SCORE_GOLD + food * SCORE_FOOD +
+      (arrow ? SCORE_SHOOT + SCORE_KILL : 0);
+    
+    if(score > best)
+      best = score;
+    /* the game is over once you are home with the gold */
+    if((gold && x == 1 && y == 1) || d >= MAP_MAXSTEPS)
+      continue;
+    
+    for(dir = 0; dir < 4; dir++)
+    {
+      x2 = x + dx[dir]; y2 = y + dy[dir];
+      c = map_at(x2, y2);
+      /* arrow 1 killed the wumpus, 2 killed the supmuw */
+      if(c == MAP_WUMPUS && arrow == 1)
+        c = MAP_EMPTY;
+      if(c == MAP_SUPMUW && arrow == 2)
+        c = MAP_EMPTY;
+      
+      /* shoot whatever is over there, it doesn't cost a step */
+      if(!arrow && (c == MAP_WUMPUS || c == MAP_SUPMUW))
+      {
+        t = ((((c == MAP_WUMPUS ? 1 : 2) * 2 + food) * 2 + gold) * cells) +
+          x * n + y;
+        if(dist[t] == -1 || dist[t] > d)
+        {
+          dist[t] = d;
+          head = (head - 1 + cap) % cap;
+          deque[head] = t;
+        }
+      }
+      
+      /* killing either one of them makes the supmuw friendly */
+      killed = arrow != 0;
+      if(c == MAP_WALL || c == MAP_PIT || c == MAP_WUMPUS ||
+         (c == MAP_SUPMUW && game.supmuw_neighbors_wumpus && !killed))
+        continue;
+      gold2 = gold || c == MAP_GOLD;
+      food2 = food || c == MAP_SUPMUW;
+      t = ((arrow * 2 + food2) * 2 + gold2) * cells + x2 * n + y2;
+      if(dist[t] == -1)
+      {
+        dist[t] = d + 1;
+        deque[tail] = t;
+        tail = (tail + 1) % cap;
+      }
+    }
+  }
+  free(dist);
+  free(deque);
+  return best;
+}
+
+/* returns a word for a map class */
+const char *word_from_class(int map_class)
+{
+  switch(map_class)
+  {
+    case MAP_CLASS_SOLVABLE:
+      return "solvable";
+    case MAP_CLASS_RISKY:
+      return "risky";
+    case MAP_CLASS_IMPOSSIBLE:
+      return "impossible";
+  }
+  return "unknown";
+}
+
+/* Intialize map with randomly placed obstackles */
+void init_game()
+{
+  int i;
+  
+  /* flag for determining if the supmuw is next to the wumpus. */
+  game.supmuw_neighbors_wumpus = 0;
+  game.quit = 0;
+  game.decisions = 0;
+  game.timeouts = 0;
+  game.decision_ns = 0;
+  game.kb_lookups = 0;
+  game.deadline = 0;
+  game.out_of_time = 0;
+  memset(game.latency, 0, sizeof(game.latency));
+  memset(game.counters, 0, sizeof(game.counters));
+  game.rng = game.seed;
+  
+  /* Place player at (1,1) */
+  game.x = 1;
+  game.y = 1;
+  game.reach = 1;
+  game.has_food = 0;
+  game.has_gold = 0;
+  game.arrows = 1;
+  game.percepts = 0;
+  game.score = 0;
+  game.steps_taken = 0;
+  game.dest_x = -1;
+  game.dest_y = -1;
+  
+  /* the map comes out of a --maps file, or is made up from the seed */
+  if(game.preset)
+    map_from_record(game.preset);
+  else
+    make_map();
+  
+  /* set up the database for the KB */
+  if(game.use_agent)
+  {
+    kb_init();
+    if(game.use_hpa)
+      hpa_init();
+    /*
+     * let the kb know about the outside walls. there are too many of them on
+     * a procedural map, there the agent has to bump into them like any other.
+     */
+    for(i = 0; game.kind != MAP_KIND_PROCEDURAL && i < game.size; i++)
+    {
+      kb_insert(PERCEPT_BUMP, i, 0);
+      kb_insert(PERCEPT_BUMP, i, game.size - 1);
+      kb_insert(PERCEPT_BUMP, 0, i);
+      kb_insert(PERCEPT_BUMP, game.size - 1, i);
+    }
+  }
+}
+
+/* makes up the map of a new game, and how hard it is, from game.rng */
+void make_map()
+{
+  int i, j, num_pits, num_walls, x, y;
+  
+  /* a procedural map has its walls and pits made up as it is looked at */
+  if(game.kind == MAP_KIND_PROCEDURAL)
+  {
+    game.chunk_slots = 64;
+    game.chunks = calloc(game.chunk_slots, sizeof(chunk *));
+  }
+  else
+  {
+    /* First create a Clean Slate */
+    game.map = malloc(map_bytes());
+#ifdef WUMPUS_PACKED_MAP
+    game.wumpus.x = game.wumpus.y = -1;
+    game.gold.x = game.gold.y = -1;
+    game.supmuw.x = game.supmuw.y = -1;
+#endif
+    for(j = 0; j < game.size; j++)
+      for(i = 0; i < game.size; i++)
+        map_put(i, j, MAP_EMPTY);
+    
+    /* Create walls around perimeter of map. one loop. figure it out. */
+    for(i = 0; i < game.size; i++)
+    {
+      map_put(i, 0, MAP_WALL);
+      map_put(i, game.size - 1, MAP_WALL);
+      map_put(0, i, MAP_WALL);
+      map_put(game.size - 1, i, MAP_WALL);
+    }
+  }
+  
+  /* a maze gets its walls first so everything else lands in the corridors */
+  if(game.kind == MAP_KIND_MAZE)
+    carve_maze();
+  
+  /* I maximize the number of pits to be 15% the size of the map */
+  if(game.kind != MAP_KIND_PROCEDURAL)
+  {
+    num_pits = (game_rand() % (int)(game.size * game.size * game.pit_ratio))
+      + 1;
+    for(i = 0; i < num_pits; i++)
+    {
+      random_map_x_y(&x, &y);
+      map_put(x, y, MAP_PIT);
+    }
+  }
+  
+  /* set up the interior walls in random locations. max 10% of mapsize */
+  if(game.kind == MAP_KIND_RANDOM)
+  {
+    num_walls = (game_rand() % (int)(game.size * game.size * game.wall_ratio))
+      + 1;
+    for(i = 0; i < num_walls; i++)
+    {
+      random_map_x_y(&x, &y);
+      map_put(x, y, MAP_WALL);
+    }
+  }
+  
+  /* Create Wumpus at Random Location */
+  random_map_x_y(&x, &y);
+  map_put(x, y, MAP_WUMPUS);
+  
+  /* Randomly place a pot - o - gold */
+  random_map_x_y(&x, &y);
+  map_put(x, y, MAP_GOLD);
+  
+  /* Place the Supmuw (wumpus cousin) */
+  random_map_x_y(&x, &y);
+  map_put(x, y, MAP_SUPMUW);
+  /* check to see if the supmuw neighbors the wumpus, used for percepts */
+  if(map_at(x, y + 1) == MAP_WUMPUS ||
+     map_at(x, y - 1) == MAP_WUMPUS ||
+     map_at(x + 1, y) == MAP_WUMPUS ||
+     map_at(x - 1, y) == MAP_WUMPUS)
+  {
+    game.supmuw_neighbors_wumpus = 1;
+  }
+  
+  /* how hard is it going to be? nobody knows without the whole map */
+  game.map_class = game.kind == MAP_KIND_PROCEDURAL ? -1 : classify_map();
+  game.oracle = game.size <= ORACLE_MAXSIZE && game.map_class >= 0 ?
+    oracle_score() : -1;
+}
+
+/*
+ * sets the game up with a map out of a --maps file. with a packed map the
+ * terrain is just copied, otherwise it gets unpacked a square at a time.
+ */
+void map_from_record(const map_record *record)
+{
+#ifndef WUMPUS_PACKED_MAP
+  static const char terrain[4] = { MAP_EMPTY, MAP_WALL, MAP_PIT, MAP_EMPTY };
+  int i;
+#endif
+  
+  game.seed = record->seed;
+  game.rng = record->rng;
+  game.map = malloc(map_bytes());
+#ifdef WUMPUS_PACKED_MAP
+  memcpy(game.map, record->cells, map_bytes());
+  game.wumpus.x = record->wumpus_x;
+  game.wumpus.y = record->wumpus_y;
+  game.gold.x = record->gold_x;
+  game.gold.y = record->gold_y;
+  game.supmuw.x = record->supmuw_x;
+  game.supmuw.y = record->supmuw_y;
+#else
+  for(i = 0; i < game.size * game.size; i++)
+    game.map[i] = terrain[(record->cells[i >> 2] >> ((i & 3) * 2)) & 3];
+  if(record->wumpus_x >= 0)
+    map_put(record->wumpus_x, record->wumpus_y, MAP_WUMPUS);
+  if(record->gold_x >= 0)
+    map_put(record->gold_x, record->gold_y, MAP_GOLD);
+  if(record->supmuw_x >= 0)
+    map_put(record->supmuw_x, record->supmuw_y, MAP_SUPMUW);
+#endif
+  game.supmuw_neighbors_wumpus = record->supmuw_neighbors_wumpus;
+  game.map_class = record->map_class;
+  game.oracle = record->oracle;
+}
+
+/* packs the map init_game() just made into a record for a --maps file */
+void map_to_record(map_record *record)
+{
+  int x, y, i, cell;
+  char here;
+  
+  memset(record->cells, 0, (game.size * game.size + 3) / 4);
+  record->seed = game.seed;
+  record->rng = game.rng;
+  record->oracle = game.oracle;
+  record->map_class = game.map_class;
+  record->supmuw_neighbors_wumpus = game.supmuw_neighbors_wumpus;
+  record->wumpus_x = record->wumpus_y = -1;
+  record->gold_x = record->gold_y = -1;
+  record->supmuw_x = record->supmuw_y = -1;
+  for(x = 0; x < game.size; x++)
+    for(y = 0; y < game.size; y++)
+    {
+      here = map_at(x, y);
+      cell = here == MAP_WALL ? MAP_CELL_WALL :
+        here == MAP_PIT ? MAP_CELL_PIT : MAP_CELL_EMPTY;
+      i = x * game.size + y;
+      record->cells[i >> 2] |= cell << ((i & 3) * 2);
+      if(here == MAP_WUMPUS)
+      {
+        record->wumpus_x = x;
+        record->wumpus_y = y;
+      }
+      else if(here == MAP_GOLD)
+      {
+        record->gold_x = x;
+        record->gold_y = y;
+      }
+      else if(here == MAP_SUPMUW)
+      {
+        record->supmuw_x = x;
+        record->supmuw_y = y;
+      }
+    }
+}
+
+/* cleans up after a game so the next one can start fresh */
+void end_game()
+{
+  /* cleanup for agent */
+  if(game.use_agent)
+  {
+    /* dumps the contents of the knowledge base to stderr */
+    if(!game.quiet)
+      kb_dump();
+    kb_close();
+    hpa_free();
+  }
+  free(look.table);
+  look.table = NULL;
+  free(game.route);
+  game.route = NULL;
+  game.route_cells = 0;
+  free(look.dist);
+  free(look.queue);
+  look.dist = look.queue = NULL;
+  look.cells = 0;
+  free(game.map);
+  game.map = NULL;
+  map_chunks_free();
+}
+
+/*
+ * Processes the player position and determines if any percepts fire.
+ * This checks the map given the player's current position and sets all flags
+ * as appropriate. The only flag not set is the PERCEPT_BUMP flag which _must_
+ * be set by the action_move() function since the player cannot occupy the
+ * same square as the wall.
+ */
+void process_percepts()
+{
+  int x = game.x, y = game.y, flags = 0;
+  long long started = now_ns();
+  pmu_count began;
+  char here, north, south, east, west;
+  
+  pmu_read(&began);
+  here = map_at(x, y);
+  north = map_at(x, y - 1);
+  south = map_at(x, y + 1);
+  east = map_at(x + 1, y);
+  west = map_at(x - 1, y);
+  if(x > game.reach)
+    game.reach = x;
+  if(y > game.reach)
+    game.reach = y;
+  
+  /* the move function sets this percept */
+  int bumped = game.percepts & PERCEPT_BUMP;
+  if(bumped)
+    flags |= PERCEPT_BUMP;
+  /* see if the player is dead, first */
+  if(here == MAP_PIT || here == MAP_WUMPUS ||
+     (here == MAP_SUPMUW && game.supmuw_neighbors_wumpus))
+  {
+    flags |= PERCEPT_DEAD;
+    add_score(SCORE_DEATH);
+    log_event(EVENT_DEATH, x, y, 0);
+    if(here == MAP_PIT)
+      message("You have fallen into a pit!\n");
+    else
+      message("You have been consumed by the beast!\n");
+  }
+  if(north == MAP_WUMPUS ||
+     south == MAP_WUMPUS ||
+     east == MAP_WUMPUS ||
+     west == MAP_WUMPUS)
+    flags |= PERCEPT_SMELL;
+  if(north == MAP_PIT ||
+     south == MAP_PIT ||
+     east == MAP_PIT ||
+     west == MAP_PIT)
+    flags |= PERCEPT_BREEZE;
+  if(north == MAP_SUPMUW ||
+     south == MAP_SUPMUW ||
+     east == MAP_SUPMUW ||
+     west == MAP_SUPMUW)
+    flags |= PERCEPT_MOO;
+  if(here == MAP_GOLD)
+    flags |= PERCEPT_GLITTER;
+  if(flags & PERCEPT_MOO && game.supmuw_neighbors_wumpus)
+    flags |= PERCEPT_SMELL;
+  game.percepts = flags;
+  if(game.use_agent && spec.active)
+    speculate_arrived();
+  else if(game.use_agent)
+    kb_tell();
+  hist_record(&game.latency[PHASE_SENSE], now_ns() - started);
+  pmu_add(PHASE_SENSE, &began);
+}
+
+/* unknown action */
+void unknown_action()
+{
+  message("Do what now? (Unknown action)\n");
+}
+
+/* does what the player wants */
+void process_player_command(char choice)
+{
+  if(game.publishing)
+    game.spectate.action = choice;
+  log_event(EVENT_ACTION, game.x, game.y, choice);
+  switch(choice)
+  {
+    case '?':
+      print_help();
+      break;
+    case 'q':
+      action_quit();
+      break;
+    case 'n':
+    case 'k':
+      action_move(DIRECTION_NORTH);
+      break;
+    case 's':
+    case 'j':
+      action_move(DIRECTION_SOUTH);
+      break;
+    case 'e':
+    case 'l':
+      action_move(DIRECTION_EAST);
+      break;
+    case 'w':
+    case 'h':
+      action_move(DIRECTION_WEST);
+      break;
+    case 'N':
+      action_shoot(DIRECTION_NORTH);
+      break;
+    case 'S':
+      action_shoot(DIRECTION_SOUTH);
+      break;
+    case 'E':
+      action_shoot(DIRECTION_EAST);
+      break;
+    case 'W':
+      action_shoot(DIRECTION_WEST);
+      break;
+    case 'g':
+      action_grab();
+      break;
+    default:
+      unknown_action();
+  }
+}
+
+/* which way a move or shot command goes, 0 for anything else */
+int command_direction(char choice)
+{
+  switch(choice)
+  {
+    case 'n': case 'k': case 'N':
+      return DIRECTION_NORTH;
+    case 's': case 'j': case 'S':
+      return DIRECTION_SOUTH;
+    case 'e': case 'l': case 'E':
+      return DIRECTION_EAST;
+    case 'w': case 'h': case 'W':
+      return DIRECTION_WEST;
+  }
+  return 0;
+}
+
+/* get user defined inputs */
+void user_input()
+{
+  char choice;
+  if(screen.active)
+    choice = raw_key();
+  else
+  {
+    printf(SCREEN_PROMPT);
+    scanf("%1s", &choice);
+  }
+  process_player_command(choice);
+}
+
+/*
+ * Puts the terminal in non-canonical mode without echo so raw_key() gets
+ * every key as it is pressed, and makes room for the screen under whatever
+ * was printed before. Signals still work, and the terminal is put back
+ * however the game ends.
+ */
+void raw_begin()
+{
+  struct termios term;
+  int i;
+  if(tcgetattr(STDIN_FILENO, &screen.saved) != 0)
+  {
+    perror("raw_begin: tcgetattr");
+    return;
+  }
+  term = screen.saved;
+  term.c_lflag &= ~(ICANON | ECHO);
+  term.c_cc[VMIN] = 1;
+  term.c_cc[VTIME] = 0;
+  if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &term) != 0)
+  {
+    perror("raw_begin: tcsetattr");
+    return;
+  }
+  screen.active = 1;
+  atexit(raw_end);
+  signal(SIGINT, raw_signal);
+  signal(SIGTERM, raw_signal);
+  
+  /* blank lines to draw over, the cursor stays on the last one */
+  memset(screen.lines, 0, sizeof(screen.lines));
+  for(i = 1; i < SCREEN_LINES; i++)
+    printf("\n");
+  printf(SCREEN_PROMPT);
+  strcpy(screen.lines[SCREEN_LINES - 1], SCREEN_PROMPT);
+  fflush(stdout);
+}
+
+/* shows the last of the messages and gives the terminal back */
+void raw_end()
+{
+  if(!screen.active)
+    return;
+  screen_draw();
+  tcsetattr(STDIN_FILENO, TCSAFLUSH, &screen.saved);
+  screen.active = 0;
+  printf("\n");
+  fflush(stdout);
+}
+
+/* killed in the middle of a game, the terminal still has to come back */
+void raw_signal(int sig)
+{
+  tcsetattr(STDIN_FILENO, TCSAFLUSH, &screen.saved);
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+/*
+ * One key from the terminal. The arrow keys come in as ESC [ A through D and
+ * are turned into moves, anything else is handed back as is. End of input
+ * quits.
+ */
+char raw_key()
+{
+  static const char arrows[] = "nsew";
+  struct termios term;
+  char c, seq[2];
+  int n = 0;
+  if(read(STDIN_FILENO, &c, 1) != 1)
+    return 'q';
+  if(c != '\033')
+    return c;
+  
+  /* a lone escape has nothing after it, so only wait a little for the rest */
+  tcgetattr(STDIN_FILENO, &term);
+  term.c_cc[VMIN] = 0;
+  term.c_cc[VTIME] = 1;
+  tcsetattr(STDIN_FILENO, TCSANOW, &term);
+  while(n < 2 && read(STDIN_FILENO, seq + n, 1) == 1)
+    n++;
+  term.c_cc[VMIN] = 1;
+  term.c_cc[VTIME] = 0;
+  tcsetattr(STDIN_FILENO, TCSANOW, &term);
+  if(n == 2 && seq[0] == '[' && seq[1] >= 'A' && seq[1] <= 'D')
+    return arrows[seq[1] - 'A'];
+  return c;
+}
+
+/*
+ * get agent (AI) desired action, asks the knowledge base and guesses for the
+ * best course of action.
+ */
+void agent_input()
+{
+  long long started = now_ns(), decided, finished;
+  pmu_count began, acting;
+  char choice;
+  
+  pmu_read(&began);
+  game.decisions++;
+  game.out_of_time = 0;
+  game.deadline = game.move_budget ? started + game.move_budget :
+    game.lookahead ? started + LOOKAHEAD_BUDGET : 0;
+  if(spec.active)
+    choice = speculate_adopt();
+  else
+    choice = game.lookahead ? lookahead_action() : kb_ask_action();
+  decided = now_ns();
+  game.decision_ns += decided - started;
+  hist_record(&game.latency[PHASE_DECIDE], decided - started);
+  pmu_add(PHASE_DECIDE, &began);
+  pmu_read(&acting);
+  if(game.out_of_time)
+    game.timeouts++;
+  message("agent_input: %c\n", choice);
+  if(spec.running)
+    speculate_start(choice);
+  process_player_command(choice);
+  finished = now_ns();
+  hist_record(&game.latency[PHASE_ACT], finished - decided);
+  hist_record(&game.latency[PHASE_TURN], finished - started);
+  pmu_add(PHASE_ACT, &acting);
+  pmu_add(PHASE_TURN, &began);
+}
+
+/* prints a game message unless the game is being played headless */
+void message(const char *format, ...)
+{
+  va_list args;
+  int room = sizeof(screen.pending) - screen.pending_len, n;
+  if(game.quiet)
+    return;
+  va_start(args, format);
+  /* the raw screen shows them all at once on the next draw */
+  if(screen.active)
+  {
+    n = vsnprintf(screen.pending + screen.pending_len, room, format, args);
+    screen.pending_len += (n < room ? n : room - 1);
+  }
+  else
+    vprintf(format, args);
+  va_end(args);
+}
+
+/* prints help for a user */
+void print_help()
+{
+  message("Usable commands:\n");
+  message(" n,s,e,w    Move in direction given (also VI keybindings)\n");
+  message(" N,S,E,W    Shoot in direction given\n");
+  message(" g          Grab gold\n");
+  message(" q          Quit\n");
+}
+
+/* display the current environment */
+void print_map()
+{
+  int i = 0, j = 0, left = 0, top = 0, right = game.size, bottom = game.size;
+  
+  /* a procedural map is too big to print, show what is around the player */
+  if(game.kind == MAP_KIND_PROCEDURAL && game.size > MAP_VIEW)
+  {
+    left = game.x < MAP_VIEW / 2 ? 0 : game.x - MAP_VIEW / 2;
+    top = game.y < MAP_VIEW / 2 ? 0 : game.y - MAP_VIEW / 2;
+    left = left > game.size - MAP_VIEW ? game.size - MAP_VIEW : left;
+    top = top > game.size - MAP_VIEW ? game.size - MAP_VIEW : top;
+    right = left + MAP_VIEW;
+    bottom = top + MAP_VIEW;
+  }
+  for(j = top; j < bottom; j++)
+  {
+    for(i = left; i < right; i++)
+    {
+      if(i == game.x && j == game.y)
+        printf("%c", MAP_PLAYER);
+      else
+        printf("%c", map_at(i, j));
+    }
+    printf("\n");
+  }
+  printf("\n");
+}
+
+/* prints out what percepts the player feels */
+void print_percepts()
+{
+  char line[SCREEN_WIDTH];
+  format_percepts(line, sizeof(line));
+  printf("%s\n", line);
+}
+
+/* prints out the player's score */
+void print_score()
+{
+  char line[SCREEN_WIDTH];
+  format_score(line, sizeof(line));
+  printf("%s\n", line);
+}
+
+/* the percepts line, for print_percepts() and the raw screen */
+void format_percepts(char *line, size_t size)
+{
+  char *nopercept = "None";
+  snprintf(line, size, "Percepts: [%s,%s,%s,%s,%s,%s]",
+    (game.percepts & PERCEPT_BUMP ? "Bump" : nopercept),
+    (game.percepts & PERCEPT_SMELL ? "Smell" : nopercept),
+    (game.percepts & PERCEPT_BREEZE ? "Breeze" : nopercept),
+    (game.percepts & PERCEPT_MOO ? "Moo" : nopercept),
+    (game.percepts & PERCEPT_GLITTER ? "Glitter" : nopercept),
+    (game.percepts & PERCEPT_DEAD ? "Dead" : nopercept));
+}
+
+/* the score line, for print_score() and the raw screen */
+void format_score(char *line, size_t size)
+{
+  snprintf(line, size, "Score: %5d\tSteps Taken: %3d/%d", game.score,
+    game.steps_taken, MAP_MAXSTEPS);
+}
+
+/*
+ * Brings the raw screen up to date. Each line is checked against what was
+ * drawn there last time and only the ones that changed are sent, moving up to
+ * them from the prompt and back again, so a turn is usually just the score and
+ * a message or two. The whole update goes out in one write.
+ */
+void screen_draw()
+{
+  char lines[SCREEN_LINES][SCREEN_WIDTH];
+  char out[SCREEN_LINES * (SCREEN_WIDTH + 16)];
+  char *p = screen.pending, *eol;
+  int i, n, len = 0, up;
+  
+  memset(lines, 0, sizeof(lines));
+  format_percepts(lines[0], SCREEN_WIDTH);
+  format_score(lines[1], SCREEN_WIDTH);
+  /* one line per message, whatever does not fit is dropped */
+  screen.pending[screen.pending_len] = '\0';
+  for(i = 2; i < SCREEN_LINES - 1 && *p; i++)
+  {
+    eol = strchr(p, '\n');
+    n = eol ? eol - p : (int)strlen(p);
+    snprintf(lines[i], SCREEN_WIDTH, "%.*s", n, p);
+    p += eol ? n + 1 : n;
+  }
+  screen.pending_len = 0;
+  strcpy(lines[SCREEN_LINES - 1], SCREEN_PROMPT);
+  
+  for(i = 0; i < SCREEN_LINES - 1; i++)
+  {
+    if(strcmp(lines[i], screen.lines[i]) == 0)
+      continue;
+    up = SCREEN_LINES - 1 - i;
+    len += sprintf(out + len, "\033[%dA\r\033[2K%s\033[%dB", up, lines[i],
+      up);
+    strcpy(screen.lines[i], lines[i]);
+  }
+  if(len == 0)
+    return;
+  /* back to where the prompt ends */
+  len += sprintf(out + len, "\r%s", SCREEN_PROMPT);
+  fwrite(out, 1, len, stdout);
+  fflush(stdout);
+}
+
+/* helper to tell if the player is dead */
+int player_dead()
+{
+  return (game.percepts & PERCEPT_DEAD);
+}
+
+/* you have won when you have the gold and are at the start square */
+int has_won()
+{
+  return (game.x == 1 && game.y == 1 && game.has_gold);
+}
+
+/*
+ * you lose when your score is less than SCORE_MIN or have taken more than
+ * MAP_MAXSTEPS or you have died.
+ */
+int has_lost()
+{
+  return (game.score < SCORE_MIN || game.steps_taken > MAP_MAXSTEPS ||
+    player_dead());
+}
+
+/*
+ * figures out which direction the user wants to go and updates
+ * pointers to the new coordinates. returns a string for printing which
+ * direction was processed.
+ */
+char *delta_coordinates(int *x, int *y, int direction)
+{
+  /* add the direction onto the coordinate */
+  switch(direction)
+  {
+    case DIRECTION_NORTH:
+      (*y)--;
+      return "North";
+      break;
+    case DIRECTION_SOUTH:
+      (*y)++;
+      return "South";
+      break;
+    case DIRECTION_EAST:
+      (*x)++;
+      return "East";
+      break;
+    case DIRECTION_WEST:
+      (*x)--;
+      return "West";
+      break;
+  }
+  return "Unknown";
+}
+
+/* adds score into the game */
+void add_score(int delta)
+{
+  game.score += delta;
+}
+
+/* moves the player around. also requires a direction. */
+void action_move(int direction)
+{
+  int x2 = game.x, y2 = game.y;
+  add_score(SCORE_MOVE);
+  game.steps_taken++;
+  message("Moving %s ", delta_coordinates(&x2, &y2, direction));
+  message("(%d, %d)\n", x2, y2);
+  
+  /* this function will process bumps */
+  if(map_at(x2, y2) == MAP_WALL)
+  {
+    game.percepts |= PERCEPT_BUMP;
+    message("You bumped into a wall!\n");
+    log_event(EVENT_BUMP, x2, y2, 0);
+    /* just go ahead and back out if you bump into something */
+    if(game.use_agent)
+    {
+      /* must tell the kb about this... */
+      kb_bumped(x2, y2);
+    }
+    return;
+  }
+  
+  /* see if you are in the same square as a supmuw */
+  if(map_at(x2, y2) == MAP_SUPMUW &&
+     !game.has_food && !game.supmuw_neighbors_wumpus)
+  {
+    game.has_food = 1;
+    message("The supmuw has gifted food to you!\n");
+    add_score(SCORE_FOOD);
+    log_event(EVENT_FOOD, x2, y2, 0);
+  }
+  
+  /* now go ahead and move the player */
+  game.x = x2; game.y = y2;
+  log_event(EVENT_MOVE, x2, y2, 0);
+}
+
+/* shoots arrows. requires a direction */
+void action_shoot(int direction)
+{
+  int x2 = game.x, y2 = game.y;
+
+  if(!game.arrows)
+  {
+    message("You are out of arrows!\n");
+    return;
+  }
+  
+  message("Shooting %s\n", delta_coordinates(&x2, &y2, direction));
+  add_score(SCORE_SHOOT);
+  game.arrows--;
+  log_event(EVENT_SHOOT, x2, y2, game.arrows);
+  if(map_at(x2, y2) == MAP_WUMPUS || map_at(x2, y2) == MAP_SUPMUW)
+  {
+    add_score(SCORE_KILL);
+    message("You hear a deafening scream as you slay the beast.\n");
+    log_event(EVENT_KILL, x2, y2, 0);
+    map_put(x2, y2, MAP_EMPTY);
+    /* regardless of who you kill, the supmuw does not neighbor wumpus */
+    game.supmuw_neighbors_wumpus = 0;
+    game.heard_scream = 1;
+
+    /* tell the agent that the thing was killed */    
+    if(game.use_agent)
+      kb_killed(x2, y2);
+  }
+}
+
+/* grabs gold if possible */
+void action_grab()
+{
+  if(map_at(game.x, game.y) == MAP_GOLD)
+  {
+    add_score(SCORE_GOLD);
+    message("You have found gold!\n");
+    log_event(EVENT_GOLD, game.x, game.y, 0);
+    map_put(game.x, game.y, MAP_EMPTY);
+    game.has_gold = 1;
+    if(game.use_agent)
+      kb_grabbed();
+  }
+}
+
+/* quits the game, the game loop stops once the current turn is done */
+void action_quit()
+{
+  game.quit = 1;
+}
+
+/* shows how the game went once it is over */
+void print_analysis()
+{
+  printf("\nFinal Analysis of gameplay\n");
+  /* show the final map */
+  print_map();
+  /* show the final set of percepts */
+  print_percepts();
+  
+  /* one last chance to make fun of the player */
+  if(has_lost())
+    printf("Apparently you are not a winner. That would make you a loser.\n");
+  if(player_dead())
+    printf("You have died. Indiana Jones would be ashamed.\n");
+  if(has_won())
+    printf("You have won, the plantation is saved. Glory! Glory!\n");
+  if(game.oracle >= 0)
+    printf("This map was %s, the best possible score was %d.\n",
+      word_from_class(game.map_class), game.oracle);
+  else if(game.map_class >= 0)
+    printf("This map was %s.\n", word_from_class(game.map_class));
+  if(game.use_agent)
+    print_latency(game.latency);
+  if(game.use_counters)
+    print_counters(game.counters, game.latency);
+  if(game.lookahead)
+    printf("Lookahead: %lld states searched, %lld more from the "
+      "transposition table\n", look.nodes, look.hits);
+  
+  /* final score */
+  print_score();
+}
+
+#ifndef WUMPUS_TILED_KB
+/*
+ * Hands SQLite the heap, page cache and lookaside of struct KB_HEAP, all made
+ * out of megabytes of memory taken up front. It has to happen before SQLite
+ * is used for anything. Returns 1 if SQLite won't have it.
+ */
+int kb_heap_init(int megabytes)
+{
+  static sqlite3_mem_methods methods = {
+    kb_heap_malloc, kb_heap_free, kb_heap_realloc, kb_heap_size,
+    kb_heap_roundup, kb_heap_start, kb_heap_stop, NULL
+  };
+  size_t bytes = (size_t)megabytes << 20;
+  int header = 0;
+  
+  sqlite3_config(SQLITE_CONFIG_PCACHE_HDRSZ, &header);
+  kb_heap.page_size = (KB_HEAP_PAGE + header + 15) & ~15;
+  kb_heap.page_count = bytes / 4 / kb_heap.page_size;
+  kb_heap.size = bytes - (size_t)kb_heap.page_count * kb_heap.page_size;
+  /* touch all of it now so the games don't even fault the pages in */
+  if((kb_heap.base = aligned_alloc(4096, bytes)) == NULL)
+  {
+    perror("kb_heap_init");
+    return 1;
+  }
+  memset(kb_heap.base, 0, bytes);
+  pthread_mutex_init(&kb_heap.lock, NULL);
+  
+  /* the heap keeps its own count, SQLite's takes a lock on every malloc */
+  if(sqlite3_config(SQLITE_CONFIG_MEMSTATUS, 0) != SQLITE_OK ||
+     sqlite3_config(SQLITE_CONFIG_MALLOC, &methods) != SQLITE_OK ||
+     sqlite3_config(SQLITE_CONFIG_PAGECACHE, kb_heap.base + kb_heap.size,
+       kb_heap.page_size, kb_heap.page_count) != SQLITE_OK ||
+     sqlite3_config(SQLITE_CONFIG_LOOKASIDE, KB_LOOKASIDE_SLOT,
+       KB_LOOKASIDE_SLOTS) != SQLITE_OK)
+  {
+    fprintf(stderr, "KB_HEAP_INIT: SQLite is already running\n");
+    return 1;
+  }
+  atexit(kb_heap_report);
+  return 0;
+}
+
+/* the smallest piece that fits bytes and its header, or KB_HEAP_CLASSES */
+static int kb_heap_class(int bytes)
+{
+  int c = 0;
+  while(c < KB_HEAP_CLASSES &&
+        (1 << (c + KB_HEAP_MIN_BITS)) < bytes + (int)sizeof(long long))
+    c++;
+  return c;
+}
+
+/* raises a high water mark, other threads may be raising it too */
+static void kb_heap_raise(long long *mark, long long value)
+{
+  long long seen = __atomic_load_n(mark, __ATOMIC_RELAXED);
+  while(value > seen && !__atomic_compare_exchange_n(mark, &seen, value, 1,
+          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/*
+ * SQLite's malloc(). The piece comes from the thread's own freed ones, then
+ * the shared ones, then the part of the heap not cut up yet. Anything bigger
+ * than the biggest piece, or once the heap is used up, goes to malloc() and
+ * its header has minus its size instead.
+ */
+static void *kb_heap_malloc(int bytes)
+{
+  int c = kb_heap_class(bytes);
+  long long *piece = NULL, size = 1LL << (c + KB_HEAP_MIN_BITS);
+  
+  kb_heap_raise(&kb_heap.largest, bytes);
+  if(c < KB_HEAP_CLASSES && kb_cache.free[c])
+  {
+    piece = (long long *)kb_cache.free[c];
+    kb_cache.free[c] = kb_cache.free[c]->next;
+    kb_cache.count[c]--;
+  }
+  else if(c < KB_HEAP_CLASSES)
+  {
+    pthread_mutex_lock(&kb_heap.lock);
+    if(kb_heap.free[c])
+    {
+      piece = (long long *)kb_heap.free[c];
+      kb_heap.free[c] = kb_heap.free[c]->next;
+    }
+    else if(kb_heap.top + size <= kb_heap.size)
+    {
+      piece = (long long *)(kb_heap.base + kb_heap.top);
+      kb_heap.top += size;
+    }
+    pthread_mutex_unlock(&kb_heap.lock);
+  }
+  if(piece)
+    *piece = c;
+  else
+  {
+    size = bytes + sizeof(long long);
+    if((piece = malloc(size)) == NULL)
+      return NULL;
+    *piece = -size;
+    __atomic_add_fetch(&kb_heap.overflows, 1, __ATOMIC_RELAXED);
+  }
+  kb_heap_raise(&kb_heap.peak,
+    __atomic_add_fetch(&kb_heap.in_use, size, __ATOMIC_RELAXED));
+  return piece + 1;
+}
+
+/* SQLite's free(), the piece is kept for the next one of its size */
+static void kb_heap_free(void *p)
+{
+  long long *piece = (long long *)p - 1;
+  int c = *piece;
+  
+  if(*piece < 0)
+  {
+    __atomic_add_fetch(&kb_heap.in_use, *piece, __ATOMIC_RELAXED);
+    free(piece);
+    return;
+  }
+  __atomic_sub_fetch(&kb_heap.in_use, 1LL << (c + KB_HEAP_MIN_BITS),
+    __ATOMIC_RELAXED);
+  if(kb_cache.count[c] < KB_HEAP_CACHE)
+  {
+    ((kb_piece *)piece)->next = kb_cache.free[c];
+    kb_cache.free[c] = (kb_piece *)piece;
+    kb_cache.count[c]++;
+    return;
+  }
+  pthread_mutex_lock(&kb_heap.lock);
+  ((kb_piece *)piece)->next = kb_heap.free[c];
+  kb_heap.free[c] = (kb_piece *)piece;
+  pthread_mutex_unlock(&kb_heap.lock);
+}
+
+/* SQLite's realloc(), which only moves it if it no longer fits its piece */
+static void *kb_heap_realloc(void *p, int bytes)
+{
+  long long *piece = (long long *)p - 1;
+  void *moved;
+  int size = kb_heap_size(p);
+  
+  if(*piece >= 0 && bytes <= size)
+    return p;
+  if((moved = kb_heap_malloc(bytes)) == NULL)
+    return NULL;
+  memcpy(moved, p, bytes < size ? bytes : size);
+  kb_heap_free(p);
+  return moved;
+}
+
+/* how much can go in what kb_heap_malloc() gave out */
+static int kb_heap_size(void *p)
+{
+  long long *piece = (long long *)p - 1;
+  if(*piece < 0)
+    return -*piece - sizeof(long long);
+  return (1 << (*piece + KB_HEAP_MIN_BITS)) - sizeof(long long);
+}
+
+/* how much kb_heap_malloc() is really going to give for so many bytes */
+static int kb_heap_roundup(int bytes)
+{
+  int c = kb_heap_class(bytes);
+  if(c < KB_HEAP_CLASSES)
+    return (1 << (c + KB_HEAP_MIN_BITS)) - sizeof(long long);
+  return (bytes + 7) & ~7;
+}
+
+/* kb_heap_init() already did all of it */
+static int kb_heap_start(void *unused)
+{
+  return SQLITE_OK;
+}
+
+/* the heap lasts until the program exits */
+static void kb_heap_stop(void *unused)
+{
+}
+
+/* shows how much of the heap and page cache the games needed at most */
+void kb_heap_report()
+{
+  int now, pages, spilled;
+  
+  sqlite3_status(SQLITE_STATUS_PAGECACHE_USED, &now, &pages, 0);
+  sqlite3_status(SQLITE_STATUS_PAGECACHE_OVERFLOW, &now, &spilled, 0);
+  printf("\nKB heap: %.2f MB in use at most, %.2f of %.2f MB cut up, "
+    "largest ask %lld bytes\n", kb_heap.peak / 1048576.0,
+    kb_heap.top / 1048576.0, kb_heap.size / 1048576.0, kb_heap.largest);
+  printf("KB heap: %lld asks had to go to malloc()\n", kb_heap.overflows);
+  printf("Page cache: %d of %d pages at most, %d bytes more from the heap\n",
+    pages, kb_heap.page_count, spilled);
+  if(sqlite3_compileoption_used("OMIT_LOOKASIDE"))
+    printf("Lookaside: left out of this SQLite\n");
+  else
+    printf("Lookaside: %lld hits, %lld misses\n", kb_heap.lookaside_hits,
+      kb_heap.lookaside_misses);
+}
+
+/* initialize the knowledge base. builds an sqlite3 RAM db and build tables */
+void kb_init()
+{
+  char *err_msg;
+  int res = 0;
+  
+  game.kb_hash = 0;
+  /* make db */
+  res = sqlite3_open(":memory:", &game.db);
+  if(res)
+  {
+    fprintf(stderr, "KB_INIT: %s\n",
+      sqlite3_errmsg(game.db));
+    sqlite3_close(game.db);
+    exit(1);
+  }
+  kb_memo_forget(game.db);
+  
+  /* random() in SQL would not follow the game seed, so use our own */
+  sqlite3_create_function(game.db, "game_random", 0, SQLITE_UTF8, NULL,
+    game_random_sql, NULL, NULL);
+  
+  /* create the knowledge base table */
+  res = sqlite3_exec(game.db,
+    /* no primary key, you get locking errors if you do... */
+    "CREATE TABLE kb (sentence INT, x INT, y INT);",
+    NULL, 0, &err_msg);
+  if(res != SQLITE_OK)
+  {
+    fprintf(stderr, "KB_INIT: %s\n", err_msg);
+    sqlite3_free(err_msg);
+    exit(1);
+  }
+}
+
+/* closes the database stuff */
+void kb_close()
+{
+  kb_release(game.db);
+}
+
+/* closes a knowledge base that is not the game's, see kb_clone() */
+void kb_release(knowledge *kb)
+{
+  int now, hits, small, full;
+  if(kb_heap.base)
+  {
+    sqlite3_db_status(kb, SQLITE_DBSTATUS_LOOKASIDE_HIT, &now, &hits, 0);
+    sqlite3_db_status(kb, SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE, &now, &small, 0);
+    sqlite3_db_status(kb, SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL, &now, &full, 0);
+    __atomic_add_fetch(&kb_heap.lookaside_hits, hits, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&kb_heap.lookaside_misses, small + full,
+      __ATOMIC_RELAXED);
+  }
+  kb_memo_forget(kb);
+  sqlite3_close(kb);
+}
+
+/* makes a private copy of a knowledge base, tables, rows and all */
+knowledge *kb_clone(knowledge *from)
+{
+  sqlite3 *db;
+  sqlite3_backup *backup;
+  
+  if(sqlite3_open(":memory:", &db))
+  {
+    fprintf(stderr, "KB_CLONE: %s\n", sqlite3_errmsg(db));
+    sqlite3_close(db);
+    exit(1);
+  }
+  sqlite3_create_function(db, "game_random", 0, SQLITE_UTF8, NULL,
+    game_random_sql, NULL, NULL);
+  backup = sqlite3_backup_init(db, "main", from, "main");
+  if(backup == NULL)
+  {
+    fprintf(stderr, "KB_CLONE: %s\n", sqlite3_errmsg(db));
+    exit(1);
+  }
+  sqlite3_backup_step(backup, -1);
+  sqlite3_backup_finish(backup);
+  /* the memo could still be about an old kb that was closed right here */
+  kb_memo_forget(db);
+  return db;
+}
+
+/*
+ * the memo's slot for a fact about the game's kb, empty if it hasn't been
+ * asked about yet. makes the memo first if it has to. only kb_memo_fill()
+ * puts anything in a slot, so only it ever has to make room.
+ */
+kb_memo_entry *kb_memo_at(int sentence, int x, int y)
+{
+  kb_memo_entry *e;
+  int i;
+  unsigned int h = ((unsigned int)x * 73856093u) ^
+    ((unsigned int)y * 19349663u) ^ ((unsigned int)sentence * 83492791u);
+  
+  if(kb_memo.db != game.db || !kb_memo.slots)
+  {
+    kb_memo_forget(kb_memo.db);
+    kb_memo.db = game.db;
+    kb_memo.slot_count = KB_MEMO_SLOTS;
+    kb_memo.slots = calloc(kb_memo.slot_count, sizeof(kb_memo_entry));
+  }
+  if(kb_memo.slots == NULL)
+  {
+    fprintf(stderr, "KB_MEMO_AT: out of memory\n");
+    exit(1);
+  }
+  
+  for(i = h & (kb_memo.slot_count - 1); kb_memo.slots[i].sentence;
+      i = (i + 1) & (kb_memo.slot_count - 1))
+  {
+    e = &kb_memo.slots[i];
+    if(e->sentence == sentence && e->x == x && e->y == y)
+      return e;
+  }
+  e = &kb_memo.slots[i];
+  e->x = x;
+  e->y = y;
+  return e;
+}
+
+/* writes down whether the game's kb has a fact, doubling the memo if full */
+void kb_memo_fill(int sentence, int x, int y, int found)
+{
+  kb_memo_entry *e = kb_memo_at(sentence, x, y), *old = kb_memo.slots;
+  int i, old_count = kb_memo.slot_count;
+  
+  if(!e->sentence && 2 * (kb_memo.count + 1) > kb_memo.slot_count)
+  {
+    kb_memo.slot_count *= 2;
+    kb_memo.slots = calloc(kb_memo.slot_count, sizeof(kb_memo_entry));
+    kb_memo.count = 0;
+    if(kb_memo.slots == NULL)
+    {
+      fprintf(stderr, "KB_MEMO_FILL: out of memory\n");
+      exit(1);
+    }
+    for(i = 0; i < old_count; i++)
+      if(old[i].sentence)
+        kb_memo_fill(old[i].sentence, old[i].x, old[i].y, old[i].found);
+    free(old);
+    e = kb_memo_at(sentence, x, y);
+  }
+  if(!e->sentence)
+    kb_memo.count++;
+  e->sentence = sentence;
+  e->found = found;
+}
+
+/* private callback for kb_memo_load(), every row is a fact */
+static int kb_memo_load_callback(void *unused, int argc, char **argv,
+  char **cols)
+{
+  kb_memo_fill(atoi(argv[0]), atoi(argv[1]), atoi(argv[2]), 1);
+  return 0;
+}
+
+/*
+ * reads the whole kb into the memo, so the memo is the kb until it is
+ * forgotten or complete is cleared. the lookahead works on it that way, its
+ * changes never get to SQLite because they are all undone before it is done.
+ */
+void kb_memo_load()
+{
+  char *err_msg;
+  
+  if(sqlite3_exec(game.db, "SELECT sentence, x, y FROM kb;",
+     kb_memo_load_callback, NULL, &err_msg) != SQLITE_OK)
+  {
+    fprintf(stderr, "KB_MEMO_LOAD: %s\n", err_msg);
+    sqlite3_free(err_msg);
+    return;
+  }
+  kb_memo.complete = 1;
+}
+
+/* throws the memo away if it is about kb */
+void kb_memo_forget(knowledge *kb)
+{
+  if(kb_memo.db != kb)
+    return;
+  free(kb_memo.slots);
+  kb_memo.slots = NULL;
+  kb_memo.db = NULL;
+  kb_memo.slot_count = kb_memo.count = kb_memo.complete = 0;
+}
+
+/* private callback that just sees if a row has been found */
+static int kb_found_callback(void *found, int argc, char **argv, char **cols)
+{
+  if(argc > 0)
+    *((int *)found) = 1;
+  return 0;
+}
+
+/* finds a row in the kb, asking SQLite only the first time */
+int kb_found(int sentence, int x, int y)
+{
+  int res = 0, found = 0;
+  char query[128], *err_msg;
+  kb_memo_entry *memo = kb_memo_at(sentence, x, y);
+  
+  game.kb_lookups++;
+  if(memo->sentence)
+    return memo->found;
+  if(kb_memo.complete)
+    return 0;
+  sprintf(query,
+    "SELECT * FROM KB WHERE x = %d AND y = %d AND sentence = %d LIMIT 1;",
+    x, y, sentence);
+  res = sqlite3_exec(game.db, query, kb_found_callback, (void *)&found,
+    &err_msg);
+  if(res != SQLITE_OK)
+  {
+    fprintf(stderr, "KB_FOUND: %s\n", err_msg);
+    sqlite3_free(err_msg);
+  }
+  else
+    kb_memo_fill(sentence, x, y, found);
+  return found;
+}
+
+/* private callback for kb_around(), the top left square comes in first */
+static int kb_around_callback(void *to, int argc, char **argv, char **cols)
+{
+  int *around = (int *)to;
+  around[2] |= 1 << ((atoi(argv[1]) - around[1]) * 3 + atoi(argv[0]) -
+    around[0]);
+  return 0;
+}
+
+/*
+ * the squares around x, y that sentence is true of, see AROUND(). unless the
+ * memo knows all nine, they come from one query and go into the memo.
+ */
+int kb_around(int sentence, int x, int y)
+{
+  /* where the top left square is, and then what was found */
+  int around[3] = { x - 1, y - 1, 0 }, i, res, missing = 0;
+  char query[192], *err_msg;
+  kb_memo_entry *memo;
+  
+  game.kb_lookups++;
+  for(i = 0; i < 9; i++)
+  {
+    memo = kb_memo_at(sentence, x + i % 3 - 1, y + i / 3 - 1);
+    missing |= !memo->sentence;
+    around[2] |= memo->sentence && memo->found ? 1 << i : 0;
+  }
+  if(!missing || kb_memo.complete)
+    return around[2];
+  
+  around[2] = 0;
+  sprintf(query, "SELECT x, y FROM KB WHERE sentence = %d AND x >= %d AND "
+    "x <= %d AND y >= %d AND y <= %d;", sentence, x - 1, x + 1, y - 1, y + 1);
+  res = sqlite3_exec(game.db, query, kb_around_callback, around, &err_msg);
+  if(res != SQLITE_OK)
+  {
+    fprintf(stderr, "KB_AROUND: %s\n", err_msg);
+    sqlite3_free(err_msg);
+    return 0;
+  }
+  for(i = 0; i < 9; i++)
+    kb_memo_fill(sentence, x + i % 3 - 1, y + i / 3 - 1, (around[2] >> i) & 1);
+  return around[2];
+}
+
+/* private callback for kb_passable(), walls go into seen for now */
+static int passable_callback(void *to, int argc, char **argv, char **cols)
+{
+  wavefront *wf = (wavefront *)to;
+  int sentence = atoi(argv[0]), x = atoi(argv[1]), y = atoi(argv[2]);
+  unsigned long long *rows = sentence == PERCEPT_SAFE ? wf->open : wf->seen;
+  rows[y * wf->words + x / 64] |= 1ULL << (x % 64);
+  return 0;
+}
+
+/*
+ * fills in wf->open with the squares of the top left n by n that are safe
+ * and not walls. one query for all of them instead of two for every square.
+ */
+void kb_passable(wavefront *wf)
+{
+  int i, res = 0;
+  char query[256], *err_msg;
+  
+  sprintf(query, "SELECT sentence, x, y FROM kb WHERE (sentence = %d OR "
+    "sentence = %d) AND x >= 0 AND x < %d AND y >= 0 AND y < %d;",
+    PERCEPT_SAFE, PERCEPT_BUMP, wf->n, wf->n);
+  res = sqlite3_exec(game.db, query, passable_callback, wf, &err_msg);
+  if(res != SQLITE_OK)
+  {
+    fprintf(stderr, "KB_PASSABLE: %s\n", err_msg);
+    sqlite3_free(err_msg);
+  }
+  for(i = 0; i < wf->n * wf->words; i++)
+  {
+    wf->open[i] &= ~wf->seen[i];
+    wf->seen[i] = 0;
+  }
+}
+#else
+/* initialize the knowledge base. no tiles yet, they come as facts do */
+void kb_init()
+{
+  int i;
+  
+  game.kb_hash = 0;
+  game.db = calloc(1, sizeof(knowledge));
+  game.db->slot_count = 64;
+  game.db->slots = malloc(game.db->slot_count * sizeof(int));
+  if(game.db->slots == NULL)
+  {
+    fprintf(stderr, "KB_INIT: out of memory\n");
+    exit(1);
+  }
+  for(i = 0; i < game.db->slot_count; i++)
+    game.db->slots[i] = -1;
+}
+
+/* frees the game's knowledge base */
+void kb_close()
+{
+  kb_release(game.db);
+}
+
+/* frees a knowledge base that is not the game's, see kb_clone() */
+void kb_release(knowledge *kb)
+{
+  int i;
+  
+  if(kb == NULL)
+    return;
+  for(i = 0; i < kb->block_count; i++)
+    free(kb->blocks[i]);
+  free(kb->blocks);
+  free(kb->slots);
+  free(kb->safe);
+  free(kb);
+}
+
+/* makes a private copy of a knowledge base, tiles and all */
+knowledge *kb_clone(knowledge *from)
+{
+  knowledge *kb = calloc(1, sizeof(knowledge));
+  int i;
+  
+  kb->slot_count = from->slot_count;
+  kb->slots = malloc(kb->slot_count * sizeof(int));
+  memcpy(kb->slots, from->slots, kb->slot_count * sizeof(int));
+  kb->tiles = from->tiles;
+  kb->block_count = from->block_count;
+  kb->blocks = malloc(kb->block_count * sizeof(kb_tile *));
+  for(i = 0; i < kb->block_count; i++)
+  {
+    kb->blocks[i] = malloc(KB_ARENA * sizeof(kb_tile));
+    memcpy(kb->blocks[i], from->blocks[i], KB_ARENA * sizeof(kb_tile));
+  }
+  kb->safe_count = kb->safe_cap = from->safe_count;
+  kb->safe = malloc((kb->safe_cap + 1) * sizeof(coordinate));
+  memcpy(kb->safe, from->safe, kb->safe_count * sizeof(coordinate));
+  return kb;
+}
+
+/* which slot of the tile table to start looking for a tile in */
+unsigned int kb_tile_hash(knowledge *kb, int tx, int ty)
+{
+  unsigned int h = ((unsigned int)tx * 73856093u) ^
+    ((unsigned int)ty * 19349663u);
+  return h & (kb->slot_count - 1);
+}
+
+/* doubles the tile table, it is kept at most half full */
+void kb_tile_grow(knowledge *kb)
+{
+  int i, j;
+  kb_tile *tile;
+  
+  free(kb->slots);
+  kb->slot_count *= 2;
+  kb->slots = malloc(kb->slot_count * sizeof(int));
+  for(i = 0; i < kb->slot_count; i++)
+    kb->slots[i] = -1;
+  for(j = 0; j < kb->tiles; j++)
+  {
+    tile = &kb->blocks[j / KB_ARENA][j % KB_ARENA];
+    for(i = kb_tile_hash(kb, tile->tx, tile->ty); kb->slots[i] >= 0;
+        i = (i + 1) & (kb->slot_count - 1));
+    kb->slots[i] = j;
+  }
+}
+
+/*
+ * Finds the tile holding x, y, making it first if create is set. Tile
+ * coordinates round down, so squares off the top or left of the map work too.
+ */
+kb_tile *kb_tile_at(knowledge *kb, int x, int y, int create)
+{
+  int tx = x >> KB_TILE_BITS, ty = y >> KB_TILE_BITS, i;
+  kb_tile *tile;
+  
+  for(i = kb_tile_hash(kb, tx, ty); kb->slots[i] >= 0;
+      i = (i + 1) & (kb->slot_count - 1))
+  {
+    tile = &kb->blocks[kb->slots[i] / KB_ARENA][kb->slots[i] % KB_ARENA];
+    if(tile->tx == tx && tile->ty == ty)
+      return tile;
+  }
+  if(!create)
+    return NULL;
+  
+  if(2 * (kb->tiles + 1) > kb->slot_count)
+  {
+    kb_tile_grow(kb);
+    for(i = kb_tile_hash(kb, tx, ty); kb->slots[i] >= 0;
+        i = (i + 1) & (kb->slot_count - 1));
+  }
+  if(kb->tiles == kb->block_count * KB_ARENA)
+  {
+    kb->blocks = realloc(kb->blocks, (kb->block_count + 1) * sizeof(kb_tile *));
+    kb->blocks[kb->block_count] = malloc(KB_ARENA * sizeof(kb_tile));
+    if(kb->blocks[kb->block_count++] == NULL)
+    {
+      fprintf(stderr, "KB_TILE_AT: out of memory\n");
+      exit(1);
+    }
+  }
+  tile = &kb->blocks[kb->tiles / KB_ARENA][kb->tiles % KB_ARENA];
+  memset(tile, 0, sizeof(kb_tile));
+  tile->tx = tx;
+  tile->ty = ty;
+  kb->slots[i] = kb->tiles++;
+  return tile;
+}
+
+/* finds a fact in the kb */
+int kb_found(int sentence, int x, int y)
+{
+  kb_tile *tile = kb_tile_at(game.db, x, y, 0);
+  int plane = __builtin_ctz(sentence);
+  
+  game.kb_lookups++;
+  if(tile == NULL || plane >= KB_SENTENCES)
+    return 0;
+  return (tile->planes[plane][y & (KB_TILE - 1)] >> (x & (KB_TILE - 1))) & 1;
+}
+
+/*
+ * the squares around x, y that sentence is true of, see AROUND(). each row
+ * of them is three bits of a tile row, unless they are split between tiles.
+ */
+int kb_around(int sentence, int x, int y)
+{
+  int plane = __builtin_ctz(sentence), i, around = 0;
+  kb_tile *tile;
+  
+  if(((x - 1) & (KB_TILE - 1)) > KB_TILE - 3 || plane >= KB_SENTENCES)
+  {
+    for(i = 0; i < 9; i++)
+      if(kb_found(sentence, x + i % 3 - 1, y + i / 3 - 1))
+        around |= 1 << i;
+    return around;
+  }
+  game.kb_lookups++;
+  for(i = 0; i < 3; i++)
+    if((tile = kb_tile_at(game.db, x, y + i - 1, 0)) != NULL)
+      around |= ((tile->planes[plane][(y + i - 1) & (KB_TILE - 1)] >>
+        ((x - 1) & (KB_TILE - 1))) & 7) << (3 * i);
+  return around;
+}
+
+/*
+ * fills in wf->open with the squares of the top left n by n that are safe
+ * and not walls. a tile row is as wide as a word, so tile tx is word tx.
+ */
+void kb_passable(wavefront *wf)
+{
+  knowledge *kb = game.db;
+  kb_tile *tile;
+  int i, ly, y, safe_plane = __builtin_ctz(PERCEPT_SAFE);
+  int bump_plane = __builtin_ctz(PERCEPT_BUMP);
+  
+  for(i = 0; i < kb->tiles; i++)
+  {
+    tile = &kb->blocks[i / KB_ARENA][i % KB_ARENA];
+    if(tile->tx < 0 || tile->ty < 0 || tile->tx >= wf->words)
+      continue;
+    for(ly = 0; ly < KB_TILE; ly++)
+    {
+      y = (tile->ty << KB_TILE_BITS) + ly;
+      if(y < wf->n)
+        wf->open[y * wf->words + tile->tx] =
+          tile->planes[safe_plane][ly] & ~tile->planes[bump_plane][ly];
+    }
+  }
+}
+#endif
+
+/* has the square been visited? */
+int visited(int x, int y)
+{
+  return kb_found(PERCEPT_VISITED, x, y);
+}
+
+/* is the square safe? */
+int safe(int x, int y)
+{
+  return kb_found(PERCEPT_SAFE, x, y);
+}
+
+/* is it a wall? */
+int wall(int x, int y)
+{
+  return kb_found(PERCEPT_BUMP, x, y);
+}
+
+/* does it glitter? */
+int glitter(int x, int y)
+{
+  return kb_found(PERCEPT_GLITTER, x, y);
+}
+
+/* does it smell? */
+int smell(int x, int y)
+{
+  return kb_found(PERCEPT_SMELL, x, y);
+}
+
+#ifndef WUMPUS_TILED_KB
+/*
+ * puts a percept or sentence into the kb. requires a percept and does not
+ * insert a row if one is already found of the same kind and position.
+ */
+void kb_insert(int sentence, int x, int y)
+{
+  int res = 0;
+  char query[128], *err_msg;
+  
+  /* don't insert another row of the same kind or for a wall */
+  if(kb_found(sentence, x, y))
+    return;
+  
+  /* a complete memo is the kb for now, see kb_memo_load() */
+  sprintf(query, "INSERT INTO KB (sentence, x, y) VALUES (%d, %d, %d);",
+    sentence, x, y);
+  if(!kb_memo.complete)
+    res = sqlite3_exec(game.db, query, NULL, 0, &err_msg);
+  if(res != SQLITE_OK)
+  {
+    fprintf(stderr, "KB_INSERT: %s\n", err_msg);
+    sqlite3_free(err_msg);
+  }
+  else if(game.hpa && (sentence == PERCEPT_SAFE || sentence == PERCEPT_BUMP))
+    hpa_touch(sentence, x, y, 1);
+  if(res == SQLITE_OK)
+  {
+    kb_memo_fill(sentence, x, y, 1);
+    kb_changed(sentence, x, y);
+  }
+}
+
+/* removes a statement from the database */
+void kb_delete(int sentence, int x, int y)
+{
+  int res = 0;
+  char query[128], *err_msg;
+  if(!kb_found(sentence, x, y))
+    return;
+  
+  sprintf(query, "DELETE FROM KB WHERE sentence = %d AND x = %d AND y = %d;",
+    sentence, x, y);
+  if(!kb_memo.complete)
+    res = sqlite3_exec(game.db, query, NULL, 0, &err_msg);
+  if(res != SQLITE_OK)
+  {
+    fprintf(stderr, "KB_DELETE: %s\n", err_msg);
+    sqlite3_free(err_msg);
+  }
+  else if(game.hpa && (sentence == PERCEPT_SAFE || sentence == PERCEPT_BUMP))
+    hpa_touch(sentence, x, y, 0);
+  if(res == SQLITE_OK)
+  {
+    kb_memo_fill(sentence, x, y, 0);
+    kb_changed(-sentence, x, y);
+  }
+}
+#else
+/*
+ * puts a percept or sentence into the kb. safe squares are also written down
+ * in order, has_unvisited_safe_squares() goes through them the way the SQL kb
+ * would go through its rows.
+ */
+void kb_insert(int sentence, int x, int y)
+{
+  knowledge *kb = game.db;
+  kb_tile *tile;
+  
+  if(kb_found(sentence, x, y) || __builtin_ctz(sentence) >= KB_SENTENCES)
+    return;
+  
+  tile = kb_tile_at(kb, x, y, 1);
+  tile->planes[__builtin_ctz(sentence)][y & (KB_TILE - 1)] |=
+    1ULL << (x & (KB_TILE - 1));
+  if(sentence == PERCEPT_SAFE)
+  {
+    if(kb->safe_count == kb->safe_cap)
+    {
+      kb->safe_cap = kb->safe_cap ? 2 * kb->safe_cap : 64;
+      kb->safe = realloc(kb->safe, kb->safe_cap * sizeof(coordinate));
+    }
+    kb->safe[kb->safe_count].x = x;
+    kb->safe[kb->safe_count++].y = y;
+  }
+  if(game.hpa && (sentence == PERCEPT_SAFE || sentence == PERCEPT_BUMP))
+    hpa_touch(sentence, x, y, 1);
+  kb_changed(sentence, x, y);
+}
+
+/* removes a statement from the kb, the tile stays around */
+void kb_delete(int sentence, int x, int y)
+{
+  knowledge *kb = game.db;
+  kb_tile *tile;
+  int i;
+  
+  if(!kb_found(sentence, x, y))
+    return;
+  
+  tile = kb_tile_at(kb, x, y, 0);
+  tile->planes[__builtin_ctz(sentence)][y & (KB_TILE - 1)] &=
+    ~(1ULL << (x & (KB_TILE - 1)));
+  if(sentence == PERCEPT_SAFE)
+  {
+    for(i = 0; kb->safe[i].x != x || kb->safe[i].y != y; i++);
+    memmove(&kb->safe[i], &kb->safe[i + 1],
+      (--kb->safe_count - i) * sizeof(coordinate));
+  }
+  if(game.hpa && (sentence == PERCEPT_SAFE || sentence == PERCEPT_BUMP))
+    hpa_touch(sentence, x, y, 0);
+  kb_changed(-sentence, x, y);
+}
+#endif
+
+/*
+ * a fact went into the kb, or out of it when the sentence is negative. keeps
+ * the hash up to date and tells whoever is following along. the destination
+ * is only the agent's plan, it is not something the agent believes.
+ */
+void kb_changed(int sentence, int x, int y)
+{
+  if(abs(sentence) != PERCEPT_DESTINATION)
+    game.kb_hash ^= zobrist_key(abs(sentence), x, y);
+  /* taking the search's changes back is not news to anyone */
+  if(look.undoing)
+    return;
+  if(look.searching)
+  {
+    lookahead_journal(sentence, x, y);
+    return;
+  }
+  if(game.publishing)
+    spectate_delta(sentence, x, y);
+  log_event(EVENT_KB, x, y, sentence);
+}
+
+/* the agent walked into a wall at x, y */
+void kb_bumped(int x, int y)
+{
+  kb_insert(PERCEPT_BUMP, x, y);
+}
+
+/* the agent shot whatever was at x, y */
+void kb_killed(int x, int y)
+{
+  /* only one of these will be removed */
+  kb_delete(PERCEPT_WUMPUS, x, y);
+  kb_delete(PERCEPT_SUPMUW, x, y);
+  /* remove the smells, too */
+  kb_delete(PERCEPT_SMELL, x - 1, y);
+  kb_delete(PERCEPT_SMELL, x + 1, y);
+  kb_delete(PERCEPT_SMELL, x, y - 1);
+  kb_delete(PERCEPT_SMELL, x, y + 1);
+}
+
+/* the agent picked up the gold where it stands */
+void kb_grabbed()
+{
+  kb_delete(PERCEPT_GLITTER, game.x, game.y);
+}
+
+/*
+ * the one rule about the corners around the player. a percept on a corner
+ * that isn't a wall comes from one of the two squares next to both it and the
+ * player. one of them known to be safe and it has to be the other one. both
+ * of them safe and something is not right, neither and not enough is known.
+ */
+int infer_corners(int sensed, int safe)
+{
+  int xd, yd, found = 0;
+  
+  for(yd = -1; yd <= 1; yd += 2)
+    for(xd = -1; xd <= 1; xd += 2)
+      if((sensed & AROUND(xd, yd)) &&
+         !(safe & AROUND(xd, 0)) != !(safe & AROUND(0, yd)))
+        found |= safe & AROUND(xd, 0) ? AROUND(0, yd) : AROUND(xd, 0);
+  return found;
+}
+
+/* the corners sensed and the sides that are safe, as an infer_table index */
+int infer_index(int sensed, int safe)
+{
+  return (sensed & 1) | (sensed >> 1 & 2) | (sensed >> 4 & 4) |
+    (sensed >> 5 & 8) | (safe << 3 & 16) | (safe << 2 & 32) |
+    (safe << 1 & 64) | (safe & 128);
+}
+
+/* works out infer_table, for a new rule add it to what this asks */
+void infer_init()
+{
+  static const int corners[4] = {
+    AROUND(-1, -1), AROUND(1, -1), AROUND(-1, 1), AROUND(1, 1)
+  };
+  static const int sides[4] = {
+    AROUND(0, -1), AROUND(-1, 0), AROUND(1, 0), AROUND(0, 1)
+  };
+  int i, j, sensed, safe;
+  
+  for(i = 0; i < INFER_STATES; i++)
+  {
+    sensed = safe = 0;
+    for(j = 0; j < 4; j++)
+    {
+      if(i & (1 << j))
+        sensed |= corners[j];
+      if(i & (16 << j))
+        safe |= sides[j];
+    }
+    infer_table[infer_index(sensed, safe)] = infer_corners(sensed, safe);
+  }
+}
+
+/*
+ * check for something at each corner around where the player sits. This only
+ * checks the diagonals around the player position. the general form to check
+ * the squares immediately accessible to the player require three pieces of
+ * information and only in the rarest of cases can you not determine this
+ * otherwise. A specific situation is like this:
+ *
+ * ..P.
+ * PPP.
+ *
+ * The agent does not seem to notice the middle P in the bottom row, but really
+ * the agent will not maneuver to that square anyways. Not a big deal, really.
+ *
+ * This function requires the 'maybe' percept and the percept to tell the KB
+ * that you 'found' the obstackle in question. the safe squares and walls
+ * around the player are the same for every percept, so the first one to need
+ * them looks them up into safe and walls, until then they are -1.
+ */
+void kb_inferrances(int percept, int known, int *safe, int *walls)
+{
+  int found, square;
+  
+  if(!kb_found(percept, game.x, game.y))
+    return;
+  if(*safe < 0)
+  {
+    *safe = kb_around(PERCEPT_SAFE, game.x, game.y);
+    *walls = kb_around(PERCEPT_BUMP, game.x, game.y);
+  }
+  found = infer_table[infer_index(kb_around(percept, game.x, game.y) &
+    ~*walls, *safe)];
+  for(; found; found &= found - 1)
+  {
+    square = __builtin_ctz(found);
+    kb_insert(known, game.x + square % 3 - 1, game.y + square / 3 - 1);
+  }
+}
+
+/*
+ * tell the knowledge base about your percepts. this is a lot like processing
+ * the percepts, only now we are telling the kb about what we see using only
+ * the percepts.
+ */
+void kb_tell()
+{
+  long long started = now_ns();
+  pmu_count began;
+  int i, j, safe = -1, walls = -1;
+  
+  pmu_read(&began);
+  /* on a procedural map the kb only learns about outside walls up close */
+  for(i = -1; game.kind == MAP_KIND_PROCEDURAL && i <= 1; i++)
+    for(j = -1; j <= 1; j++)
+      if(game.x + i <= 0 || game.y + j <= 0 || game.x + i >= game.size - 1 ||
+         game.y + j >= game.size - 1)
+        kb_insert(PERCEPT_BUMP, game.x + i, game.y + j);
+  
+  kb_insert(PERCEPT_VISITED, game.x, game.y);
+  if(!(game.percepts & PERCEPT_DEAD))
+    kb_insert(PERCEPT_SAFE, game.x, game.y);
+  if(game.percepts & PERCEPT_SMELL)
+    kb_insert(PERCEPT_SMELL, game.x, game.y);
+  if(game.percepts & PERCEPT_BREEZE)
+    kb_insert(PERCEPT_BREEZE, game.x, game.y);
+  if(game.percepts & PERCEPT_MOO)
+    kb_insert(PERCEPT_MOO, game.x, game.y);
+  if(game.percepts & PERCEPT_GLITTER)
+    kb_insert(PERCEPT_GLITTER, game.x, game.y);
+  if(!(game.percepts & PERCEPT_SMELL) &&
+     !(game.percepts & PERCEPT_BREEZE))
+  {
+    /*
+     * this is useful to expand the number of squares we can access after each
+     * move.
+     */
+    kb_insert(PERCEPT_SAFE, game.x - 1, game.y);
+    kb_insert(PERCEPT_SAFE, game.x + 1, game.y);
+    kb_insert(PERCEPT_SAFE, game.x, game.y - 1);
+    kb_insert(PERCEPT_SAFE, game.x, game.y + 1);
+  }
+  
+  /*
+   * now lets make some inferrances.
+   * this process is mostly the same, so just use the same function.
+   */
+  kb_inferrances(PERCEPT_SMELL, PERCEPT_WUMPUS, &safe, &walls);
+  kb_inferrances(PERCEPT_BREEZE, PERCEPT_PIT, &safe, &walls);
+  kb_inferrances(PERCEPT_MOO, PERCEPT_SUPMUW, &safe, &walls);
+  /* the lookahead keeps its own count */
+  if(!look.searching)
+  {
+    hist_record(&game.latency[PHASE_TELL], now_ns() - started);
+    pmu_add(PHASE_TELL, &began);
+  }
+}
+
+/* removes the pre-set destination, if it exists */
+void remove_destination()
+{
+  kb_delete(PERCEPT_DESTINATION, 0, 0);
+  game.dest_x = -1; game.dest_y = -1;
+}
+
+/*
+ * sets a bee-line destination for the agent to navigate to this point.
+ * I use destinations to force the agent to explore more of the map. It is the
+ * sai-yu-sanji-kuyah (top priority) next to gold. You set a destination and the
+ * agent goes there. Because i always require a coordinate in the KB for each
+ * percept saved, i use (0, 0) as the coordinate in the database and keep the
+ * real coordinates in the WUMPLUS struct. This simplifies many things about
+ * the SQL code and prevents me from having to write another function just to
+ * pull the two coordinates out.
+ */
+void set_destination(int x, int y)
+{
+  kb_insert(PERCEPT_DESTINATION, 0, 0);
+  game.dest_x = x;
+  game.dest_y = y;
+}
+
+/* does a destination exist? */
+int has_destination()
+{
+  if(kb_found(PERCEPT_DESTINATION, 0, 0))
+    return 1;
+  return 0;
+}
+
+/* is the agent is at the destination? */
+int at_destination()
+{
+  if(has_destination() && game.x == game.dest_x && game.y == game.dest_y)
+    return 1;
+  return 0;
+}
+
+/* is the agent is at the starting position? */
+int at_start()
+{
+  return game.x == 1 && game.y == 1;
+}
+
+#ifndef WUMPUS_TILED_KB
+/* callback to see if an unvisited safe square has been found */
+static int huss_callback(void *found, int argc, char **argv, char **cols)
+{
+  int x = atoi(argv[1]), y = atoi(argv[2]);
+  /* stop looking when the agent is out of time */
+  if(deadline_passed())
+    return 1;
+  if(!*((int *)found) && !visited(x, y) && !wall(x, y))
+  {
+    *((int *)found) = 1;
+    set_destination(x, y);
+  }
+  return 0;
+}
+
+/* finds a random unvisited safe square and sets the destination thusly */
+int has_unvisited_safe_squares()
+{
+  int res = 0, found = 0;
+  char query[128], *err_msg;
+  long long started = now_ns();
+  pmu_count began;
+  
+  pmu_read(&began);
+  if(game.tune.pick == PICK_NEAREST)
+    sprintf(query, "SELECT * FROM kb WHERE sentence = %d "
+      "ORDER BY ABS(x - %d) + ABS(y - %d), game_random();",
+      PERCEPT_SAFE, game.x, game.y);
+  else
+    sprintf(query,
+      "SELECT * FROM kb WHERE sentence = %d ORDER BY game_random();",
+      PERCEPT_SAFE);
+  res = sqlite3_exec(game.db, query, huss_callback, &found, &err_msg);
+  if(res != SQLITE_OK)
+  {
+    /* running out of time aborts the query, that's no error */
+    if(!game.out_of_time)
+      fprintf(stderr, "HAS_UNVISITED_SAFE_SQUARES: %s\n", err_msg);
+    sqlite3_free(err_msg);
+  }
+  hist_record(&game.latency[PHASE_SCAN], now_ns() - started);
+  pmu_add(PHASE_SCAN, &began);
+  return found;
+}
+#else
+/*
+ * orders the shuffled safe squares, see has_unvisited_safe_squares(). with
+ * --pick nearest the closest ones go first and the shuffle breaks ties.
+ */
+static int huss_compare(const void *a, const void *b)
+{
+  long long x = *(const long long *)a, y = *(const long long *)b;
+  coordinate *i = &game.db->safe[x & 0xffffffff];
+  coordinate *j = &game.db->safe[y & 0xffffffff];
+  int di = abs(i->x - game.x) + abs(i->y - game.y);
+  int dj = abs(j->x - game.x) + abs(j->y - game.y);
+  
+  if(game.tune.pick == PICK_NEAREST && di != dj)
+    return di - dj;
+  return (x > y) - (x < y);
+}
+
+/*
+ * finds a random unvisited safe square and sets the destination thusly. every
+ * safe square gets a number off the game seed in the order they were learned
+ * and then they are tried smallest number first, just like the SQL kb does
+ * it, so a seed plays the same game with either kb.
+ */
+int has_unvisited_safe_squares()
+{
+  knowledge *kb = game.db;
+  long long *order;
+  coordinate *square;
+  int i, found = 0;
+  long long started = now_ns();
+  pmu_count began;
+  
+  pmu_read(&began);
+  order = malloc((kb->safe_count + 1) * sizeof(long long));
+  for(i = 0; i < kb->safe_count; i++)
+    order[i] = ((long long)game_rand() << 32) | i;
+  qsort(order, kb->safe_count, sizeof(long long), huss_compare);
+  for(i = 0; i < kb->safe_count && !found && !deadline_passed(); i++)
+  {
+    square = &kb->safe[order[i] & 0xffffffff];
+    if(!visited(square->x, square->y) && !wall(square->x, square->y))
+    {
+      found = 1;
+      set_destination(square->x, square->y);
+    }
+  }
+  free(order);
+  hist_record(&game.latency[PHASE_SCAN], now_ns() - started);
+  pmu_add(PHASE_SCAN, &began);
+  return found;
+}
+#endif
+
+/* returns a direction to the requested square from the relative player pos. */
+char relative_direction(int x, int y)
+{
+  if(x == game.x)
+    return (game.y < y ? 's' : 'n');
+  if(y == game.y)
+    return (game.x < x ? 'e' : 'w');
+  return 'q';
+}
+
+/*
+ * determines if two squares are neighbors.
+ * returns a boolean if the delta between the two coordinates is one.
+ */
+int neighbors(int x1, int y1, int x2, int y2)
+{
+  int xd = abs(x2 - x1), yd = abs(y2 - y1);
+  if(xd > 1 || yd > 1 || xd + yd > 1 || xd + xd == 0)
+    return 0;
+  return 1;
+}
+
+/*
+ * will return a char for the next step to get to the given square
+ *
+ * This function performs a breadth-first search out from the requested
+ * square, a whole layer of squares at a time. Every layer is a step further
+ * from the destination than the one before, so the first layer to get to a
+ * square next to the player also gives the best direction of travel. A layer
+ * is a bit per square and moves on with shifts across whole rows, 64 squares
+ * at a go, instead of asking the kb about every square on the way.
+ *
+ * This is a lot of complication for a lot of simplification on the game side
+ * This is probably the hardest part of the whole program. 'Knowing' things
+ * about what you see is easy, inferring this is pretty easy. Getting there.
+ * That's complication.
+ *
+ * This algorithm is also completely capable of navigating 'walls' of obstackles
+ * in the game. Pits, walls, wumpuses, supmuws, whatever. It can get around it.
+ *
+ * ==General procedure==
+ * Read the safe squares that are not walls out of the kb, a bit per square.
+ * The destination is layer one.
+ * While the layer is not empty:
+ *  Done if it holds a square next to the player that the player can step on,
+ *   the first of west, east, north and south
+ *  Shift the layer's safe squares a square each way across whole rows
+ *  The next layer is whatever that hits that no layer had yet
+ * Go to the square found, or nowhere.
+ *
+ * The player can step on a square next to it that is not a wall and is safe
+ * or has been visited. If the agent runs out of time before the
+ * search gets back to the player, it takes the fallback_action() instead.
+ * With --hpa all of this is left to hpa_shortest_path().
+ */
+char shortest_path()
+{
+  int i = 0, n, dx[4] = { -1, 1, 0, 0 }, dy[4] = { 0, 0, -1, 1 }, step[4];
+  long long started = now_ns();
+  pmu_count began;
+  wavefront wf;
+  coordinate temp;
+  char choice;
+  
+  pmu_read(&began);
+  if(game.hpa)
+  {
+    choice = hpa_shortest_path();
+    hist_record(&game.latency[PHASE_PATH], now_ns() - started);
+    pmu_add(PHASE_PATH, &began);
+    return choice;
+  }
+  
+  /*
+   * the kb only knows squares next to ones the player has been on, so the
+   * search never gets further out than that. the planner thread can be a
+   * step past game.reach.
+   */
+  n = game.reach > game.x ? game.reach : game.x;
+  n = (n > game.y ? n : game.y) + 3;
+  n = n < game.size ? n : game.size;
+  wf.n = n;
+  wf.words = (n + 63) / 64;
+  wf.open = calloc(4 * n * wf.words, sizeof(unsigned long long));
+  wf.seen = wf.open + n * wf.words;
+  wf.front = wf.seen + n * wf.words;
+  wf.next = wf.front + n * wf.words;
+  kb_passable(&wf);
+  
+  for(i = 0; i < 4; i++)
+  {
+    temp.x = game.x + dx[i]; temp.y = game.y + dy[i];
+    step[i] = !wall(temp.x, temp.y) && (safe(temp.x, temp.y) ||
+      visited(temp.x, temp.y));
+  }
+  
+  temp.x = game.x; temp.y = game.y;
+  wf.top = wf.bottom = game.dest_y;
+  if(game.dest_x >= 0 && game.dest_x < n && game.dest_y >= 0 &&
+     game.dest_y < n)
+  {
+    wf.front[game.dest_y * wf.words + game.dest_x / 64] =
+      1ULL << (game.dest_x % 64);
+    wf.seen[game.dest_y * wf.words + game.dest_x / 64] =
+      1ULL << (game.dest_x % 64);
+    do
+    {
+      for(i = 0; i < 4 && !(step[i] &&
+          wavefront_at(&wf, wf.front, game.x + dx[i], game.y + dy[i])); i++);
+      if(i < 4)
+      {
+        temp.x = game.x + dx[i];
+        temp.y = game.y + dy[i];
+        break;
+      }
+    } while(wavefront_spread(&wf) && !deadline_passed());
+  }
+  
+  free(wf.open);
+  hist_record(&game.latency[PHASE_PATH], now_ns() - started);
+  pmu_add(PHASE_PATH, &began);
+  if(game.out_of_time && temp.x == game.x && temp.y == game.y)
+    return fallback_action();
+  return relative_direction(temp.x, temp.y);
+}
+
+/* is x, y in the rows, squares off the search are not */
+int wavefront_at(wavefront *wf, unsigned long long *rows, int x, int y)
+{
+  if(x < 0 || y < 0 || x >= wf->n || y >= wf->n)
+    return 0;
+  return (rows[y * wf->words + x / 64] >> (x % 64)) & 1;
+}
+
+/*
+ * moves the search a layer on. the safe squares of the front spread to the
+ * four squares around them, a row of them at a time, and whatever was not
+ * seen before is the next front. returns 0 once there is nothing left.
+ */
+int wavefront_spread(wavefront *wf)
+{
+  int y, w, i, words = wf->words, n = wf->n, top, bottom;
+  unsigned long long *from = wf->front, *to = wf->next, bits;
+  
+  for(i = wf->top * words; i < (wf->bottom + 1) * words; i++)
+    from[i] &= wf->open[i];
+  top = wf->top > 0 ? wf->top - 1 : 0;
+  bottom = wf->bottom < n - 1 ? wf->bottom + 1 : n - 1;
+  wf->top = n;
+  wf->bottom = -1;
+  for(y = top; y <= bottom; y++)
+  {
+    for(w = 0; w < words; w++)
+    {
+      i = y * words + w;
+      bits = from[i] << 1 | from[i] >> 1;
+      if(w > 0)
+        bits |= from[i - 1] >> 63;
+      if(w < words - 1)
+        bits |= from[i + 1] << 63;
+      if(y > 0)
+        bits |= from[i - words];
+      if(y < n - 1)
+        bits |= from[i + words];
+      to[i] = bits & ~wf->seen[i];
+      wf->seen[i] |= to[i];
+      if(to[i] && y < wf->top)
+        wf->top = y;
+      if(to[i])
+        wf->bottom = y;
+    }
+  }
+  /* the old front is the next one after this, it starts out empty */
+  memset(&from[top * words], 0, (bottom - top + 1) * words * sizeof(*from));
+  wf->front = to;
+  wf->next = from;
+  return wf->bottom >= 0;
+}
+
+/* is x, y known to be safe and not a wall, according to the pathfinder */
+int hpa_passable(int x, int y)
+{
+  pathfinder *pf = game.hpa;
+  cluster *c;
+  if(x < 0 || y < 0 || x >= game.size || y >= game.size)
+    return 0;
+  c = pf->clusters[(y / HPA_CLUSTER) * pf->width + x / HPA_CLUSTER];
+  return c && c->cells[(x % HPA_CLUSTER) * HPA_CLUSTER + y % HPA_CLUSTER] ==
+    HPA_SAFE;
+}
+
+/* sets up the pathfinder for a new map, nothing is known yet */
+void hpa_init()
+{
+  pathfinder *pf = calloc(1, sizeof(pathfinder));
+  int nodes;
+  pf->width = (game.size + HPA_CLUSTER - 1) / HPA_CLUSTER;
+  nodes = pf->width * pf->width * HPA_ENTRANCES;
+  pf->clusters = calloc(pf->width * pf->width, sizeof(cluster *));
+  pf->seen = calloc(nodes, sizeof(int));
+  pf->cost = malloc(sizeof(int) * nodes);
+  pf->from = malloc(sizeof(int) * nodes);
+  pf->heap_cap = 64;
+  pf->heap = malloc(sizeof(long long) * pf->heap_cap);
+  game.hpa = pf;
+}
+
+/* throws the pathfinder away */
+void hpa_free()
+{
+  pathfinder *pf = game.hpa;
+  int i;
+  if(!pf)
+    return;
+  for(i = 0; i < pf->width * pf->width; i++)
+    free(pf->clusters[i]);
+  free(pf->clusters);
+  free(pf->seen);
+  free(pf->cost);
+  free(pf->from);
+  free(pf->heap);
+  free(pf);
+  game.hpa = NULL;
+}
+
+/*
+ * the kb learned or forgot that x, y is safe or a wall. the cluster holding it
+ * has to be rebuilt, and so does the one next door if it is on the edge since
+ * they share entrances.
+ */
+void hpa_touch(int sentence, int x, int y, int present)
+{
+  pathfinder *pf = game.hpa;
+  int cx = x / HPA_CLUSTER, cy = y / HPA_CLUSTER, bit;
+  cluster **c;
+  
+  if(x < 0 || y < 0 || x >= game.size || y >= game.size)
+    return;
+  bit = sentence == PERCEPT_SAFE ? HPA_SAFE : HPA_WALL;
+  c = &pf->clusters[cy * pf->width + cx];
+  if(!*c)
+    *c = calloc(1, sizeof(cluster));
+  if(present)
+    (*c)->cells[(x % HPA_CLUSTER) * HPA_CLUSTER + y % HPA_CLUSTER] |= bit;
+  else
+    (*c)->cells[(x % HPA_CLUSTER) * HPA_CLUSTER + y % HPA_CLUSTER] &= ~bit;
+  (*c)->dirty = 1;
+  
+  if(x % HPA_CLUSTER == 0 && cx > 0 && pf->clusters[cy * pf->width + cx - 1])
+    pf->clusters[cy * pf->width + cx - 1]->dirty = 1;
+  if(x % HPA_CLUSTER == HPA_CLUSTER - 1 && cx + 1 < pf->width &&
+     pf->clusters[cy * pf->width + cx + 1])
+    pf->clusters[cy * pf->width + cx + 1]->dirty = 1;
+  if(y % HPA_CLUSTER == 0 && cy > 0 && pf->clusters[(cy - 1) * pf->width + cx])
+    pf->clusters[(cy - 1) * pf->width + cx]->dirty = 1;
+  if(y % HPA_CLUSTER == HPA_CLUSTER - 1 && cy + 1 < pf->width &&
+     pf->clusters[(cy + 1) * pf->width + cx])
+    pf->clusters[(cy + 1) * pf->width + cx]->dirty = 1;
+}
+
+/*
+ * breadth-first search inside one cluster from x, y. dist gets the number of
+ * steps to every square of the cluster, -1 where it can't be reached.
+ */
+void hpa_local_bfs(int cx, int cy, int x, int y, int *dist)
+{
+  int queue[HPA_CLUSTER * HPA_CLUSTER], head = 0, tail = 0, i, j, x2, y2;
+  int dx[4] = { -1, 1, 0, 0 }, dy[4] = { 0, 0, -1, 1 };
+  
+  for(i = 0; i < HPA_CLUSTER * HPA_CLUSTER; i++)
+    dist[i] = -1;
+  i = (x - cx * HPA_CLUSTER) * HPA_CLUSTER + y - cy * HPA_CLUSTER;
+  dist[i] = 0;
+  queue[tail++] = i;
+  while(head < tail)
+  {
+    i = queue[head++];
+    x = cx * HPA_CLUSTER + i / HPA_CLUSTER;
+    y = cy * HPA_CLUSTER + i % HPA_CLUSTER;
+    for(j = 0; j < 4; j++)
+    {
+      x2 = x + dx[j]; y2 = y + dy[j];
+      if(x2 / HPA_CLUSTER != cx || y2 / HPA_CLUSTER != cy || x2 < 0 ||
+         y2 < 0 || !hpa_passable(x2, y2))
+        continue;
+      if(dist[(x2 % HPA_CLUSTER) * HPA_CLUSTER + y2 % HPA_CLUSTER] != -1)
+        continue;
+      dist[(x2 % HPA_CLUSTER) * HPA_CLUSTER + y2 % HPA_CLUSTER] =
+        dist[i] + 1;
+      queue[tail++] = (x2 % HPA_CLUSTER) * HPA_CLUSTER + y2 % HPA_CLUSTER;
+    }
+  }
+}
+
+/*
+ * finds the entrances on one side of a cluster. an entrance is the middle of
+ * every run of squares along the edge that are passable on both sides of it.
+ * the cluster next door finds the same runs, so its entrance is right across.
+ */
+void hpa_side_entrances(cluster *c, int x, int y, int sx, int sy, int ox,
+  int oy)
+{
+  int i, run = 0, open;
+  for(i = 0; i <= HPA_CLUSTER; i++)
+  {
+    open = i < HPA_CLUSTER && hpa_passable(x + sx * i, y + sy * i) &&
+      hpa_passable(x + sx * i + ox, y + sy * i + oy);
+    if(open)
+    {
+      run++;
+      continue;
+    }
+    if(run && c->entrances < HPA_ENTRANCES)
+    {
+      c->entrance[c->entrances].x = x + sx * (i - run + (run - 1) / 2);
+      c->entrance[c->entrances].y = y + sy * (i - run + (run - 1) / 2);
+      c->entrances++;
+    }
+    run = 0;
+  }
+}
+
+/* works out a cluster's entrances and the distances between them again */
+void hpa_rebuild(int cx, int cy)
+{
+  cluster *c = game.hpa->clusters[cy * game.hpa->width + cx];
+  int i, j, dist[HPA_CLUSTER * HPA_CLUSTER];
+  int x0 = cx * HPA_CLUSTER, y0 = cy * HPA_CLUSTER;
+  int x1 = x0 + HPA_CLUSTER - 1, y1 = y0 + HPA_CLUSTER - 1;
+  
+  c->entrances = 0;
+  hpa_side_entrances(c, x0, y0, 1, 0, 0, -1);
+  hpa_side_entrances(c, x0, y1, 1, 0, 0, 1);
+  hpa_side_entrances(c, x0, y0, 0, 1, -1, 0);
+  hpa_side_entrances(c, x1, y0, 0, 1, 1, 0);
+  for(i = 0; i < c->entrances; i++)
+  {
+    hpa_local_bfs(cx, cy, c->entrance[i].x, c->entrance[i].y, dist);
+    for(j = 0; j < c->entrances; j++)
+      c->dist[i][j] = dist[(c->entrance[j].x - x0) * HPA_CLUSTER +
+        c->entrance[j].y - y0];
+  }
+  c->dirty = 0;
+}
+
+/* the cluster holding x, y, brought up to date, or NULL if none */
+cluster *hpa_cluster_at(int x, int y)
+{
+  pathfinder *pf = game.hpa;
+  cluster *c;
+  if(x < 0 || y < 0 || x >= game.size || y >= game.size)
+    return NULL;
+  c = pf->clusters[(y / HPA_CLUSTER) * pf->width + x / HPA_CLUSTER];
+  if(c && c->dirty)
+    hpa_rebuild(x / HPA_CLUSTER, y / HPA_CLUSTER);
+  return c;
+}
+
+/* which entrance of the cluster x, y is, or -1 */
+int hpa_entrance_at(cluster *c, int x, int y)
+{
+  int i;
+  for(i = 0; c && i < c->entrances; i++)
+    if(c->entrance[i].x == x && c->entrance[i].y == y)
+      return i;
+  return -1;
+}
+
+/* puts an entrance on the search heap, cheapest guess at the top */
+void hpa_push(int node, int guess)
+{
+  pathfinder *pf = game.hpa;
+  long long item = ((long long)guess << 32) | node, swap;
+  int i = pf->heap_size++;
+  if(pf->heap_size > pf->heap_cap)
+    pf->heap = realloc(pf->heap, sizeof(long long) * (pf->heap_cap *= 2));
+  pf->heap[i] = item;
+  while(i > 0 && pf->heap[(i - 1) / 2] > pf->heap[i])
+  {
+    swap = pf->heap[i]; pf->heap[i] = pf->heap[(i - 1) / 2];
+    pf->heap[(i - 1) / 2] = swap;
+    i = (i - 1) / 2;
+  }
+}
+
+/* takes the cheapest entrance off the search heap */
+long long hpa_pop()
+{
+  pathfinder *pf = game.hpa;
+  long long top = pf->heap[0], swap;
+  int i = 0, child;
+  pf->heap[0] = pf->heap[--pf->heap_size];
+  while((child = 2 * i + 1) < pf->heap_size)
+  {
+    if(child + 1 < pf->heap_size && pf->heap[child + 1] < pf->heap[child])
+      child++;
+    if(pf->heap[i] <= pf->heap[child])
+      break;
+    swap = pf->heap[i]; pf->heap[i] = pf->heap[child]; pf->heap[child] = swap;
+    i = child;
+  }
+  return top;
+}
+
+/*
+ * Hierarchical version of shortest_path() for big maps (HPA*). The squares the
+ * kb knows are safe get split into HPA_CLUSTER sized clusters. Each cluster
+ * knows its entrances and how far apart they are inside it, and only clusters
+ * the kb has learned something new about get worked out again.
+ *
+ * To find the next step, the squares inside the player's cluster and the
+ * destination's cluster are searched directly. In between, an A* search goes
+ * from entrance to entrance, so the work follows how long and twisty the path
+ * is rather than how big the map is. The path it finds may be a little longer
+ * than the best one, but it never goes anywhere shortest_path() wouldn't.
+ *
+ * The first stop on the way is either the destination, an entrance inside the
+ * player's cluster or the entrance right next to the player across the edge.
+ * The step is the neighbor closest to that stop, ties broken like
+ * shortest_path() does.
+ */
+char hpa_shortest_path()
+{
+  pathfinder *pf = game.hpa;
+  int from_player[HPA_CLUSTER * HPA_CLUSTER], to_dest[HPA_CLUSTER * HPA_CLUSTER];
+  int pcx = game.x / HPA_CLUSTER, pcy = game.y / HPA_CLUSTER;
+  int dcx = game.dest_x / HPA_CLUSTER, dcy = game.dest_y / HPA_CLUSTER;
+  int i, j, k, node, cost, best = -1, best_node = -1, x2, y2, chain[4];
+  int dx[4] = { -1, 1, 0, 0 }, dy[4] = { 0, 0, -1, 1 };
+  cluster *pc = hpa_cluster_at(game.x, game.y);
+  cluster *dc = hpa_cluster_at(game.dest_x, game.dest_y), *c, *c2;
+  coordinate stop;
+  long long item;
+  
+  stop.x = game.x; stop.y = game.y;
+  if(!pc || !dc || !hpa_passable(game.dest_x, game.dest_y))
+    return relative_direction(game.x, game.y);
+  
+  hpa_local_bfs(pcx, pcy, game.x, game.y, from_player);
+  hpa_local_bfs(dcx, dcy, game.dest_x, game.dest_y, to_dest);
+  
+  /* same cluster, maybe no need to leave it */
+  if(pc == dc)
+  {
+    best = from_player[(game.dest_x % HPA_CLUSTER) * HPA_CLUSTER +
+      game.dest_y % HPA_CLUSTER];
+    if(best >= 0)
+      stop.x = game.dest_x, stop.y = game.dest_y;
+  }
+  
+  /* start from every entrance the player can get to */
+  pf->stamp++;
+  pf->heap_size = 0;
+  for(i = 0; i < pc->entrances; i++)
+  {
+    cost = from_player[(pc->entrance[i].x % HPA_CLUSTER) * HPA_CLUSTER +
+      pc->entrance[i].y % HPA_CLUSTER];
+    if(cost < 0)
+      continue;
+    node = (pcy * pf->width + pcx) * HPA_ENTRANCES + i;
+    pf->seen[node] = pf->stamp;
+    pf->cost[node] = cost;
+    pf->from[node] = -1;
+    hpa_push(node, cost + abs(pc->entrance[i].x - game.dest_x) +
+      abs(pc->entrance[i].y - game.dest_y));
+  }
+  
+  while(pf->heap_size)
+  {
+    item = hpa_pop();
+    node = (int)(item & 0xffffffff);
+    if(best >= 0 && (item >> 32) >= best)
+      break;
+    k = node % HPA_ENTRANCES;
+    c = pf->clusters[node / HPA_ENTRANCES];
+    cost = pf->cost[node];
+    if((item >> 32) > cost + abs(c->entrance[k].x - game.dest_x) +
+       abs(c->entrance[k].y - game.dest_y))
+      continue;
+    
+    /* reached the destination's cluster, see if it gets there */
+    if(c == dc)
+    {
+      j = to_dest[(c->entrance[k].x % HPA_CLUSTER) * HPA_CLUSTER +
+        c->entrance[k].y % HPA_CLUSTER];
+      if(j >= 0 && (best < 0 || cost + j < best))
+      {
+        best = cost + j;
+        best_node = node;
+      }
+    }
+    
+    /* other entrances of this cluster */
+    for(j = 0; j < c->entrances; j++)
+      if(j != k && c->dist[k][j] >= 0)
+      {
+        i = node - k + j;
+        if(pf->seen[i] == pf->stamp && pf->cost[i] <= cost + c->dist[k][j])
+          continue;
+        pf->seen[i] = pf->stamp;
+        pf->cost[i] = cost + c->dist[k][j];
+        pf->from[i] = node;
+        hpa_push(i, pf->cost[i] + abs(c->entrance[j].x - game.dest_x) +
+          abs(c->entrance[j].y - game.dest_y));
+      }
+    
+    /* the entrance right across the edge */
+    for(j = 0; j < 4; j++)
+    {
+      x2 = c->entrance[k].x + dx[j]; y2 = c->entrance[k].y + dy[j];
+      if(x2 / HPA_CLUSTER == c->entrance[k].x / HPA_CLUSTER &&
+         y2 / HPA_CLUSTER == c->entrance[k].y / HPA_CLUSTER)
+        continue;
+      c2 = hpa_cluster_at(x2, y2);
+      if((i = hpa_entrance_at(c2, x2, y2)) < 0)
+        continue;
+      i += ((y2 / HPA_CLUSTER) * pf->width + x2 / HPA_CLUSTER) *
+        HPA_ENTRANCES;
+      if(pf->seen[i] == pf->stamp && pf->cost[i] <= cost + 1)
+        continue;
+      pf->seen[i] = pf->stamp;
+      pf->cost[i] = cost + 1;
+      pf->from[i] = node;
+      hpa_push(i, cost + 1 + abs(x2 - game.dest_x) + abs(y2 - game.dest_y));
+    }
+  }
+  
+  /*
+   * walk back from the end to find the first two entrances on the way, the
+   * first stop is the first of those that isn't where the player stands.
+   */
+  if(best_node >= 0)
+  {
+    chain[0] = chain[1] = -1;
+    for(node = best_node; node >= 0; node = pf->from[node])
+    {
+      chain[1] = chain[0];
+      chain[0] = node;
+    }
+    for(i = 0; i < 2; i++)
+    {
+      if(chain[i] < 0)
+        break;
+      c = pf->clusters[chain[i] / HPA_ENTRANCES];
+      stop = c->entrance[chain[i] % HPA_ENTRANCES];
+      if(stop.x != game.x || stop.y != game.y)
+        break;
+    }
+    if(stop.x == game.x && stop.y == game.y)
+      stop.x = game.dest_x, stop.y = game.dest_y;
+  }
+  if(stop.x == game.x && stop.y == game.y)
+    return relative_direction(game.x, game.y);
+  
+  /* right next door, just go */
+  if(abs(stop.x - game.x) + abs(stop.y - game.y) == 1)
+    return relative_direction(stop.x, stop.y);
+  
+  /* otherwise the neighbor inside the cluster that is closest to the stop */
+  hpa_local_bfs(pcx, pcy, stop.x, stop.y, to_dest);
+  best = -1;
+  for(i = 0; i < 4; i++)
+  {
+    x2 = game.x + dx[i]; y2 = game.y + dy[i];
+    if(x2 / HPA_CLUSTER != pcx || y2 / HPA_CLUSTER != pcy)
+      continue;
+    j = to_dest[(x2 % HPA_CLUSTER) * HPA_CLUSTER + y2 % HPA_CLUSTER];
+    if(j >= 0 && (best < 0 || j < best))
+    {
+      best = j;
+      stop.x = x2; stop.y = y2;
+    }
+  }
+  return relative_direction(stop.x, stop.y);
+}
+
+/* determines if the (perceived) wumpus is in a nearby square */
+int wumpus_nearby(coordinate *wumpus)
+{
+  int found = 0;
+  if(kb_found(PERCEPT_WUMPUS, game.x - 1, game.y))
+  {
+    wumpus->x = game.x - 1;
+    wumpus->y = game.y;
+    found = 1;
+  }
+  if(kb_found(PERCEPT_WUMPUS, game.x + 1, game.y))
+  {
+    wumpus->x = game.x + 1;
+    wumpus->y = game.y;
+    found = 1;
+  }
+  if(kb_found(PERCEPT_WUMPUS, game.x, game.y - 1))
+  {
+    wumpus->x = game.x;
+    wumpus->y = game.y - 1;
+    found = 1;
+  }
+  if(kb_found(PERCEPT_WUMPUS, game.x, game.y + 1))
+  {
+    wumpus->x = game.x;
+    wumpus->y = game.y + 1;
+    found = 1;
+  }
+  return found;
+}
+
+/* has the agent run out of time for this decision? */
+int deadline_passed()
+{
+  if(game.deadline && !game.out_of_time && now_ns() >= game.deadline)
+    game.out_of_time = 1;
+  return game.out_of_time;
+}
+
+/*
+ * the rule-based choice for when there is no time to plan. steps onto a safe
+ * square next to the player that has not been visited yet, otherwise onto the
+ * safe square closest to the destination (or the start, if there is none).
+ * just quits if there is nowhere safe to go.
+ */
+char fallback_action()
+{
+  int i, x, y, d, best = -1;
+  int tx = game.dest_x >= 0 ? game.dest_x : 1;
+  int ty = game.dest_x >= 0 ? game.dest_y : 1;
+  int dx[4] = { -1, 1, 0, 0 }, dy[4] = { 0, 0, -1, 1 };
+  char choice = 'q';
+  
+  for(i = 0; i < 4; i++)
+  {
+    x = game.x + dx[i]; y = game.y + dy[i];
+    if(wall(x, y) || !safe(x, y))
+      continue;
+    if(!visited(x, y))
+      return relative_direction(x, y);
+    d = abs(tx - x) + abs(ty - y);
+    if(best == -1 || d < best)
+    {
+      best = d;
+      choice = relative_direction(x, y);
+    }
+  }
+  return choice;
+}
+
+/*
+ * gets the action from the knowledge base.
+ *
+ * priority of actions is as follows:
+ * 1. grab if glittering and set destination to start
+ * 2. kill that wumpus, if you know where he is and he is nearby.
+ * 3. go to the destination, if set
+ * 4. find an unvisited safe square and go there
+ * 5. go back to the beginning and give up.
+ *
+ * The supmuw will usually be de-food-ified through the normal course of travel
+ * so specific rules are not really necessary. Hunting the wumpus is viewed
+ * as a 'bonus' more than a goal, so it only happens if the agent discovers
+ * where the wumpus is located and then travels to a nearby square.
+ *
+ * With a move budget the search for an unvisited square and the path to it
+ * stop when time is up, and whatever fallback_action() says goes instead.
+ */
+char kb_ask_action()
+{
+  coordinate wumpus;
+  char learned;
+  
+  /* the table already knows what to do here, no need to ask the kb */
+  if(game.policy && (learned = policy_lookup(game.policy)) != '.')
+    return learned;
+  wumpus.x = game.x; wumpus.y = game.y;
+  
+  /* priority one: gold */
+  if(glitter(game.x, game.y))
+  {
+    /* if gold, stop, drop and proceed to exit */
+    remove_destination();
+    set_destination(1, 1);
+    return 'g';
+  }
+  
+  /* out of patience, head home and call it a day */
+  if(game.tune.give_up && game.steps_taken >= game.tune.give_up)
+  {
+    if(at_start())
+      return 'q';
+    set_destination(1, 1);
+    return shortest_path();
+  }
+  
+  /* check to see if the destination is deadly or a wall, if so, remove it */
+  if(has_destination() && (wall(game.dest_x, game.dest_y) ||
+     !safe(game.dest_x, game.dest_y)))
+  {
+    remove_destination();
+  }
+  /* rather look around again, unless the gold is in hand */
+  if(game.tune.repick && !game.has_gold)
+    remove_destination();
+  
+  /* kill the wumpus, if he is nearby */
+  if(game.tune.shoot == SHOOT_FIRST && smell(game.x, game.y) && game.arrows &&
+     wumpus_nearby(&wumpus))
+  {
+    return (char)((int)relative_direction(wumpus.x, wumpus.y) - 32);
+  }
+  
+  /*
+   * if has destination, go there now. if we're not at the destination, then
+   * go ahead and find a new random location and go there if we have unvisited
+   * safe areas.
+   */
+  if((has_destination() && !at_destination()) || has_unvisited_safe_squares())
+  {
+    return shortest_path();
+  }
+  if(game.out_of_time)
+    return fallback_action();
+  
+  /* nothing left to look at, the wumpus might be in the way */
+  if(game.tune.shoot == SHOOT_LAST && smell(game.x, game.y) && game.arrows &&
+     wumpus_nearby(&wumpus))
+  {
+    return (char)((int)relative_direction(wumpus.x, wumpus.y) - 32);
+  }
+  
+  /*
+   * should really hunt the wumpus and find the supmuw now, but we're gonna
+   * save that for later... since the objective is only to find the gold, this
+   * part is not strictly speaking necessary. Just go back and quit...
+   */
+  if(!at_start())
+  {
+    set_destination(1, 1);
+    return shortest_path();
+  }
+  
+  /*
+   * failure condition, just quit. can't find the gold and can't guarantee
+   * that the agent will survive any new squares.
+   */
+  return 'q';
+}
+
+#ifndef WUMPUS_TILED_KB
+/* callback keeping the first unvisited safe square, they come nearest first */
+static int heading_callback(void *to, int argc, char **argv, char **cols)
+{
+  coordinate *target = (coordinate *)to;
+  int x = atoi(argv[0]), y = atoi(argv[1]);
+  if(visited(x, y) || wall(x, y))
+    return 0;
+  target->x = x;
+  target->y = y;
+  /* the rest are further away */
+  return 1;
+}
+#endif
+
+/*
+ * works out where the policy is heading and how many steps every square is
+ * from there, a layer of shortest_path()'s search at a time. home once it has
+ * the gold, otherwise the nearest safe square it has not been to yet, or home
+ * once there is nothing left to look at. it is only done again once the agent
+ * gets there, picks up the gold or finds a wall in the way.
+ */
+void policy_route()
+{
+  int n = game.reach, i, x, y, w, layer = 0;
+  unsigned long long bits;
+  wavefront wf;
+  coordinate target;
+#ifdef WUMPUS_TILED_KB
+  int d, best = -1;
+  coordinate *square;
+#else
+  char query[160], *err_msg;
+  int res;
+#endif
+  
+  target.x = target.y = -1;
+  /* the kb is on its way somewhere already, go along with it */
+  if(!game.has_gold && game.dest_x >= 0 &&
+     (game.x != game.dest_x || game.y != game.dest_y) &&
+     safe(game.dest_x, game.dest_y) && !visited(game.dest_x, game.dest_y) &&
+     !wall(game.dest_x, game.dest_y))
+  {
+    target.x = game.dest_x;
+    target.y = game.dest_y;
+  }
+  else if(!game.has_gold)
+  {
+    /* or it would go back to a square the policy has been to since */
+    if(game.dest_x >= 0)
+      remove_destination();
+#ifdef WUMPUS_TILED_KB
+    for(i = 0; i < game.db->safe_count; i++)
+    {
+      square = &game.db->safe[i];
+      d = abs(square->x - game.x) + abs(square->y - game.y);
+      if((best < 0 || d < best) && !visited(square->x, square->y) &&
+         !wall(square->x, square->y))
+      {
+        best = d;
+        target = *square;
+      }
+    }
+#else
+    /* ties go the way the tiled kb's safe list has them, oldest first */
+    sprintf(query, "SELECT x, y FROM kb WHERE sentence = %d "
+      "ORDER BY ABS(x - %d) + ABS(y - %d), rowid;", PERCEPT_SAFE, game.x,
+      game.y);
+    res = sqlite3_exec(game.db, query, heading_callback, &target, &err_msg);
+    /* the callback stops it at the first one, that is not an error */
+    if(res != SQLITE_OK && res != SQLITE_ABORT)
+      fprintf(stderr, "POLICY_ROUTE: %s\n", err_msg);
+    if(res != SQLITE_OK)
+      sqlite3_free(err_msg);
+#endif
+    /* and the kb goes there too if it gets asked on the way */
+    if(target.x >= 0)
+      set_destination(target.x, target.y);
+  }
+  if(target.x < 0)
+  {
+    target.x = 1;
+    target.y = 1;
+  }
+  if(game.has_gold && (game.dest_x != 1 || game.dest_y != 1))
+    set_destination(1, 1);
+  game.route_to = target;
+  game.route_gold = game.has_gold;
+  
+  /* the search can take the player past anywhere it has really been */
+  n = (n > game.x ? n : game.x);
+  n = (n > game.y ? n : game.y) + 3;
+  n = (n < game.size ? n : game.size);
+  if(n * n > game.route_cells)
+  {
+    game.route_cells = n * n;
+    game.route = realloc(game.route, game.route_cells * sizeof(int));
+  }
+  game.route_n = n;
+  for(i = 0; i < n * n; i++)
+    game.route[i] = -1;
+  if(target.x >= n || target.y >= n)
+    return;
+  
+  /* shortest_path()'s search, only every layer is written down on the way */
+  wf.n = n;
+  wf.words = (n + 63) / 64;
+  wf.open = calloc(4 * n * wf.words, sizeof(unsigned long long));
+  wf.seen = wf.open + n * wf.words;
+  wf.front = wf.seen + n * wf.words;
+  wf.next = wf.front + n * wf.words;
+  kb_passable(&wf);
+  wf.top = wf.bottom = target.y;
+  wf.front[target.y * wf.words + target.x / 64] = 1ULL << (target.x % 64);
+  wf.seen[target.y * wf.words + target.x / 64] = 1ULL << (target.x % 64);
+  game.route[target.x * n + target.y] = 0;
+  do
+  {
+    for(y = wf.top; y <= wf.bottom; y++)
+      for(w = 0; w < wf.words; w++)
+        for(bits = wf.front[y * wf.words + w] & wf.open[y * wf.words + w];
+            bits; bits &= bits - 1)
+        {
+          x = w * 64 + __builtin_ctzll(bits);
+          game.route[x * n + y] = layer;
+        }
+    layer++;
+  } while(wavefront_spread(&wf));
+  free(wf.open);
+}
+
+/* steps from x, y to where the policy is heading, or -1 for no way there */
+int policy_route_at(int x, int y)
+{
+  if(!game.route || x < 0 || y < 0 || x >= game.route_n || y >= game.route_n)
+    return -1;
+  return game.route[x * game.route_n + y];
+}
+
+/* the square next to the agent a step closer on the route, 1 to 4 or 0 */
+int policy_step()
+{
+  int dx[4] = { 0, 1, 0, -1 }, dy[4] = { -1, 0, 1, 0 };
+  int i, d = policy_route_at(game.x, game.y), next, step = 0;
+  
+  for(i = 0; i < 4; i++)
+  {
+    next = policy_route_at(game.x + dx[i], game.y + dy[i]);
+    if(next >= 0 && next < d)
+    {
+      d = next;
+      step = i + 1;
+    }
+  }
+  return step;
+}
+
+/*
+ * which way the agent should be going, 1 to 4 for north, east, south and west
+ * or 0 for nowhere. walls are the squares around it the kb knows to be walls,
+ * see kb_around(). the route is kept from one move to the next and only
+ * worked out again when it runs out, see policy_route().
+ */
+int policy_heading(int walls)
+{
+  int around[4] = { AROUND(0, -1), AROUND(1, 0), AROUND(0, 1), AROUND(-1, 0) };
+  int step;
+  
+  if(!game.route || game.route_gold != game.has_gold ||
+     (game.x == game.route_to.x && game.y == game.route_to.y) ||
+     policy_route_at(game.x, game.y) < 0)
+    policy_route();
+  step = policy_step();
+  /* the way there went through a wall nobody knew about */
+  if(step && (walls & around[step - 1]))
+  {
+    policy_route();
+    step = policy_step();
+  }
+  return step;
+}
+
+/*
+ * Packs what the agent knows about the squares next to it into a number, out
+ * of the safe, visited and wall squares around it from kb_around(). Each one
+ * is unknown or deadly, safe, visited or a wall, two bits each, going north,
+ * east, south and west. Then the smell, breeze and glitter here, the gold and
+ * the arrow.
+ */
+int policy_view(int safe, int visits, int walls)
+{
+  int around[4] = { AROUND(0, -1), AROUND(1, 0), AROUND(0, 1), AROUND(-1, 0) };
+  int i, state = 0;
+  
+  for(i = 0; i < 4; i++)
+    state = state * 4 + (walls & around[i] ? 3 : visits & around[i] ? 2 :
+      safe & around[i] ? 1 : 0);
+  state = state * 8 + (game.percepts & PERCEPT_SMELL ? 1 : 0) +
+    (game.percepts & PERCEPT_BREEZE ? 2 : 0) +
+    (game.percepts & PERCEPT_GLITTER ? 4 : 0);
+  state = state * 2 + (game.has_gold ? 1 : 0);
+  return state * 2 + (game.arrows ? 1 : 0);
+}
+
+/*
+ * the state number for the policy table, the view and then the heading. it
+ * takes three lookups of the squares around the agent and, most of the time,
+ * a look at the route that is already there.
+ */
+int policy_state()
+{
+  int walls = kb_around(PERCEPT_BUMP, game.x, game.y);
+  
+  return policy_view(kb_around(PERCEPT_SAFE, game.x, game.y),
+    kb_around(PERCEPT_VISITED, game.x, game.y), walls) * 5 +
+    policy_heading(walls);
+}
+
+/* the table's move for where the agent stands, or '.' to ask the kb */
+char policy_lookup(const char *table)
+{
+  return table[policy_state()];
+}
+
+#ifndef WUMPUS_TILED_KB
+/* SQL function game_random(), the same as random() but from the game seed */
+static void game_random_sql(sqlite3_context *context, int argc,
+  sqlite3_value **argv)
+{
+  sqlite3_result_int(context, game_rand());
+}
+#endif
+
+/* returns a word for a percept */
+char *word_from_percept(int percept)
+{
+  char *res = "Unknown";
+  switch(percept)
+  {
+    case(PERCEPT_BUMP):
+      res = "BUMP";
+      break;
+    case(PERCEPT_SMELL):
+      res = "SMELL";
+      break;
+    case(PERCEPT_BREEZE):
+      res = "BREEZE";
+      break;
+    case(PERCEPT_MOO):
+      res = "MOO";
+      break;
+    case(PERCEPT_GLITTER):
+      res = "GLITTER";
+      break;
+    case(PERCEPT_DEAD):
+      res = "DEAD";
+      break;
+    case(PERCEPT_WUMPUS):
+      res = "WUMPUS";
+      break;
+    case(PERCEPT_SUPMUW):
+      res = "SUPMUW";
+      break;
+    case(PERCEPT_PIT):
+      res = "PIT";
+      break;
+    case(PERCEPT_SAFE):
+      res = "SAFE";
+      break;
+    case(PERCEPT_VISITED):
+      res = "VISITED";
+      break;
+    case(PERCEPT_DESTINATION):
+      res = "DESTINATION";
+      break;
+  }
+  return res;
+}
+
+#ifndef WUMPUS_TILED_KB
+/* private callback for printing out each row of the knowledge base */
+static int kb_dump_callback(void *x, int argc, char **argv, char **cols)
+{
+  fprintf(stderr, "%4d: %7s: (%2d, %2d)\n", *((int *)x),
+    (argv[0] ? word_from_percept(atoi(argv[0])) : "NULL"),
+    atoi(argv[1]), atoi(argv[2]));
+  *((int *)x) = *((int *)x) + 1;
+  return 0;
+}
+
+/* dumps the kb's contents to stderr; sorts on value then on column then row */
+void kb_dump()
+{
+  int res = 0, counter = 1;
+  char *err_msg;
   
-  /* I maximize the number of pits to be 15% the size of the map */
-  num_pits = (rand() % (int)(MAP_SIZE * MAP_SIZE * .15)) + 1;
-  for(i = 0; i < num_pits; i++)
+  fprintf(stderr, "Knowledge Base Dump\n");
+  res = sqlite3_exec(game.db, "SELECT * FROM kb ORDER BY sentence, y, x;",
+    kb_dump_callback, (void *)&counter, &err_msg);
+  if(res != SQLITE_OK)
+  {
+    fprintf(stderr, "KB_DUMP: %s\n", err_msg);
+    sqlite3_free(err_msg);
+  }
+}
+
+#else
+/* orders facts for kb_dump(), packed as sentence, y and x from high to low */
+static int kb_dump_compare(const void *a, const void *b)
+{
+  long long x = *(const long long *)a, y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+/* dumps the kb's contents to stderr; sorts on value then on column then row */
+void kb_dump()
+{
+  knowledge *kb = game.db;
+  kb_tile *tile;
+  long long *facts = NULL, row;
+  int i, plane, ly, lx, count = 0, cap = 0;
+  
+  for(i = 0; i < kb->tiles; i++)
+  {
+    tile = &kb->blocks[i / KB_ARENA][i % KB_ARENA];
+    for(plane = 0; plane < KB_SENTENCES; plane++)
+      for(ly = 0; ly < KB_TILE; ly++)
+        for(row = tile->planes[plane][ly]; row; row &= row - 1)
+        {
+          lx = __builtin_ctzll(row);
+          if(count == cap)
+          {
+            cap = cap ? 2 * cap : 256;
+            facts = realloc(facts, cap * sizeof(long long));
+          }
+          /* offset by 2^20 so squares off the map still sort right */
+          facts[count++] = ((long long)plane << 42) |
+            ((long long)((tile->ty << KB_TILE_BITS) + ly + (1 << 20)) << 21) |
+            ((tile->tx << KB_TILE_BITS) + lx + (1 << 20));
+        }
+  }
+  qsort(facts, count, sizeof(long long), kb_dump_compare);
+  
+  fprintf(stderr, "Knowledge Base Dump\n");
+  for(i = 0; i < count; i++)
+    fprintf(stderr, "%4d: %7s: (%2d, %2d)\n", i + 1,
+      word_from_percept(1 << (facts[i] >> 42)),
+      (int)(facts[i] & 0x1fffff) - (1 << 20),
+      (int)((facts[i] >> 21) & 0x1fffff) - (1 << 20));
+  free(facts);
+}
+
+#endif
+
+/* starts up the planner thread, see struct SPECULATION */
+void speculate_init()
+{
+  if(spec.running)
+    return;
+  pthread_mutex_init(&spec.lock, NULL);
+  pthread_cond_init(&spec.wake, NULL);
+  pthread_cond_init(&spec.done, NULL);
+  spec.map_changes = -1;
+  spec.running = 1;
+  if(pthread_create(&spec.thread, NULL, speculate_thread, NULL))
+  {
+    fprintf(stderr, "SPECULATE_INIT: can not start the planner thread\n");
+    spec.running = 0;
+  }
+}
+
+/* shuts down the planner thread once it is done with what it is doing */
+void speculate_stop()
+{
+  if(!spec.running)
+    return;
+  pthread_mutex_lock(&spec.lock);
+  spec.cancel = 1;
+  spec.running = 0;
+  pthread_cond_broadcast(&spec.wake);
+  pthread_mutex_unlock(&spec.lock);
+  pthread_join(spec.thread, NULL);
+  free(spec.map);
+  map_chunks_release(spec.chunks, spec.chunk_slots);
+  spec.map = NULL;
+  spec.chunks = NULL;
+}
+
+/* adds one way the action could turn out to the list */
+void speculate_add(outcome *list, int *count, int x, int y, int percepts,
+  int arrows, int has_gold, int heard_scream)
+{
+  outcome *o;
+  if(*count == SPECULATE_MAX)
+    return;
+  o = &list[(*count)++];
+  o->x = x; o->y = y; o->percepts = percepts; o->arrows = arrows;
+  o->has_gold = has_gold; o->heard_scream = heard_scream;
+}
+
+/*
+ * Works out every way the action could turn out using only what the kb knows,
+ * the most likely ones first, and puts them in list. A square that has been
+ * visited feels the same as it did last time, a new one could feel like
+ * anything. Dying or winning ends the game, so nobody needs a plan for those.
+ */
+int speculate_outcomes(char action, outcome *list)
+{
+  int x2 = game.x, y2 = game.y, here = game.percepts & ~PERCEPT_BUMP;
+  int feel = 0, i, bits, mask, direction = command_direction(action);
+  int kinds[4] = { PERCEPT_SMELL, PERCEPT_BREEZE, PERCEPT_MOO,
+    PERCEPT_GLITTER };
+  int count = 0;
+  
+  delta_coordinates(&x2, &y2, direction);
+  if(action == 'n' || action == 's' || action == 'e' || action == 'w')
+  {
+    if(!wall(x2, y2) && !(x2 == 1 && y2 == 1 && game.has_gold))
+    {
+      if(visited(x2, y2))
+      {
+        for(i = 0; i < 4; i++)
+          if(kb_found(kinds[i], x2, y2))
+            feel |= kinds[i];
+        speculate_add(list, &count, x2, y2, feel, game.arrows,
+          game.has_gold, 0);
+      }
+      else
+      {
+        /* fewest percepts first, those are the common ones */
+        for(bits = 0; bits <= 4; bits++)
+          for(mask = 0; mask < 16; mask++)
+          {
+            if(__builtin_popcount(mask) != bits || (game.has_gold && mask & 8))
+              continue;
+            feel = 0;
+            for(i = 0; i < 4; i++)
+              if(mask & (1 << i))
+                feel |= kinds[i];
+            speculate_add(list, &count, x2, y2, feel, game.arrows,
+              game.has_gold, 0);
+          }
+      }
+    }
+    if(!visited(x2, y2))
+      speculate_add(list, &count, game.x, game.y, here | PERCEPT_BUMP,
+        game.arrows, game.has_gold, 0);
+  }
+  else if(direction && game.arrows)
+  {
+    /* a miss, or a hit that may take the smell or the moo with it */
+    speculate_add(list, &count, game.x, game.y, here, game.arrows - 1,
+      game.has_gold, 0);
+    for(i = 0; i < 4; i++)
+      if((i & 1 && !(here & PERCEPT_SMELL)) || (i & 2 && !(here & PERCEPT_MOO)))
+        continue;
+      else
+        speculate_add(list, &count, game.x, game.y,
+          here & ~(i & 1 ? PERCEPT_SMELL : 0) & ~(i & 2 ? PERCEPT_MOO : 0),
+          game.arrows - 1, game.has_gold, 1);
+  }
+  else if(direction)
+    speculate_add(list, &count, game.x, game.y, here, 0, game.has_gold, 0);
+  else if(action == 'g' && glitter(game.x, game.y))
+    speculate_add(list, &count, game.x, game.y, here & ~PERCEPT_GLITTER,
+      game.arrows, 1, 0);
+  else if(action == 'g')
+    speculate_add(list, &count, game.x, game.y, here, game.arrows,
+      game.has_gold, 0);
+  return count;
+}
+
+/*
+ * Moves the likeliest SPECULATE_TRIES of the n outcomes to the front of the
+ * list, the likeliest first, and returns how many of them could happen at all.
+ */
+int speculate_likeliest(char action, outcome *list, int n)
+{
+  double chance[SPECULATE_MAX], swap_chance;
+  outcome swap;
+  int i, j, best;
+  
+  look.unvisited = (double)(game.size - 2) * (game.size - 2) - visited_count();
+  if(look.unvisited < 1)
+    look.unvisited = 1;
+  outcome_chances(action, list, n, chance);
+  for(i = 0; i < n && i < SPECULATE_TRIES; i++)
+  {
+    for(j = best = i; j < n; j++)
+      if(chance[j] > chance[best])
+        best = j;
+    if(chance[best] <= 0)
+      break;
+    swap = list[i]; list[i] = list[best]; list[best] = swap;
+    swap_chance = chance[i]; chance[i] = chance[best];
+    chance[best] = swap_chance;
+  }
+  return i;
+}
+
+/*
+ * Brings the planner's copy of the map up to date. It is only made again once
+ * the map changed, see map_put(), or a new game started, see
+ * speculate_abandon(). The planner can look at its copy while the game changes
+ * the real one.
+ */
+void speculate_map()
+{
+  int i;
+  chunk *c, *copy;
+  
+  if(spec.map_changes == game.map_changes)
+    return;
+  spec.map_changes = game.map_changes;
+  if(game.kind != MAP_KIND_PROCEDURAL)
+  {
+    spec.map = realloc(spec.map, map_bytes());
+    if(spec.map == NULL)
+    {
+      fprintf(stderr, "SPECULATE_MAP: out of memory\n");
+      exit(1);
+    }
+    memcpy(spec.map, game.map, map_bytes());
+    return;
+  }
+  
+  map_chunks_release(spec.chunks, spec.chunk_slots);
+  spec.chunk_slots = game.chunk_slots;
+  spec.chunk_count = game.chunk_count;
+  spec.chunks = calloc(spec.chunk_slots, sizeof(chunk *));
+  if(spec.chunks == NULL)
+  {
+    fprintf(stderr, "SPECULATE_MAP: out of memory\n");
+    exit(1);
+  }
+  for(i = 0; i < spec.chunk_slots; i++)
+    for(c = game.chunks[i]; c; c = c->next)
+    {
+      copy = malloc(sizeof(chunk));
+      if(copy == NULL)
+      {
+        fprintf(stderr, "SPECULATE_MAP: out of memory\n");
+        exit(1);
+      }
+      *copy = *c;
+      copy->next = spec.chunks[i];
+      spec.chunks[i] = copy;
+    }
+}
+
+/*
+ * Does to the kb what the action would have if it turned out like o, and
+ * tells it the percepts there.
+ */
+void outcome_apply(char action, outcome *o)
+{
+  int x2 = game.x, y2 = game.y;
+  delta_coordinates(&x2, &y2, command_direction(action));
+  if(o->percepts & PERCEPT_BUMP)
+    kb_bumped(x2, y2);
+  if(o->heard_scream)
+    kb_killed(x2, y2);
+  if(o->has_gold && !game.has_gold)
+    kb_grabbed();
+  game.x = o->x; game.y = o->y; game.percepts = o->percepts;
+  game.arrows = o->arrows; game.has_gold = o->has_gold;
+  game.heard_scream = o->heard_scream;
+  kb_tell();
+}
+
+/*
+ * Hands the planner thread the action the agent just chose, along with a copy
+ * of the kb from before the action. Called right before the action is done.
+ */
+void speculate_start(char action)
+{
+  pthread_mutex_lock(&spec.lock);
+  while(spec.busy)
+    pthread_cond_wait(&spec.done, &spec.lock);
+  pthread_mutex_unlock(&spec.lock);
+  
+  game.heard_scream = 0;
+  spec.count = speculate_likeliest(action, spec.outcomes,
+    speculate_outcomes(action, spec.outcomes));
+  if(!spec.count)
+    return;
+  
+  spec.action = action;
+  spec.before = game;
+  speculate_map();
+  spec.kb = kb_clone(game.db);
+  memset(spec.started, 0, sizeof(spec.started));
+  memset(spec.ready, 0, sizeof(spec.ready));
+  memset(spec.kbs, 0, sizeof(spec.kbs));
+  
+  pthread_mutex_lock(&spec.lock);
+  spec.wanted = -1;
+  spec.cancel = 0;
+  spec.active = 1;
+  spec.busy = 1;
+  pthread_cond_broadcast(&spec.wake);
+  pthread_mutex_unlock(&spec.lock);
+}
+
+/*
+ * The planner thread. For each outcome of the action it takes a copy of the
+ * kb, does to it what the action would have, tells it the percepts and asks
+ * it for the next action. Once the real outcome is known it is done next, and
+ * once the game has picked up its answer the rest are thrown away. The last
+ * outcome it gets to takes the kb from before the action itself, so most
+ * turns copy the kb once or twice.
+ */
+static void *speculate_thread(void *unused)
+{
+  int i, j;
+  outcome *o;
+  char decision;
+  knowledge *db;
+  
+  /* a guess is only worth it on time nobody else wanted, linux nices threads */
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+  pthread_mutex_lock(&spec.lock);
+  while(spec.running)
+  {
+    if(!spec.busy)
+    {
+      pthread_cond_wait(&spec.wake, &spec.lock);
+      continue;
+    }
+    
+    while(!spec.cancel)
+    {
+      /* the real outcome first, otherwise the next one in line */
+      i = -1;
+      if(spec.wanted >= 0)
+        i = spec.started[spec.wanted] ? -1 : spec.wanted;
+      else
+        for(i = 0; i < spec.count && spec.started[i]; i++);
+      if(i < 0 || i == spec.count)
+      {
+        pthread_cond_wait(&spec.wake, &spec.lock);
+        continue;
+      }
+      spec.started[i] = 1;
+      for(j = 0; j < spec.count && spec.started[j]; j++);
+      db = NULL;
+      if(spec.wanted >= 0 || j == spec.count)
+      {
+        db = spec.kb;
+        spec.kb = NULL;
+      }
+      pthread_mutex_unlock(&spec.lock);
+      
+      o = &spec.outcomes[i];
+      game = spec.before;
+      game.map = spec.map;
+      game.chunks = spec.chunks;
+      game.chunk_slots = spec.chunk_slots;
+      game.chunk_count = spec.chunk_count;
+      game.use_agent = 1;
+      game.out_of_time = 0;
+      /* nothing the planner counts would end up in the game's counts */
+      game.use_counters = 0;
+      /* nor what it guesses in the game's log */
+      game.log_level = 0;
+      game.deadline = game.move_budget ? now_ns() + game.move_budget : 0;
+      game.db = db ? db : kb_clone(spec.kb);
+      /* the game's route is the game's, the policy works out its own */
+      game.route = NULL;
+      game.route_cells = 0;
+      outcome_apply(spec.action, o);
+      decision = kb_ask_action();
+      free(game.route);
+      
+      pthread_mutex_lock(&spec.lock);
+      /* the planner may have had to make chunks of its own */
+      spec.chunks = game.chunks;
+      spec.chunk_slots = game.chunk_slots;
+      spec.chunk_count = game.chunk_count;
+      spec.kbs[i] = game.db;
+      spec.decisions[i] = decision;
+      spec.dest_x[i] = game.dest_x;
+      spec.dest_y[i] = game.dest_y;
+      spec.rng[i] = game.rng;
+      spec.kb_hash[i] = game.kb_hash;
+      spec.ready[i] = 1;
+      pthread_cond_broadcast(&spec.done);
+    }
+    
+    /* whatever the game did not take is no good to anyone now */
+    for(i = 0; i < spec.count; i++)
+      if(spec.kbs[i])
+        kb_release(spec.kbs[i]);
+    if(spec.kb)
+      kb_release(spec.kb);
+    spec.kb = NULL;
+    spec.busy = 0;
+    pthread_cond_broadcast(&spec.done);
+  }
+  pthread_mutex_unlock(&spec.lock);
+  return NULL;
+}
+
+/*
+ * The percepts are in. If the planner saw this outcome coming it is told to
+ * get on with it, otherwise the guesses are dropped and the kb is told about
+ * the percepts the normal way.
+ */
+void speculate_arrived()
+{
+  int i;
+  outcome *o;
+  
+  pthread_mutex_lock(&spec.lock);
+  for(i = 0; i < spec.count; i++)
+  {
+    o = &spec.outcomes[i];
+    if(o->x == game.x && o->y == game.y && o->percepts == game.percepts &&
+       o->arrows == game.arrows && o->has_gold == game.has_gold &&
+       o->heard_scream == game.heard_scream)
+      break;
+  }
+  if(i < spec.count)
+  {
+    spec.hits++;
+    spec.wanted = i;
+    pthread_cond_broadcast(&spec.wake);
+    pthread_mutex_unlock(&spec.lock);
+    return;
+  }
+  spec.misses++;
+  spec.cancel = 1;
+  spec.active = 0;
+  pthread_cond_broadcast(&spec.wake);
+  pthread_mutex_unlock(&spec.lock);
+  kb_tell();
+}
+
+/*
+ * Takes the planner's kb and decision for the real outcome. The kb already
+ * knows about the percepts and whatever kb_ask_action() wrote into it. If the
+ * planner has not got there yet the game does not wait, it tells its own kb
+ * about the percepts and asks it the normal way.
+ */
+char speculate_adopt()
+{
+  int i, ready;
+  knowledge *db = NULL;
+  
+  pthread_mutex_lock(&spec.lock);
+  i = spec.wanted;
+  ready = spec.ready[i];
+  if(ready)
+  {
+    db = spec.kbs[i];
+    spec.kbs[i] = NULL;
+  }
+  else
+    spec.late++;
+  spec.cancel = 1;
+  spec.active = 0;
+  pthread_cond_broadcast(&spec.wake);
+  pthread_mutex_unlock(&spec.lock);
+  
+  if(!ready)
+  {
+    kb_tell();
+    return kb_ask_action();
+  }
+  kb_release(game.db);
+  game.db = db;
+  game.dest_x = spec.dest_x[i];
+  game.dest_y = spec.dest_y[i];
+  game.rng = spec.rng[i];
+  game.kb_hash = spec.kb_hash[i];
+  return spec.decisions[i];
+}
+
+/*
+ * The game ended with guesses still out. They were made with the percepts
+ * already in the kb, so the kb has to be told about them itself.
+ */
+void speculate_abandon()
+{
+  /* the next game has a map of its own */
+  spec.map_changes = -1;
+  if(!spec.active)
+    return;
+  pthread_mutex_lock(&spec.lock);
+  spec.cancel = 1;
+  spec.active = 0;
+  pthread_cond_broadcast(&spec.wake);
+  pthread_mutex_unlock(&spec.lock);
+  kb_tell();
+}
+
+/* which bucket of a histogram a value goes in */
+int hist_index(long long value)
+{
+  int top;
+  if(value < (1 << HIST_SUB_BITS))
+    return value < 0 ? 0 : (int)value;
+  top = 63 - __builtin_clzll(value);
+  return ((top - HIST_SUB_BITS + 1) << HIST_SUB_BITS) +
+    (int)((value >> (top - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1));
+}
+
+/* the value in the middle of a histogram bucket */
+long long hist_value(int index)
+{
+  int top = (index >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+  long long low;
+  if(index < (1 << HIST_SUB_BITS))
+    return index;
+  low = ((1LL << HIST_SUB_BITS) + (index & ((1 << HIST_SUB_BITS) - 1))) <<
+    (top - HIST_SUB_BITS);
+  return low + ((1LL << (top - HIST_SUB_BITS)) >> 1);
+}
+
+/* records one value, remembering where it came from if it is a slow one */
+void hist_record(histogram *h, long long value)
+{
+  int i, j;
+  h->count++;
+  h->buckets[hist_index(value)]++;
+  if(value > h->max)
+    h->max = value;
+  for(i = 0; i < HIST_WORST && h->worst[i].ns >= value; i++);
+  if(i == HIST_WORST)
+    return;
+  for(j = HIST_WORST - 1; j > i; j--)
+    h->worst[j] = h->worst[j - 1];
+  h->worst[i].ns = value;
+  h->worst[i].seed = game.seed;
+  h->worst[i].turn = game.decisions;
+}
+
+/* adds everything in one histogram into another */
+void hist_merge(histogram *into, histogram *from)
+{
+  int i, j, k;
+  slowest worst[HIST_WORST];
+  
+  into->count += from->count;
+  if(from->max > into->max)
+    into->max = from->max;
+  for(i = 0; i < HIST_BUCKETS; i++)
+    into->buckets[i] += from->buckets[i];
+  for(i = j = k = 0; k < HIST_WORST; k++)
+    worst[k] = into->worst[i].ns >= from->worst[j].ns ?
+      into->worst[i++] : from->worst[j++];
+  memcpy(into->worst, worst, sizeof(worst));
+}
+
+/* the value below which the given fraction of all the values fall */
+long long hist_percentile(histogram *h, double fraction)
+{
+  long long seen = 0, wanted = (long long)ceil(h->count * fraction);
+  int i;
+  if(wanted < 1)
+    wanted = 1;
+  for(i = 0; i < HIST_BUCKETS; i++)
+  {
+    seen += h->buckets[i];
+    if(seen >= wanted)
+      return hist_value(i) < h->max ? hist_value(i) : h->max;
+  }
+  return h->max;
+}
+
+/* prints the tail latency of every phase and the worst turns of all */
+void print_latency(histogram *phases)
+{
+  int i, j;
+  histogram *h;
+  
+  printf("\n%-7s %8s %9s %9s %9s %9s %9s\n", "phase", "count", "p50 us",
+    "p90 us", "p99 us", "p99.9 us", "max us");
+  for(i = 0; i < PHASES; i++)
+  {
+    h = &phases[i];
+    if(!h->count)
+      continue;
+    printf("%-7s %8lld %9.1f %9.1f %9.1f %9.1f %9.1f\n", phase_names[i],
+      h->count, hist_percentile(h, .5) / 1e3, hist_percentile(h, .9) / 1e3,
+      hist_percentile(h, .99) / 1e3, hist_percentile(h, .999) / 1e3,
+      h->max / 1e3);
+  }
+  h = &phases[PHASE_TURN];
+  for(j = 0; j < HIST_WORST && h->worst[j].ns; j++)
+    printf("Slow turn: %9.1f us, seed %u turn %d\n", h->worst[j].ns / 1e3,
+      h->worst[j].seed, h->worst[j].turn);
+}
+
+/*
+ * Opens the hardware counters of the calling thread, see struct PMU. Events
+ * the CPU can't count are left out. Returns 0 if it can't count anything, which
+ * is only said once since every thread is going to find the same.
+ */
+int pmu_open()
+{
+  static const unsigned int types[PMU_EVENTS] = {
+    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+    PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE
+  };
+  static const unsigned long long configs[PMU_EVENTS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+      PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+    PERF_COUNT_HW_CACHE_LL | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+      PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+    PERF_COUNT_HW_BRANCH_MISSES
+  };
+  static int warned = 0;
+  struct perf_event_attr attr;
+  int i, fd, n = 0, failed = 0;
+  
+  pmu.state = -1;
+  pmu.leader = -1;
+  for(i = 0; i < PMU_EVENTS; i++)
+  {
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = types[i];
+    attr.config = configs[i];
+    attr.disabled = pmu.leader < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+      PERF_FORMAT_TOTAL_TIME_RUNNING;
+    fd = syscall(SYS_perf_event_open, &attr, 0, -1, pmu.leader, 0);
+    if(fd < 0 && !failed)
+      failed = errno;
+    pmu.slot[i] = fd < 0 ? -1 : n++;
+    if(fd >= 0 && pmu.leader < 0)
+      pmu.leader = fd;
+  }
+  if(pmu.leader < 0)
+  {
+    if(!warned++)
+      fprintf(stderr, "PMU: no hardware counters: %s%s\n", strerror(failed),
+        failed == EACCES ? " (see /proc/sys/kernel/perf_event_paranoid)" : "");
+    return 0;
+  }
+  ioctl(pmu.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  pmu.state = 1;
+  return 1;
+}
+
+/*
+ * What the thread's counters are up to now, all zero without --counters. If
+ * the kernel had to share the counters with someone else the counts are
+ * scaled up to the whole time they were meant to be counting.
+ */
+void pmu_read(pmu_count *now)
+{
+  /* how many events, the time enabled and running, then the counts */
+  unsigned long long buf[3 + PMU_EVENTS];
+  int i;
+  
+  memset(now, 0, sizeof(pmu_count));
+  if(!game.use_counters || (!pmu.state && !pmu_open()) || pmu.state < 0)
+    return;
+  if(read(pmu.leader, buf, sizeof(buf)) < (ssize_t)(3 * sizeof(buf[0])))
+    return;
+  for(i = 0; i < PMU_EVENTS; i++)
+    if(pmu.slot[i] >= 0)
+      now->count[i] = buf[2] && buf[2] < buf[1] ?
+        (unsigned long long)((double)buf[3 + pmu.slot[i]] * buf[1] / buf[2]) :
+        buf[3 + pmu.slot[i]];
+}
+
+/* adds what the counters counted since then to a phase of the game */
+void pmu_add(int phase, pmu_count *since)
+{
+  pmu_count now;
+  int i;
+  if(!game.use_counters)
+    return;
+  pmu_read(&now);
+  for(i = 0; i < PMU_EVENTS; i++)
+    game.counters[phase].count[i] += now.count[i] - since->count[i];
+}
+
+/* adds everything one game's counters counted into another */
+void pmu_merge(pmu_count *into, pmu_count *from)
+{
+  int i;
+  for(i = 0; i < PMU_EVENTS; i++)
+    into->count[i] += from->count[i];
+}
+
+/*
+ * prints what the hardware counted in every phase, per time the phase ran,
+ * along with the instructions per cycle. events that weren't counted are a -.
+ */
+void print_counters(pmu_count *phases, histogram *latency)
+{
+  int i, j;
+  double per;
+  
+  if(pmu.state <= 0)
+    return;
+  printf("\n%-7s", "phase");
+  for(j = 0; j < PMU_EVENTS; j++)
+    printf(" %9s", pmu_names[j]);
+  printf(" %5s\n", "IPC");
+  for(i = 0; i < PHASES; i++)
+  {
+    if(!latency[i].count)
+      continue;
+    per = 1.0 / latency[i].count;
+    printf("%-7s", phase_names[i]);
+    for(j = 0; j < PMU_EVENTS; j++)
+      if(pmu.slot[j] < 0)
+        printf(" %9s", "-");
+      else
+        printf(" %9.0f", phases[i].count[j] * per);
+    if(phases[i].count[PMU_CYCLES])
+      printf(" %5.2f\n", (double)phases[i].count[PMU_INSTRUCTIONS] /
+        phases[i].count[PMU_CYCLES]);
+    else
+      printf(" %5s\n", "-");
+  }
+}
+
+/* monotonic clock in nanoseconds, for timing things */
+long long now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* looks up a benchmark tier by name */
+const tier *find_tier(const char *name)
+{
+  int i;
+  for(i = 0; i < BENCH_TIERS; i++)
+    if(strcmp(bench_tiers[i].name, name) == 0)
+      return &bench_tiers[i];
+  return NULL;
+}
+
+/* makes the next init_game() build a map like the ones in the tier */
+void use_tier(const tier *t)
+{
+  game.size = t->size;
+  game.kind = t->kind;
+  game.pit_ratio = t->pit_ratio;
+  game.wall_ratio = t->wall_ratio;
+}
+
+/* one map in the corpus and what the agent did on it */
+typedef struct BENCH_MAP {
+  const tier *t;
+  unsigned int seed;
+  int golden, score, steps, won;
+} bench_map;
+
+/* compares a measurement against the recorded one, bigger is better */
+static const char *bench_compare(double now, double then, const char *more,
+  const char *less)
+{
+  if(then <= 0)
+    return "unknown";
+  if(now > then * (1 + BENCH_NOISE))
+    return more;
+  if(now < then * (1 - BENCH_NOISE))
+    return less;
+  return "same";
+}
+
+/* the middle of the times the passes took, the slow and fast ones are out */
+static long long bench_median(long long *v)
+{
+  long long sorted[BENCH_PASSES], x;
+  int i, j;
+  
+  for(i = 0; i < BENCH_PASSES; i++)
+  {
+    for(j = i, x = v[i]; j > 0 && sorted[j - 1] > x; j--)
+      sorted[j] = sorted[j - 1];
+    sorted[j] = x;
+  }
+  return sorted[BENCH_PASSES / 2];
+}
+
+/* prints one line of the benchmark results */
+static void bench_report(const char *name, bench_total *t)
+{
+  double gps = t->ns ? t->games / (t->ns / 1e9) : 0;
+  double us = t->decisions ? t->decision_ns / 1e3 / t->decisions : 0;
+  printf("%-8s %5d %9.2f %10.1f %8.1f %6.1f%% %7.1f %7d\n", name, t->games,
+    gps, us, (double)t->score / t->games, 100.0 * t->wins / t->games,
+    (double)t->steps / t->games, t->changed);
+  if(t->golden)
+    printf("%-8s %5d %9.2f %10.1f %8.1f %6.1f%% %7.1f\n", " golden",
+      t->golden, t->perf_gps, t->perf_us,
+      (double)t->golden_score / t->golden,
+      100.0 * t->golden_wins / t->golden,
+      (double)t->golden_steps / t->golden);
+}
+
+/*
+ * Plays the agent through every map of a corpus file and compares the results
+ * with the golden outcomes stored in it. Lines of the corpus look like
+ *
+ *   map <tier> <seed> [<score> <steps> <won>]
+ *   perf <tier> <games/sec> <mean decision usec>
+ *
+ * The map lines are the outcomes the agent is expected to get, the perf lines
+ * are how fast it was when they were recorded, on that machine. The corpus is
+ * played BENCH_PASSES times and each tier's time is the median of them, the
+ * outcomes come from the first pass since the games play out the same every
+ * time. With update set, the file is rewritten with whatever happened this
+ * time. Maps that can not be won are left out with skip_impossible. The
+ * results are also split up by how hard the maps were, along with how far the
+ * agent was from the best possible score. Returns 1 if the agent got worse,
+ * or slower with strict set, 0 otherwise.
+ */
+int run_bench(const char *path, int update, int skip_impossible, int strict)
+{
+  FILE *fp;
+  char line[256], name[32];
+  int i, j, n = 0, cap = 64, worse = 0, slower, fields, timeouts = 0, pass;
+  long long ns[BENCH_TIERS][BENCH_PASSES];
+  long long decision_ns[BENCH_TIERS][BENCH_PASSES];
+  const char *by_games, *by_decisions;
+  double gps, us;
+  long long started;
+  bench_map *maps = malloc(sizeof(bench_map) * cap), *m;
+  bench_total totals[BENCH_TIERS + 1], *t, *all = &totals[BENCH_TIERS];
+  bench_class classes[MAP_CLASS_IMPOSSIBLE + 1], *c;
+  histogram *latency = calloc(PHASES, sizeof(histogram));
+  pmu_count counters[PHASES];
+  const tier *found;
+  
+  memset(totals, 0, sizeof(totals));
+  memset(classes, 0, sizeof(classes));
+  memset(counters, 0, sizeof(counters));
+  memset(ns, 0, sizeof(ns));
+  memset(decision_ns, 0, sizeof(decision_ns));
+  if((fp = fopen(path, "r")) == NULL)
+  {
+    fprintf(stderr, "BENCH: can not open %s\n", path);
+    return 1;
+  }
+  while(fgets(line, sizeof(line), fp))
   {
-    random_map_x_y(&x, &y);
-    game.map[x][y] = MAP_PIT;
+    if(line[0] == '#' || line[0] == '\n')
+      continue;
+    if(sscanf(line, "perf %31s %lf %lf", name, &gps, &us) == 3)
+    {
+      if((found = find_tier(name)) != NULL)
+      {
+        totals[found - bench_tiers].perf_gps = gps;
+        totals[found - bench_tiers].perf_us = us;
+      }
+      continue;
+    }
+    if(n == cap)
+      maps = realloc(maps, sizeof(bench_map) * (cap *= 2));
+    m = &maps[n];
+    fields = sscanf(line, "map %31s %u %d %d %d", name, &m->seed, &m->score,
+      &m->steps, &m->won);
+    if(fields < 2 || (m->t = find_tier(name)) == NULL)
+    {
+      fprintf(stderr, "BENCH: bad corpus line: %s", line);
+      continue;
+    }
+    m->golden = (fields == 5);
+    n++;
   }
+  fclose(fp);
   
-  /* set up the interior walls in random locations. max 10% of mapsize */
-  num_walls = (rand() % (int)(MAP_SIZE * MAP_SIZE * .10)) + 1;
-  for(i = 0; i < num_walls; i++)
+  printf("%-8s %5s %9s %10s %8s %7s %7s %7s\n", "tier", "games", "games/s",
+    "dec (us)", "score", "win", "steps", "changed");
+  for(pass = 0; pass < BENCH_PASSES; pass++)
   {
-    random_map_x_y(&x, &y);
-    game.map[x][y] = MAP_WALL;
+    for(i = 0; i < n; i++)
+    {
+      m = &maps[i];
+      t = &totals[m->t - bench_tiers];
+      use_tier(m->t);
+      game.seed = m->seed;
+      game.use_agent = 1;
+      game.quiet = 1;
+      
+      started = now_ns();
+      init_game();
+      if(skip_impossible && game.map_class == MAP_CLASS_IMPOSSIBLE)
+      {
+        end_game();
+        continue;
+      }
+      play_game();
+      ns[m->t - bench_tiers][pass] += now_ns() - started;
+      decision_ns[m->t - bench_tiers][pass] += game.decision_ns;
+      /* the later passes are only there for the time they take */
+      if(pass)
+      {
+        end_game();
+        continue;
+      }
+      
+      c = &classes[game.map_class];
+      c->games++;
+      c->wins += has_won() ? 1 : 0;
+      c->score += game.score;
+      c->oracle += game.oracle;
+      
+      t->games++;
+      t->decisions += game.decisions;
+      timeouts += game.timeouts;
+      t->score += game.score;
+      t->steps += game.steps_taken;
+      t->wins += has_won() ? 1 : 0;
+      if(m->golden)
+      {
+        t->golden++;
+        t->golden_score += m->score;
+        t->golden_steps += m->steps;
+        t->golden_wins += m->won;
+        if(m->score != game.score || m->steps != game.steps_taken ||
+           m->won != has_won())
+          t->changed++;
+      }
+      m->score = game.score;
+      m->steps = game.steps_taken;
+      m->won = has_won();
+      for(j = 0; j < PHASES; j++)
+      {
+        hist_merge(&latency[j], &game.latency[j]);
+        pmu_merge(&counters[j], &game.counters[j]);
+      }
+      end_game();
+    }
   }
   
-  /* Create Wumpus at Random Location */
-  random_map_x_y(&x, &y);
-  game.map[x][y] = MAP_WUMPUS;
-  
-  /* Randomly place a pot - o - gold */
-  random_map_x_y(&x, &y);
-  game.map[x][y] = MAP_GOLD;
+  /* sum up the tiers, the baseline time is what the old speed would take */
+  for(i = 0; i < BENCH_TIERS; i++)
+  {
+    t = &totals[i];
+    if(!t->games)
+      continue;
+    t->ns = bench_median(ns[i]);
+    t->decision_ns = bench_median(decision_ns[i]);
+    bench_report(bench_tiers[i].name, t);
+    all->games += t->games; all->wins += t->wins; all->changed += t->changed;
+    all->decisions += t->decisions; all->decision_ns += t->decision_ns;
+    all->score += t->score; all->steps += t->steps; all->ns += t->ns;
+    all->golden += t->golden; all->golden_wins += t->golden_wins;
+    all->golden_score += t->golden_score;
+    all->golden_steps += t->golden_steps;
+    if(t->perf_gps > 0 && all->perf_gps >= 0)
+      all->perf_gps += t->games / t->perf_gps;
+    else
+      all->perf_gps = -1;
+    all->perf_us += t->perf_us * t->decisions;
+  }
+  if(!all->games)
+  {
+    fprintf(stderr, "BENCH: no maps in %s\n", path);
+    free(latency);
+    free(maps);
+    return 1;
+  }
+  all->perf_gps = all->perf_gps > 0 ? all->games / all->perf_gps : 0;
+  all->perf_us = all->decisions ? all->perf_us / all->decisions : 0;
+  bench_report("all", all);
   
-  /* Place the Supmuw (wumpus cousin) */
-  random_map_x_y(&x, &y);
-  game.map[x][y] = MAP_SUPMUW;
-  /* check to see if the supmuw neighbors the wumpus, used for percepts */
-  if(game.map[x][y + 1] == MAP_WUMPUS ||
-     game.map[x][y - 1] == MAP_WUMPUS ||
-     game.map[x + 1][y] == MAP_WUMPUS ||
-     game.map[x - 1][y] == MAP_WUMPUS)
+  /* how hard were the maps and how close did the agent get to perfect */
+  printf("\n%-10s %5s %7s %8s %8s %8s\n", "class", "games", "win", "score",
+    "oracle", "regret");
+  for(i = 0; i <= MAP_CLASS_IMPOSSIBLE; i++)
   {
-    game.supmuw_neighbors_wumpus = 1;
+    c = &classes[i];
+    if(c->games)
+      printf("%-10s %5d %6.1f%% %8.1f %8.1f %8.1f\n", word_from_class(i),
+        c->games, 100.0 * c->wins / c->games, (double)c->score / c->games,
+        (double)c->oracle / c->games,
+        (double)(c->oracle - c->score) / c->games);
   }
+  print_latency(latency);
+  if(game.use_counters)
+    print_counters(counters, latency);
+  free(latency);
   
-  /* set up the database for the KB */
-  if(game.use_agent)
+  /* the verdict, latency is backwards since smaller is better */
+  by_games = bench_compare(all->games / (all->ns / 1e9), all->perf_gps,
+    "faster", "slower");
+  by_decisions = all->perf_us > 0 ? bench_compare(all->perf_us,
+    all->decisions ? all->decision_ns / 1e3 / all->decisions : 0, "faster",
+    "slower") : "unknown";
+  printf("\nSpeed:   %s (games/sec), %s (decision latency)\n", by_games,
+    by_decisions);
+  slower = strcmp(by_games, "slower") == 0 ||
+    strcmp(by_decisions, "slower") == 0;
+  if(all->golden && (double)all->score / all->games <
+     (double)all->golden_score / all->golden)
+    worse = 1;
+  if(game.move_budget)
+    printf("Budget:  %d of %d decisions ran out of time\n", timeouts,
+      all->decisions);
+  if(spec.running)
+    printf("Planner: saw %d of %d turns coming, %d of them too late\n",
+      spec.hits, spec.hits + spec.misses, spec.late);
+  printf("Quality: %s (score), %d of %d maps played differently\n",
+    !all->golden || all->score * all->golden == all->golden_score * all->games ?
+      "same" : (worse ? "worse" : "better"), all->changed, all->golden);
+  
+  if(update)
   {
-    kb_init();
-    /* let the kb know about the outside walls. */
-    for(i = 0; i < MAP_SIZE; i++)
+    if((fp = fopen(path, "w")) == NULL)
     {
-      kb_insert(PERCEPT_BUMP, i, 0);
-      kb_insert(PERCEPT_BUMP, i, MAP_SIZE - 1);
-      kb_insert(PERCEPT_BUMP, 0, i);
-      kb_insert(PERCEPT_BUMP, MAP_SIZE - 1, i);
+      fprintf(stderr, "BENCH: can not write %s\n", path);
+      free(maps);
+      return 1;
     }
+    fprintf(fp, "# Wum+ benchmark corpus, run with: wumplus --bench <file>\n");
+    fprintf(fp, "# tiers: default (%dx%d), pits (dense pits), maze (walls), "
+      "large (%dx%d)\n", MAP_SIZE, MAP_SIZE, bench_tiers[BENCH_TIERS - 1].size,
+      bench_tiers[BENCH_TIERS - 1].size);
+    fprintf(fp, "# the perf lines only hold for the machine that recorded "
+      "them\n");
+    fprintf(fp, "# map <tier> <seed> <score> <steps> <won>\n");
+    for(i = 0; i < n; i++)
+      fprintf(fp, "map %s %u %d %d %d\n", maps[i].t->name, maps[i].seed,
+        maps[i].score, maps[i].steps, maps[i].won);
+    fprintf(fp, "# perf <tier> <games/sec> <mean decision usec>, the median "
+      "of %d passes\n", BENCH_PASSES);
+    for(i = 0; i < BENCH_TIERS; i++)
+      if(totals[i].games)
+        fprintf(fp, "perf %s %.3f %.1f\n", bench_tiers[i].name,
+          totals[i].games / (totals[i].ns / 1e9),
+          totals[i].decisions ?
+            totals[i].decision_ns / 1e3 / totals[i].decisions : 0);
+    fclose(fp);
+    printf("Recorded the new outcomes in %s\n", path);
+    worse = slower = 0;
   }
+  free(maps);
+  return worse || (strict && slower);
 }
 
 /*
- * Processes the player position and determines if any percepts fire.
- * This checks the map given the player's current position and sets all flags
- * as appropriate. The only flag not set is the PERCEPT_BUMP flag which _must_
- * be set by the action_move() function since the player cannot occupy the
- * same square as the wall.
+ * Maps a --maps file in and checks it is one, then the game is set up to be
+ * played on its maps. Returns 1 if it can't be used.
  */
-void process_percepts()
+int map_file_open(const char *path)
 {
-  int x = game.x, y = game.y, flags = 0;
-  char north = game.map[x][y - 1], south = game.map[x][y + 1];
-  char east = game.map[x + 1][y], west = game.map[x - 1][y];
+  struct stat st;
+  maps_header *h;
+  int fd;
   
-  /* the move function sets this percept */
-  int bumped = game.percepts & PERCEPT_BUMP;
-  if(bumped)
-    flags |= PERCEPT_BUMP;
-  /* see if the player is dead, first */
-  if(game.map[x][y] == MAP_PIT || game.map[x][y] == MAP_WUMPUS ||
-     (game.map[x][y] == MAP_SUPMUW && game.supmuw_neighbors_wumpus))
+  if((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0)
   {
-    flags |= PERCEPT_DEAD;
-    add_score(SCORE_DEATH);
-    if(game.map[x][y] == MAP_PIT)
-      printf("You have fallen into a pit!\n");
-    else
-      printf("You have been consumed by the beast!\n");
+    perror(path);
+    return 1;
   }
-  if(north == MAP_WUMPUS ||
-     south == MAP_WUMPUS ||
-     east == MAP_WUMPUS ||
-     west == MAP_WUMPUS)
-    flags |= PERCEPT_SMELL;
-  if(north == MAP_PIT ||
-     south == MAP_PIT ||
-     east == MAP_PIT ||
-     west == MAP_PIT)
-    flags |= PERCEPT_BREEZE;
-  if(north == MAP_SUPMUW ||
-     south == MAP_SUPMUW ||
-     east == MAP_SUPMUW ||
-     west == MAP_SUPMUW)
-    flags |= PERCEPT_MOO;
-  if(game.map[x][y] == MAP_GOLD)
-    flags |= PERCEPT_GLITTER;
-  if(flags & PERCEPT_MOO && game.supmuw_neighbors_wumpus)
-    flags |= PERCEPT_SMELL;
-  game.percepts = flags;
-  if(game.use_agent)
-    kb_tell();
+  map_file.bytes = st.st_size;
+  h = map_file.bytes >= sizeof(maps_header) ?
+    mmap(NULL, map_file.bytes, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  if(h == MAP_FAILED || h->magic != MAPS_MAGIC || h->size < 4 ||
+     h->kind == MAP_KIND_PROCEDURAL || h->count < 0 ||
+     h->record_size < (int)sizeof(map_record) + (h->size * h->size + 3) / 4 ||
+     map_file.bytes < sizeof(maps_header) + (size_t)h->count * h->record_size)
+  {
+    fprintf(stderr, "MAPS: %s is not a map file from --make-maps\n", path);
+    if(h != MAP_FAILED)
+      munmap(h, map_file.bytes);
+    return 1;
+  }
+  madvise(h, map_file.bytes, MADV_SEQUENTIAL);
+  map_file.header = h;
+  game.size = h->size;
+  game.kind = h->kind;
+  game.pit_ratio = h->pit_ratio;
+  game.wall_ratio = h->wall_ratio;
+  return 0;
 }
 
-/* unknown action */
-void unknown_action()
+/* the i'th map of the --maps file, or NULL if there are not that many */
+const map_record *map_file_record(int i)
 {
-  printf("Do what now? (Unknown action)\n");
+  if(i < 0 || i >= map_file.header->count)
+    return NULL;
+  return (const map_record *)((const char *)(map_file.header + 1) +
+    (size_t)i * map_file.header->record_size);
 }
 
-/* does what the player wants */
-void process_player_command(char choice)
+/*
+ * Makes count maps starting at --seed with the current settings and writes
+ * them out as a map file for --maps. Returns 1 if it couldn't.
+ */
+int run_make_maps(int count, const char *path)
 {
-  switch(choice)
+  maps_header h;
+  map_record *record;
+  FILE *fp;
+  int i, failed;
+  
+  memset(&h, 0, sizeof(h));
+  h.magic = MAPS_MAGIC;
+  h.size = game.size;
+  h.kind = game.kind;
+  h.pit_ratio = game.pit_ratio;
+  h.wall_ratio = game.wall_ratio;
+  h.count = count;
+  h.record_size = (sizeof(map_record) + (game.size * game.size + 3) / 4 + 7) &
+    ~7;
+  if((fp = fopen(path, "wb")) == NULL)
   {
-    case '?':
-      print_help();
-      break;
-    case 'q':
-      action_quit();
-      break;
-    case 'n':
-    case 'k':
-      action_move(DIRECTION_NORTH);
-      break;
-    case 's':
-    case 'j':
-      action_move(DIRECTION_SOUTH);
-      break;
-    case 'e':
-    case 'l':
-      action_move(DIRECTION_EAST);
-      break;
-    case 'w':
-    case 'h':
-      action_move(DIRECTION_WEST);
-      break;
-    case 'N':
-      action_shoot(DIRECTION_NORTH);
-      break;
-    case 'S':
-      action_shoot(DIRECTION_SOUTH);
-      break;
-    case 'E':
-      action_shoot(DIRECTION_EAST);
-      break;
-    case 'W':
-      action_shoot(DIRECTION_WEST);
-      break;
-    case 'g':
-      action_grab();
-      break;
-    default:
-      unknown_action();
+    perror(path);
+    return 1;
+  }
+  record = calloc(1, h.record_size);
+  fwrite(&h, sizeof(h), 1, fp);
+  game.use_agent = 0;
+  game.quiet = 1;
+  for(i = 0; i < count; i++)
+  {
+    init_game();
+    map_to_record(record);
+    fwrite(record, h.record_size, 1, fp);
+    end_game();
+    game.seed++;
+  }
+  free(record);
+  failed = ferror(fp);
+  if(fclose(fp) || failed)
+  {
+    perror(path);
+    return 1;
+  }
+  printf("Wrote %d %dx%d maps to %s\n", count, h.size, h.size, path);
+  return 0;
+}
+
+/*
+ * how many games a run plays at once, --jobs or one per CPU, or 0 if it was
+ * given --speculate as well. the planner only looks after one game at a time.
+ */
+int game_jobs(const char *option, int jobs)
+{
+  if(spec.running)
+  {
+    fprintf(stderr, "--%s and --speculate can not be used together\n",
+      option);
+    return 0;
   }
+  if(jobs <= 0)
+    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  return jobs > 0 ? jobs : 1;
 }
 
-/* get user defined inputs */
-void user_input()
+/* runs thread on jobs threads at once and waits for all of them to finish */
+void run_threads(int jobs, void *(*thread)(void *))
 {
-  char choice;
-  printf("Enter a Command (?): ");
-  scanf("%1s", &choice);
-  process_player_command(choice);
+  pthread_t *threads = malloc(sizeof(pthread_t) * jobs);
+  int i;
+  
+  for(i = 0; i < jobs; i++)
+    pthread_create(&threads[i], NULL, thread, NULL);
+  for(i = 0; i < jobs; i++)
+    pthread_join(threads[i], NULL);
+  free(threads);
+}
+
+/* plays maps off the --maps file, or seeds, until there are none left */
+static void *maps_thread(void *unused)
+{
+  summary *results = calloc(1, sizeof(summary));
+  int i;
+  
+  game = map_file.settings;
+  pthread_mutex_lock(&map_file.lock);
+  while(map_file.next < map_file.last)
+  {
+    i = map_file.next++;
+    pthread_mutex_unlock(&map_file.lock);
+    
+    if(map_file.header)
+      game.preset = map_file_record(i);
+    else
+      game.seed = map_file.settings.seed + i;
+    init_game();
+    play_game();
+    summary_add(results);
+    end_game();
+    
+    pthread_mutex_lock(&map_file.lock);
+  }
+  summary_merge(&map_file.results, results);
+  pthread_mutex_unlock(&map_file.lock);
+  free(results);
+  return NULL;
 }
 
 /*
- * get agent (AI) desired action, asks the knowledge base and guesses for the
- * best course of action.
+ * Has the agent play the maps of the --maps file headless, or the games maps
+ * from --seed on without one, jobs games at a time, and shows how it did like
+ * --bench does, without anything to compare it with. Out of shards slices of
+ * the maps, only the shard'th is played, and the results are also written to
+ * path if there is one.
  */
-void agent_input()
+int run_maps(int games, int jobs, int shard, int shards, const char *path)
 {
-  char choice = kb_ask_action();
-  printf("agent_input: %c\n", choice);
-  process_player_command(choice);
+  long long started = now_ns();
+  long long count = map_file.header ? map_file.header->count : games;
+  summary *results = &map_file.results;
+  FILE *fp;
+  int failed;
+  
+  game.use_agent = 1;
+  game.quiet = 1;
+  map_file.settings = game;
+  map_file.next = count * shard / shards;
+  map_file.last = count * (shard + 1) / shards;
+  results->magic = SUMMARY_MAGIC;
+  results->size = sizeof(summary);
+  results->shard = shard;
+  results->shards = shards;
+  results->maps = count;
+  results->seed = map_file.header ? 0 : game.seed;
+  pthread_mutex_init(&map_file.lock, NULL);
+  run_threads(jobs, maps_thread);
+  results->total.ns = now_ns() - started;
+  
+  if(path)
+  {
+    if((fp = fopen(path, "wb")) == NULL)
+    {
+      perror(path);
+      return 1;
+    }
+    fwrite(results, sizeof(summary), 1, fp);
+    failed = ferror(fp);
+    if(fclose(fp) || failed)
+    {
+      perror(path);
+      return 1;
+    }
+  }
+  if(!results->total.games)
+  {
+    fprintf(stderr, "MAPS: there are no maps to play\n");
+    return 1;
+  }
+  print_summary(results);
+  return 0;
 }
 
-/* prints help for a user */
-void print_help()
+/* adds the game that was just played to a summary */
+void summary_add(summary *to)
 {
-  printf("Usable commands:\n");
-  printf(" n,s,e,w    Move in direction given (also VI keybindings)\n");
-  printf(" N,S,E,W    Shoot in direction given\n");
-  printf(" g          Grab gold\n");
-  printf(" q          Quit\n");
+  bench_class *c = &to->classes[game.map_class];
+  int i, score = game.score + SUMMARY_SCORES / 2;
+  
+  to->total.games++;
+  to->total.wins += has_won() ? 1 : 0;
+  to->total.score += game.score;
+  to->total.steps += game.steps_taken;
+  to->total.decisions += game.decisions;
+  to->total.decision_ns += game.decision_ns;
+  c->games++;
+  c->wins += has_won() ? 1 : 0;
+  c->score += game.score;
+  c->oracle += game.oracle;
+  to->scores[score < 0 ? 0 : score < SUMMARY_SCORES ? score :
+    SUMMARY_SCORES - 1]++;
+  to->steps[game.steps_taken < SUMMARY_STEPS ? game.steps_taken :
+    SUMMARY_STEPS - 1]++;
+  for(i = 0; i < PHASES; i++)
+    hist_merge(&to->latency[i], &game.latency[i]);
 }
 
-/* display the current environment */
-void print_map()
+/* adds everything in one summary into another */
+void summary_merge(summary *into, summary *from)
+{
+  int i;
+  
+  into->total.games += from->total.games;
+  into->total.wins += from->total.wins;
+  into->total.score += from->total.score;
+  into->total.steps += from->total.steps;
+  into->total.decisions += from->total.decisions;
+  into->total.decision_ns += from->total.decision_ns;
+  into->total.ns += from->total.ns;
+  for(i = 0; i <= MAP_CLASS_IMPOSSIBLE; i++)
+  {
+    into->classes[i].games += from->classes[i].games;
+    into->classes[i].wins += from->classes[i].wins;
+    into->classes[i].score += from->classes[i].score;
+    into->classes[i].oracle += from->classes[i].oracle;
+  }
+  for(i = 0; i < SUMMARY_SCORES; i++)
+    into->scores[i] += from->scores[i];
+  for(i = 0; i < SUMMARY_STEPS; i++)
+    into->steps[i] += from->steps[i];
+  for(i = 0; i < PHASES; i++)
+    hist_merge(&into->latency[i], &from->latency[i]);
+}
+
+/* which of count values the given fraction of all of them are at or below */
+int summary_percentile(unsigned int *counts, int count, long long total,
+  double fraction)
+{
+  long long seen = 0, wanted = (long long)ceil(total * fraction);
+  int i;
+  if(wanted < 1)
+    wanted = 1;
+  for(i = 0; i < count - 1; i++)
+    if((seen += counts[i]) >= wanted)
+      break;
+  return i;
+}
+
+/*
+ * prints a summary the way --bench shows its results. with more than one
+ * process the time is what they all took put together, so games/sec is for
+ * one process.
+ */
+void print_summary(summary *results)
+{
+  static const double fractions[] = { 0, .01, .1, .5, .9, .99, 1 };
+  long long n = results->total.games;
+  bench_class *c;
+  int i;
+  
+  printf("%-8s %5s %9s %10s %8s %7s %7s %7s\n", "maps", "games", "games/s",
+    "dec (us)", "score", "win", "steps", "changed");
+  bench_report("all", &results->total);
+  printf("\n%-10s %5s %7s %8s %8s %8s\n", "class", "games", "win", "score",
+    "oracle", "regret");
+  for(i = 0; i <= MAP_CLASS_IMPOSSIBLE; i++)
+  {
+    c = &results->classes[i];
+    if(c->games)
+      printf("%-10s %5d %6.1f%% %8.1f %8.1f %8.1f\n", word_from_class(i),
+        c->games, 100.0 * c->wins / c->games, (double)c->score / c->games,
+        (double)c->oracle / c->games,
+        (double)(c->oracle - c->score) / c->games);
+  }
+  printf("\n%-7s %6s %6s %6s %6s %6s %6s %6s\n", "", "min", "p1", "p10",
+    "p50", "p90", "p99", "max");
+  printf("%-7s", "score");
+  for(i = 0; i < 7; i++)
+    printf(" %6d", summary_percentile(results->scores, SUMMARY_SCORES, n,
+      fractions[i]) - SUMMARY_SCORES / 2);
+  printf("\n%-7s", "steps");
+  for(i = 0; i < 7; i++)
+    printf(" %6d", summary_percentile(results->steps, SUMMARY_STEPS, n,
+      fractions[i]));
+  printf("\n");
+  print_latency(results->latency);
+}
+
+/*
+ * Adds up the --summary files of the shards of a run and shows what the whole
+ * run came to. Every shard has to be there exactly once for it to be all of
+ * the maps, the same one twice would count its games twice. A missing one
+ * fails the merge unless partial is set, then the rest are still shown.
+ */
+int run_merge(int count, char **paths, int partial)
 {
-  int i = 0, j = 0;
-  for(j = 0; j < MAP_SIZE; j++)
+  summary *results = calloc(1, sizeof(summary)), *shard;
+  char *seen = NULL;
+  FILE *fp;
+  int i, bad = 0, missing = 0, res;
+  
+  shard = malloc(sizeof(summary));
+  for(i = 0; i < count && !bad; i++)
   {
-    for(i = 0; i < MAP_SIZE; i++)
+    if((fp = fopen(paths[i], "rb")) == NULL)
     {
-      if(i == game.x && j == game.y)
-        printf("%c", MAP_PLAYER);
-      else
-        printf("%c", game.map[i][j]);
+      perror(paths[i]);
+      bad = 1;
+      break;
     }
-    printf("\n");
+    if(fread(shard, sizeof(summary), 1, fp) != 1 ||
+       shard->magic != SUMMARY_MAGIC || shard->size != sizeof(summary) ||
+       shard->shard < 0 || shard->shard >= shard->shards)
+    {
+      fprintf(stderr, "MERGE: %s is not a summary from --summary\n",
+        paths[i]);
+      bad = 1;
+    }
+    else if(seen && (shard->shards != results->shards ||
+            shard->maps != results->maps || shard->seed != results->seed))
+    {
+      fprintf(stderr, "MERGE: %s is from another run\n", paths[i]);
+      bad = 1;
+    }
+    else if(seen && seen[shard->shard])
+    {
+      fprintf(stderr, "MERGE: %s is shard %d again\n", paths[i],
+        shard->shard);
+      bad = 1;
+    }
+    else
+    {
+      if(!seen)
+      {
+        seen = calloc(shard->shards, 1);
+        results->shards = shard->shards;
+        results->maps = shard->maps;
+        results->seed = shard->seed;
+      }
+      seen[shard->shard] = 1;
+      summary_merge(results, shard);
+    }
+    fclose(fp);
   }
-  printf("\n");
+  for(i = 0; !bad && i < results->shards; i++)
+    if(!seen[i])
+    {
+      fprintf(stderr, "MERGE: shard %d of %d is missing\n", i,
+        results->shards);
+      missing++;
+    }
+  if(!bad && results->total.games && (!missing || partial))
+  {
+    if(missing)
+      printf("Partial: %d of the %d shards\n\n", results->shards - missing,
+        results->shards);
+    print_summary(results);
+  }
+  res = bad || !results->total.games || (missing && !partial);
+  free(seen);
+  free(shard);
+  free(results);
+  return res;
 }
 
-/* prints out what percepts the player feels */
-void print_percepts()
+/* n choose k, as a double since it only goes into chances */
+double choose(int n, int k)
 {
-  char *nopercept = "None";
-  printf("Percepts: [");
-  printf("%s,", (game.percepts & PERCEPT_BUMP ? "Bump" : nopercept));
-  printf("%s,", (game.percepts & PERCEPT_SMELL ? "Smell" : nopercept));
-  printf("%s,", (game.percepts & PERCEPT_BREEZE ? "Breeze" : nopercept));
-  printf("%s,", (game.percepts & PERCEPT_MOO ? "Moo" : nopercept));
-  printf("%s,", (game.percepts & PERCEPT_GLITTER ? "Glitter" : nopercept));
-  printf("%s", (game.percepts & PERCEPT_DEAD ? "Dead" : nopercept));
-  printf("]\n");
+  double c = 1;
+  int i;
+  for(i = 1; i <= k; i++)
+    c = c * (n - k + i) / i;
+  return c;
+}
+
+/*
+ * Puts everything that is left to place onto the squares of
+ * enumeration.inside from square on, every way it can go, and plays each
+ * map that makes. The wumpus, gold and supmuw are the last three of things.
+ */
+void enumerate_square(enumerator *e, int square, int pits, int walls,
+  int things)
+{
+  static const char others[3] = { MAP_WUMPUS, MAP_GOLD, MAP_SUPMUW };
+  int left = enumeration.squares - square, i;
+  
+  if(square == enumeration.squares)
+  {
+    enumerate_map(e);
+    return;
+  }
+  if(left > pits + walls + __builtin_popcount(things))
+  {
+    e->kinds[square] = MAP_EMPTY;
+    enumerate_square(e, square + 1, pits, walls, things);
+  }
+  if(pits)
+  {
+    e->kinds[square] = MAP_PIT;
+    enumerate_square(e, square + 1, pits - 1, walls, things);
+  }
+  if(walls)
+  {
+    e->kinds[square] = MAP_WALL;
+    enumerate_square(e, square + 1, pits, walls - 1, things);
+  }
+  for(i = 0; i < 3; i++)
+    if(things & (1 << i))
+    {
+      e->kinds[square] = others[i];
+      enumerate_square(e, square + 1, pits, walls, things & ~(1 << i));
+    }
+}
+
+/*
+ * Plays the map in e->kinds, unless it is the mirror image of one that comes
+ * before it or another thread's turn. A map that is its own mirror image
+ * counts once, any other counts for its mirror image too, unless the mirror
+ * images are getting played as well.
+ */
+void enumerate_map(enumerator *e)
+{
+  map_record *r = e->record;
+  int i, j, mirror, n = game.size, mirrored = 0;
+  coordinate *c;
+  double chance;
+  
+  /* squares go by x then y, the mirror image of x, y is y, x */
+  for(i = 0; i < enumeration.squares && !mirrored; i++)
+  {
+    c = &enumeration.inside[i];
+    mirror = (c->y - 1) * (n - 2) + c->x - 2;
+    if(e->kinds[i] != e->kinds[mirror])
+      mirrored = e->kinds[i] < e->kinds[mirror] ? 2 : -1;
+  }
+  if(enumeration.mirrors)
+    mirrored = 0;
+  if(mirrored < 0 || e->distinct++ % enumeration.jobs != e->thread)
+    return;
+  chance = e->chance * (mirrored ? 2 : 1);
+  
+  memset(r->cells, 0, (n * n + 3) / 4);
+  for(i = 0; i < n * n; i++)
+    if(i / n == 0 || i / n == n - 1 || i % n == 0 || i % n == n - 1)
+      r->cells[i >> 2] |= MAP_CELL_WALL << ((i & 3) * 2);
+  for(i = 0; i < enumeration.squares; i++)
+  {
+    c = &enumeration.inside[i];
+    j = c->x * n + c->y;
+    if(e->kinds[i] == MAP_PIT)
+      r->cells[j >> 2] |= MAP_CELL_PIT << ((j & 3) * 2);
+    else if(e->kinds[i] == MAP_WALL)
+      r->cells[j >> 2] |= MAP_CELL_WALL << ((j & 3) * 2);
+    else if(e->kinds[i] == MAP_WUMPUS)
+    {
+      r->wumpus_x = c->x;
+      r->wumpus_y = c->y;
+    }
+    else if(e->kinds[i] == MAP_GOLD)
+    {
+      r->gold_x = c->x;
+      r->gold_y = c->y;
+    }
+    else if(e->kinds[i] == MAP_SUPMUW)
+    {
+      r->supmuw_x = c->x;
+      r->supmuw_y = c->y;
+    }
+  }
+  r->supmuw_neighbors_wumpus =
+    abs(r->supmuw_x - r->wumpus_x) + abs(r->supmuw_y - r->wumpus_y) == 1;
+  
+  game.preset = r;
+  init_game();
+  game.map_class = classify_map();
+  game.oracle = oracle_score();
+  play_game();
+  e->played++;
+  e->total += chance;
+  e->score += chance * game.score;
+  e->class_chance[game.map_class] += chance;
+  if(has_won())
+  {
+    e->won += chance;
+    e->class_won[game.map_class] += chance;
+  }
+  else if(player_dead())
+    e->died += chance;
+  else if(has_lost())
+    e->lost += chance;
+  end_game();
 }
 
-/* prints out the player's score */
-void print_score()
+/* one of the --jobs threads, they all walk every map and play their share */
+static void *enumerate_thread(void *unused)
 {
-  printf("Score: %5d\tSteps Taken: %3d/%d\n", game.score, game.steps_taken,
-    MAP_MAXSTEPS);
+  enumerator e;
+  int pits, walls, m, i, n = enumeration.squares;
+  
+  memset(&e, 0, sizeof(e));
+  game = enumeration.settings;
+  pthread_mutex_lock(&enumeration.lock);
+  e.thread = enumeration.next_thread++;
+  pthread_mutex_unlock(&enumeration.lock);
+  e.kinds = malloc(n);
+  e.record = calloc(1, sizeof(map_record) + (game.size * game.size + 3) / 4);
+  e.record->seed = e.record->rng = game.seed;
+  
+  /*
+   * init_game() picks how many pits and walls there are first, then where
+   * each of them goes, then the wumpus, gold and supmuw, all evenly
+   */
+  for(pits = 1; pits <= enumeration.pit_max; pits++)
+    for(walls = 1; walls <= enumeration.wall_max; walls++)
+    {
+      if((m = n - pits - walls) < 3)
+        continue;
+      e.chance = 1 / (enumeration.pit_max * choose(n, pits) *
+        enumeration.wall_max * choose(n - pits, walls) *
+        m * (m - 1.0) * (m - 2.0));
+      enumerate_square(&e, 0, pits, walls, 7);
+    }
+  
+  pthread_mutex_lock(&enumeration.lock);
+  enumeration.played += e.played;
+  enumeration.chance += e.total;
+  enumeration.won += e.won;
+  enumeration.died += e.died;
+  enumeration.lost += e.lost;
+  enumeration.score += e.score;
+  for(i = 0; i <= MAP_CLASS_IMPOSSIBLE; i++)
+  {
+    enumeration.class_chance[i] += e.class_chance[i];
+    enumeration.class_won[i] += e.class_won[i];
+  }
+  pthread_mutex_unlock(&enumeration.lock);
+  free(e.kinds);
+  free(e.record);
+  return NULL;
 }
 
-/* helper to tell if the player is dead */
-int player_dead()
+/*
+ * Has the agent play every map init_game() can make at the current size, jobs
+ * games at a time, and shows exactly how likely it is to win, die or lose
+ * otherwise. The chances are out of the maps the generator can finish, it
+ * never does if the pits and walls leave no room for the rest. Only good for
+ * small maps, there are 47040 at --size 5 but 377 million at --size 6.
+ */
+int run_enumerate(int jobs, int mirrors)
 {
-  return (game.percepts & PERCEPT_DEAD);
+  int x, y, i, m, n, pits, walls;
+  double total;
+  
+  n = enumeration.squares = (game.size - 2) * (game.size - 2) - 1;
+  enumeration.pit_max = (int)(game.size * game.size * game.pit_ratio);
+  enumeration.wall_max = (int)(game.size * game.size * game.wall_ratio);
+  enumeration.inside = malloc(sizeof(coordinate) * (n + 1));
+  for(i = 0, x = 1; x < game.size - 1; x++)
+    for(y = 1; y < game.size - 1; y++)
+      if(x != 1 || y != 1)
+      {
+        enumeration.inside[i].x = x;
+        enumeration.inside[i++].y = y;
+      }
+  for(pits = 1; pits <= enumeration.pit_max; pits++)
+    for(walls = 1; walls <= enumeration.wall_max; walls++)
+      if((m = n - pits - walls) >= 3)
+        enumeration.maps += (long long)(choose(n, pits) *
+          choose(n - pits, walls) * m * (m - 1.0) * (m - 2.0));
+  if(!enumeration.maps)
+  {
+    fprintf(stderr, "ENUMERATE: there is no room for anything on the map\n");
+    return 1;
+  }
+  printf("Playing every one of the %lld maps %dx%d...\n", enumeration.maps,
+    game.size, game.size);
+  fflush(stdout);
+  
+  game.use_agent = 1;
+  game.quiet = 1;
+  enumeration.settings = game;
+  enumeration.jobs = jobs;
+  enumeration.mirrors = mirrors;
+  pthread_mutex_init(&enumeration.lock, NULL);
+  run_threads(jobs, enumerate_thread);
+  free(enumeration.inside);
+  
+  total = enumeration.chance;
+  if(enumeration.played < enumeration.maps)
+    printf("Played %lld of them, the rest are mirror images and may play out "
+      "a little\ndifferently, --enumerate-all plays them too\n",
+      enumeration.played);
+  printf("The agent's random choices are the ones --seed %u makes\n",
+    enumeration.settings.seed);
+  printf("\n");
+  printf("Won:     %8.4f%%\n", 100 * enumeration.won / total);
+  printf("Died:    %8.4f%%\n", 100 * enumeration.died / total);
+  printf("Lost:    %8.4f%% (out of steps or points)\n",
+    100 * enumeration.lost / total);
+  printf("Quit:    %8.4f%%\n", 100 * (total - enumeration.won -
+    enumeration.died - enumeration.lost) / total);
+  printf("Score:   %8.2f expected\n", enumeration.score / total);
+  printf("\n%-10s %9s %9s\n", "class", "chance", "win");
+  for(i = 0; i <= MAP_CLASS_IMPOSSIBLE; i++)
+    if(enumeration.class_chance[i] > 0)
+      printf("%-10s %8.4f%% %8.4f%%\n", word_from_class(i),
+        100 * enumeration.class_chance[i] / total,
+        100 * enumeration.class_won[i] / enumeration.class_chance[i]);
+  return 0;
 }
 
-/* you have won when you have the gold and are at the start square */
-int has_won()
+/* where name is in a list of names, or -1 */
+int find_name(const char **names, int count, const char *name)
 {
-  return (game.x == 1 && game.y == 1 && game.has_gold);
+  int i;
+  for(i = 0; i < count; i++)
+    if(strcmp(names[i], name) == 0)
+      return i;
+  return -1;
 }
 
-/*
- * you lose when your score is less than SCORE_MIN or have taken more than
- * MAP_MAXSTEPS or you have died.
- */
-int has_lost()
+/* prints a set of habits the way they are given on the command line */
+void print_tuning(tuning *t)
 {
-  return (game.score < SCORE_MIN || game.steps_taken > MAP_MAXSTEPS ||
-    player_dead());
+  printf("--shoot %s --pick %s", shoot_names[t->shoot], pick_names[t->pick]);
+  if(t->repick)
+    printf(" --repick");
+  if(t->give_up)
+    printf(" --give-up %d", t->give_up);
 }
 
-/*
- * figures out which direction the user wants to go and updates
- * pointers to the new coordinates. returns a string for printing which
- * direction was processed.
- */
-char *delta_coordinates(int *x, int *y, int direction)
+/* a tuning thread, plays games off the job list until there are none left */
+static void *tune_thread(void *unused)
 {
-  /* add the direction onto the coordinate */
-  switch(direction)
+  int i, score;
+  
+  game = tuner.settings;
+  pthread_mutex_lock(&tuner.lock);
+  while(tuner.next < tuner.jobs)
   {
-    case DIRECTION_NORTH:
-      (*y)--;
-      return "North";
-      break;
-    case DIRECTION_SOUTH:
-      (*y)++;
-      return "South";
-      break;
-    case DIRECTION_EAST:
-      (*x)++;
-      return "East";
-      break;
-    case DIRECTION_WEST:
-      (*x)--;
-      return "West";
-      break;
+    i = tuner.next++;
+    pthread_mutex_unlock(&tuner.lock);
+    
+    game.tune = tuner.configs[tuner.job_config[i]];
+    game.seed = tuner.settings.seed + tuner.job_seed[i];
+    init_game();
+    play_game();
+    score = game.score;
+    end_game();
+    
+    pthread_mutex_lock(&tuner.lock);
+    tuner.sums[tuner.job_config[i]] += score;
   }
-  return "Unknown";
+  pthread_mutex_unlock(&tuner.lock);
+  return NULL;
 }
 
-/* adds score into the game */
-void add_score(int delta)
+/* best total score first, everyone compared has played the same games */
+static int tune_compare(const void *a, const void *b)
 {
-  game.score += delta;
+  int i = *(const int *)a, j = *(const int *)b;
+  if(tuner.sums[i] != tuner.sums[j])
+    return tuner.sums[i] > tuner.sums[j] ? -1 : 1;
+  return i - j;
 }
 
-/* moves the player around. also requires a direction. */
-void action_move(int direction)
+/*
+ * Looks for the habits that score best with successive halving. Every
+ * candidate in the grid plays the first `first' seeds, then only the best
+ * third go on and play three times as many, and so on until the last few have
+ * been told apart. Bad candidates drop out after a handful of games, so it
+ * costs a fraction of playing every candidate the whole way. All candidates
+ * in a round play the same seeds, starting at --seed.
+ */
+int run_tune(int first, int jobs)
 {
-  int x2 = game.x, y2 = game.y;
-  add_score(SCORE_MOVE);
-  game.steps_taken++;
-  printf("Moving %s ", delta_coordinates(&x2, &y2, direction));
-  printf("(%d, %d)\n", x2, y2);
+  static const int give_ups[] = { 0, 100, 150, 200, 250, 300, 350, 400, 450 };
+  int g = sizeof(give_ups) / sizeof(give_ups[0]), count = 3 * 2 * 2 * g;
+  int i, j, n = 0, alive = count, target = first, round = 0, *order;
+  long long games = 0, sweep;
+  tuning *t;
   
-  /* this function will process bumps */
-  if(game.map[x2][y2] == MAP_WALL)
+  tuner.configs = malloc(sizeof(tuning) * count);
+  for(i = 0; i < count; i++)
   {
-    game.percepts |= PERCEPT_BUMP;
-    printf("You bumped into a wall!\n");
-    /* just go ahead and back out if you bump into something */
-    if(game.use_agent)
-    {
-      /* must tell the kb about this... */
-      kb_insert(PERCEPT_BUMP, x2, y2);
-    }
-    return;
+    t = &tuner.configs[i];
+    t->give_up = give_ups[i % g];
+    t->repick = (i / g) % 2;
+    t->pick = (i / (2 * g)) % 2;
+    t->shoot = i / (4 * g);
   }
+  tuner.sums = calloc(count, sizeof(long long));
+  tuner.played = calloc(count, sizeof(int));
+  order = malloc(sizeof(int) * count);
+  for(i = 0; i < count; i++)
+    order[i] = i;
+  tuner.settings = game;
+  tuner.settings.use_agent = 1;
+  tuner.settings.quiet = 1;
+  pthread_mutex_init(&tuner.lock, NULL);
   
-  /* see if you are in the same square as a supmuw */
-  if(game.map[x2][y2] == MAP_SUPMUW &&
-     !game.has_food && !game.supmuw_neighbors_wumpus)
+  printf("Tuning %d candidates on %d threads, seeds from %u\n", count, jobs,
+    game.seed);
+  printf("%-5s %10s %6s %9s  %s\n", "round", "candidates", "games", "score",
+    "best");
+  while(1)
   {
-    game.has_food = 1;
-    printf("The supmuw has gifted food to you!\n");
-    add_score(SCORE_FOOD);
+    /* line up the games the survivors have not played yet */
+    tuner.job_config = malloc(sizeof(int) * alive * (target - n));
+    tuner.job_seed = malloc(sizeof(int) * alive * (target - n));
+    tuner.jobs = tuner.next = 0;
+    for(i = 0; i < alive; i++)
+      for(j = tuner.played[order[i]]; j < target; j++)
+      {
+        tuner.job_config[tuner.jobs] = order[i];
+        tuner.job_seed[tuner.jobs++] = j;
+      }
+    run_threads(jobs, tune_thread);
+    games += tuner.jobs;
+    free(tuner.job_config);
+    free(tuner.job_seed);
+    for(i = 0; i < alive; i++)
+      tuner.played[order[i]] = target;
+    n = target;
+    
+    qsort(order, alive, sizeof(int), tune_compare);
+    printf("%-5d %10d %6d %9.1f  ", round++, alive, target,
+      (double)tuner.sums[order[0]] / target);
+    print_tuning(&tuner.configs[order[0]]);
+    printf("\n");
+    
+    if(alive / TUNE_KEEP < 2)
+      break;
+    alive /= TUNE_KEEP;
+    target *= TUNE_KEEP;
   }
   
-  /* now go ahead and move the player */
-  game.x = x2; game.y = y2;
+  sweep = (long long)count * target;
+  printf("\nBest:    ");
+  print_tuning(&tuner.configs[order[0]]);
+  printf(", %.1f a game over %d games\n",
+    (double)tuner.sums[order[0]] / tuner.played[order[0]],
+    tuner.played[order[0]]);
+  printf("Default: %.1f a game over the %d games it played\n",
+    (double)tuner.sums[0] / tuner.played[0], tuner.played[0]);
+  printf("Played %lld games, %.1f%% of the %lld a full sweep would take\n",
+    games, 100. * games / sweep, sweep);
+  
+  pthread_mutex_destroy(&tuner.lock);
+  free(tuner.configs);
+  free(tuner.sums);
+  free(tuner.played);
+  free(order);
+  return 0;
 }
 
-/* shoots arrows. requires a direction */
-void action_shoot(int direction)
+/* how badly the game that was just played went, bigger is worse */
+double hunt_cost()
 {
-  int x2 = game.x, y2 = game.y;
-
-  if(!game.arrows)
+  switch(hunter.cost)
   {
-    printf("You are out of arrows!\n");
-    return;
+    case HUNT_LATENCY:
+      return game.latency[PHASE_DECIDE].max / 1e3;
+    case HUNT_KB:
+      return game.decisions ? (double)game.kb_lookups / game.decisions : 0;
+    case HUNT_LOSS:
+      return (game.oracle >= 0 ? game.oracle : 0) - game.score;
   }
+  return game.steps_taken;
+}
+
+/* a hunting thread, plays maps of the population until there are none left */
+static void *hunt_thread(void *unused)
+{
+  hunt_candidate *c;
+  double cost;
   
-  printf("Shooting %s\n", delta_coordinates(&x2, &y2, direction));
-  add_score(SCORE_SHOOT);
-  game.arrows--;
-  if(game.map[x2][y2] == MAP_WUMPUS || game.map[x2][y2] == MAP_SUPMUW)
+  game = hunter.settings;
+  pthread_mutex_lock(&hunter.lock);
+  while(hunter.next < HUNT_POPULATION)
   {
-    add_score(SCORE_KILL);
-    printf("You hear a deafening scream as you slay the beast.\n");
-    game.map[x2][y2] = MAP_EMPTY;
-    /* regardless of who you kill, the supmuw does not neighbor wumpus */
-    game.supmuw_neighbors_wumpus = 0;
-
-    /* tell the agent that the thing was killed */    
-    if(game.use_agent)
-    {
-      /* only one of these will be removed */
-      kb_delete(PERCEPT_WUMPUS, x2, y2);
-      kb_delete(PERCEPT_SUPMUW, x2, y2);
-      /* remove the smells, too */
-      kb_delete(PERCEPT_SMELL, x2 - 1, y2);
-      kb_delete(PERCEPT_SMELL, x2 + 1, y2);
-      kb_delete(PERCEPT_SMELL, x2, y2 - 1);
-      kb_delete(PERCEPT_SMELL, x2, y2 + 1);
-    }
+    c = &hunter.candidates[hunter.next++];
+    pthread_mutex_unlock(&hunter.lock);
+    
+    game.preset = c->map;
+    init_game();
+    play_game();
+    cost = hunt_cost();
+    end_game();
+    
+    pthread_mutex_lock(&hunter.lock);
+    if(!c->played++ || cost < c->cost)
+      c->cost = cost;
   }
+  pthread_mutex_unlock(&hunter.lock);
+  return NULL;
 }
 
-/* grabs gold if possible */
-void action_grab()
+/* the worst map first */
+static int hunt_compare(const void *a, const void *b)
 {
-  if(game.map[game.x][game.y] == MAP_GOLD)
-  {
-    add_score(SCORE_GOLD);
-    printf("You have found gold!\n");
-    game.map[game.x][game.y] = MAP_EMPTY;
-    game.has_gold = 1;
-    if(game.use_agent)
-      kb_delete(PERCEPT_GLITTER, game.x, game.y);
-  }
+  const hunt_candidate *i = a, *j = b;
+  if(i->cost != j->cost)
+    return i->cost > j->cost ? -1 : 1;
+  return 0;
 }
 
-/* quits the game and returns to the OS */
-void action_quit()
+/*
+ * picks one of the squares inside the map holding what, other than the start,
+ * at random. returns 0 if there are none.
+ */
+int hunt_find(char what, int *x, int *y)
 {
-  printf("\nFinal Analysis of gameplay\n");
-  /* show the final map */
-  print_map();
-  /* show the final set of percepts */
-  print_percepts();
-  
-  /* one last chance to make fun of the player */
-  if(has_lost())
-    printf("Apparently you are not a winner. That would make you a loser.\n");
-  if(player_dead())
-    printf("You have died. Indiana Jones would be ashamed.\n");
-  if(has_won())
-    printf("You have won, the plantation is saved. Glory! Glory!\n");
+  int i, j, count = 0, pick;
   
-  /* final score */
-  print_score();
+  for(j = 1; j < game.size - 1; j++)
+    for(i = 1; i < game.size - 1; i++)
+      count += map_at(i, j) == what && (i != 1 || j != 1);
+  if(!count)
+    return 0;
+  pick = rand_r(&hunter.rng) % count;
+  for(j = 1; j < game.size - 1; j++)
+    for(i = 1; i < game.size - 1; i++)
+      if(map_at(i, j) == what && (i != 1 || j != 1) && pick-- == 0)
+      {
+        *x = i;
+        *y = j;
+        return 1;
+      }
+  return 0;
+}
+
+/*
+ * moves one to three things on the map to empty squares and works out again
+ * what depends on where they are. the record keeps its seed and rng, so the
+ * agent makes the same random choices it would have on the original.
+ */
+void hunt_mutate(map_record *record)
+{
+  static const char things[5] = {
+    MAP_PIT, MAP_WALL, MAP_GOLD, MAP_WUMPUS, MAP_SUPMUW
+  };
+  int n, x, y, x2, y2;
+  char what;
   
-  /* cleanup for agent */
-  if(game.use_agent)
+  game = hunter.settings;
+  game.use_agent = 0;
+  game.preset = record;
+  init_game();
+  for(n = 1 + rand_r(&hunter.rng) % 3; n > 0; n--)
   {
-    /* dumps the contents of the knowledge base to stderr */
-    kb_dump();
-    kb_close();
+    what = things[rand_r(&hunter.rng) % 5];
+    if(!hunt_find(what, &x, &y) || !hunt_find(MAP_EMPTY, &x2, &y2))
+      continue;
+    map_put(x, y, MAP_EMPTY);
+    map_put(x2, y2, what);
   }
-  exit(0);
+  
+  game.supmuw_neighbors_wumpus = hunt_find(MAP_SUPMUW, &x, &y) &&
+    (map_at(x, y + 1) == MAP_WUMPUS || map_at(x, y - 1) == MAP_WUMPUS ||
+     map_at(x + 1, y) == MAP_WUMPUS || map_at(x - 1, y) == MAP_WUMPUS);
+  game.map_class = classify_map();
+  game.oracle = game.size <= ORACLE_MAXSIZE ? oracle_score() : -1;
+  game.rng = record->rng;
+  map_to_record(record);
+  end_game();
 }
 
-/* initialize the knowledge base. builds an sqlite3 RAM db and build tables */
-void kb_init()
+/*
+ * Searches for the maps the agent does worst on by hunter.cost. The first
+ * population is the maps --make-maps would make from --seed on, and every
+ * round after that keeps the worst 1 in TUNE_KEEP and makes the rest over from
+ * them with hunt_mutate(). The ones left at the end are written to path as a
+ * map file for --maps. Returns 1 if it couldn't write them.
+ */
+int run_hunt(int rounds, const char *path, int jobs)
 {
-  char *err_msg;
-  int res = 0;
+  int i, round, keep = HUNT_POPULATION / TUNE_KEEP, failed;
+  hunt_candidate *c = hunter.candidates;
+  maps_header h;
+  FILE *fp;
   
-  /* make db */
-  res = sqlite3_open(":memory:", &game.db);
-  if(res)
+  memset(&h, 0, sizeof(h));
+  h.magic = MAPS_MAGIC;
+  h.size = game.size;
+  h.kind = game.kind;
+  h.pit_ratio = game.pit_ratio;
+  h.wall_ratio = game.wall_ratio;
+  h.count = keep;
+  h.record_size = (sizeof(map_record) + (game.size * game.size + 3) / 4 + 7) &
+    ~7;
+  game.quiet = 1;
+  hunter.settings = game;
+  hunter.settings.use_agent = 1;
+  hunter.rng = game.seed;
+  pthread_mutex_init(&hunter.lock, NULL);
+  
+  game.use_agent = 0;
+  for(i = 0; i < HUNT_POPULATION; i++)
   {
-    fprintf(stderr, "KB_INIT: %s\n",
-      sqlite3_errmsg(game.db));
-    sqlite3_close(game.db);
-    exit(1);
+    c[i].map = calloc(1, h.record_size);
+    c[i].played = 0;
+    init_game();
+    map_to_record(c[i].map);
+    end_game();
+    game.seed++;
   }
   
-  /* create the knowledge base table */
-  res = sqlite3_exec(game.db,
-    /* no primary key, you get locking errors if you do... */
-    "CREATE TABLE kb (sentence INT, x INT, y INT);",
-    NULL, 0, &err_msg);
-  if(res != SQLITE_OK)
+  printf("Hunting the worst %dx%d maps by %s on %d threads, seeds from %u\n",
+    h.size, h.size, cost_names[hunter.cost], jobs, hunter.settings.seed);
+  printf("%-5s %10s %10s %10s\n", "round", "worst", "kept", "median");
+  for(round = 0; round < rounds; round++)
   {
-    fprintf(stderr, "KB_INIT: %s\n", err_msg);
-    sqlite3_free(err_msg);
-    exit(1);
+    hunter.next = 0;
+    run_threads(jobs, hunt_thread);
+    qsort(c, HUNT_POPULATION, sizeof(hunt_candidate), hunt_compare);
+    printf("%-5d %10.1f %10.1f %10.1f\n", round, c[0].cost, c[keep - 1].cost,
+      c[HUNT_POPULATION / 2].cost);
+    if(round == rounds - 1)
+      break;
+    for(i = keep; i < HUNT_POPULATION; i++)
+    {
+      memcpy(c[i].map, c[i % keep].map, h.record_size);
+      c[i].played = 0;
+      hunt_mutate(c[i].map);
+    }
   }
   
-  /* create the queue table */
-  res = sqlite3_exec(game.db,
-    "CREATE TABLE queue (id INTEGER PRIMARY KEY, name VARCHAR, x INT, y INT);",
-    NULL, 0, &err_msg);
-  if(res != SQLITE_OK)
+  failed = 0;
+  if((fp = fopen(path, "wb")) != NULL)
   {
-    fprintf(stderr, "KB_INIT: %s\n", err_msg);
-    sqlite3_free(err_msg);
-    exit(1);
+    fwrite(&h, sizeof(h), 1, fp);
+    printf("\n%-4s %10s %-10s %6s %10s\n", "map", "seed", "class", "oracle",
+      cost_names[hunter.cost]);
+    for(i = 0; i < keep; i++)
+    {
+      fwrite(c[i].map, h.record_size, 1, fp);
+      printf("%-4d %10u %-10s %6d %10.1f\n", i, c[i].map->seed,
+        word_from_class(c[i].map->map_class), c[i].map->oracle, c[i].cost);
+    }
+    failed = ferror(fp);
+    failed = fclose(fp) || failed;
   }
+  if(fp == NULL || failed)
+    perror(path);
+  else
+    printf("Wrote the %d worst to %s, play them again with --maps %s\n", keep,
+      path, path);
+  
+  pthread_mutex_destroy(&hunter.lock);
+  for(i = 0; i < HUNT_POPULATION; i++)
+    free(c[i].map);
+  return fp == NULL || failed;
 }
 
-/* closes the database stuff */
-void kb_close()
-{
-  sqlite3_close(game.db);
-}
-
-/* private callback that just sees if a row has been found */
-static int kb_found_callback(void *found, int argc, char **argv, char **cols)
-{
-  if(argc > 0)
-    *((int *)found) = 1;
-  return 0;
-}
-
-/* finds a row in the kb */
-int kb_found(int sentence, int x, int y)
+/*
+ * takes argv[i] into g if it changes how the agent plays, and returns how
+ * many arguments that was. 0 if it isn't one of those.
+ */
+int agent_option(struct WUMPLUS *g, int argc, char **argv, int i)
 {
-  int res = 0, found = 0;
-  char query[128], *err_msg;
+  int value = i + 1 < argc, taken = 2;
   
-  sprintf(query,
-    "SELECT * FROM KB WHERE x = %d AND y = %d AND sentence = %d LIMIT 1;",
-    x, y, sentence);
-  res = sqlite3_exec(game.db, query, kb_found_callback, (void *)&found,
-    &err_msg);
-  if(res != SQLITE_OK)
+  if(value && strcmp(argv[i], "--move-budget-us") == 0)
+    g->move_budget = atoll(argv[i + 1]) * 1000;
+  else if(value && strcmp(argv[i], "--lookahead") == 0)
+    g->lookahead = atoi(argv[i + 1]);
+  else if(value && strcmp(argv[i], "--give-up") == 0)
+    g->tune.give_up = atoi(argv[i + 1]);
+  else if(value && strcmp(argv[i], "--shoot") == 0)
+    taken = (g->tune.shoot = find_name(shoot_names, 3, argv[i + 1])) >= 0 ?
+      2 : 0;
+  else if(value && strcmp(argv[i], "--pick") == 0)
+    taken = (g->tune.pick = find_name(pick_names, 2, argv[i + 1])) >= 0 ?
+      2 : 0;
+  else if(strcmp(argv[i], "--hpa") == 0)
+    g->use_hpa = taken = 1;
+  else if(strcmp(argv[i], "--repick") == 0)
+    g->tune.repick = taken = 1;
+#ifdef WUMPUS_POLICY
+  else if(strcmp(argv[i], "--policy") == 0)
   {
-    fprintf(stderr, "KB_FOUND: %s\n", err_msg);
-    sqlite3_free(err_msg);
+    g->policy = policy_table;
+    taken = 1;
   }
-  return found;
+#endif
+  else
+    taken = 0;
+  return taken;
 }
 
-/* has the square been visited? */
-int visited(int x, int y)
+/* puts the agent options in the string into g, returns 1 if one isn't */
+int ab_parse(struct WUMPLUS *g, const char *options)
 {
-  return kb_found(PERCEPT_VISITED, x, y);
+  char *copy = strdup(options), *argv[64];
+  int argc = 0, i, taken, res = 0;
+  
+  argv[0] = strtok(copy, " \t");
+  while(argv[argc] && argc < 63)
+    argv[++argc] = strtok(NULL, " \t");
+  for(i = 0; i < argc && !res; i += taken)
+    if((taken = agent_option(g, argc, argv, i)) == 0)
+    {
+      fprintf(stderr, "AB: %s is not an option of the agent\n", argv[i]);
+      res = 1;
+    }
+  free(copy);
+  return res;
 }
 
-/* is the square safe? */
-int safe(int x, int y)
+/* plays the i'th map of the run set up as settings, and notes how it went */
+void ab_play(struct WUMPLUS *settings, int i, double *got)
 {
-  return kb_found(PERCEPT_SAFE, x, y);
+  game = *settings;
+  if(map_file.header)
+    game.preset = map_file_record(i);
+  else
+    game.seed = settings->seed + i;
+  init_game();
+  play_game();
+  got[AB_SCORE] = game.score;
+  got[AB_WON] = 100 * has_won();
+  got[AB_STEPS] = game.steps_taken;
+  got[AB_DECISION] = game.decisions ?
+    game.decision_ns / 1e3 / game.decisions : 0;
+  end_game();
 }
 
-/* is it a wall? */
-int wall(int x, int y)
+/* an A/B thread, plays both sides of the maps in the batch */
+static void *ab_thread(void *unused)
 {
-  return kb_found(PERCEPT_BUMP, x, y);
+  ab_pair *p;
+  
+  pthread_mutex_lock(&comparison.lock);
+  while(comparison.next < comparison.last)
+  {
+    p = &comparison.pairs[comparison.next++];
+    pthread_mutex_unlock(&comparison.lock);
+    
+    ab_play(&comparison.a, p - comparison.pairs, p->a);
+    ab_play(&comparison.b, p - comparison.pairs, p->b);
+    
+    pthread_mutex_lock(&comparison.lock);
+  }
+  pthread_mutex_unlock(&comparison.lock);
+  return NULL;
 }
 
-/* does it glitter? */
-int glitter(int x, int y)
+/*
+ * Wald's sequential test on the score differences of the first n pairs, with
+ * their mean and sum of squared deviations. B better by delta and B worse by
+ * delta are each tested against no difference, with the spread of the
+ * differences standing in for the real one.
+ */
+int ab_verdict(int n, double mean, double m2, double delta)
 {
-  return kb_found(PERCEPT_GLITTER, x, y);
+  double bound = log((1 - AB_ERROR) / AB_ERROR), var, better, worse;
+  
+  if(n < AB_MIN)
+    return AB_UNDECIDED;
+  var = m2 / (n - 1);
+  /* every pair came out the same way */
+  if(var == 0)
+    return mean > 0 ? AB_BETTER : mean < 0 ? AB_WORSE : AB_SAME;
+  better = delta / var * n * (mean - delta / 2);
+  worse = delta / var * n * (-mean - delta / 2);
+  if(better >= bound)
+    return AB_BETTER;
+  if(worse >= bound)
+    return AB_WORSE;
+  if(better <= -bound && worse <= -bound)
+    return AB_SAME;
+  return AB_UNDECIDED;
 }
 
-/* does it smell? */
-int smell(int x, int y)
+/*
+ * Compares the agent set up as it is with the same agent and options on top,
+ * on at most `most' maps. The maps are played a batch at a time, but the test
+ * is done after every pair in order so where it stops doesn't depend on how
+ * many threads there are. The differences are B's results less A's.
+ */
+int run_ab(int most, const char *versus, double delta, int jobs)
 {
-  return kb_found(PERCEPT_SMELL, x, y);
+  double sum[AB_METRICS][2], mean[AB_METRICS], m2[AB_METRICS], d, step, ci;
+  int j, n = 0, verdict = AB_UNDECIDED;
+  ab_pair *p;
+  
+  comparison.a = game;
+  comparison.a.use_agent = 1;
+  comparison.a.quiet = 1;
+  comparison.b = comparison.a;
+  if(ab_parse(&comparison.b, versus))
+    return 1;
+  if(comparison.b.use_hpa && game.kind == MAP_KIND_PROCEDURAL)
+  {
+    fprintf(stderr, "AB: --hpa needs the whole map, it can not be "
+      "procedural\n");
+    return 1;
+  }
+  if(map_file.header && most > map_file.header->count)
+    most = map_file.header->count;
+  comparison.pairs = calloc(most, sizeof(ab_pair));
+  comparison.next = 0;
+  pthread_mutex_init(&comparison.lock, NULL);
+  memset(sum, 0, sizeof(sum));
+  memset(mean, 0, sizeof(mean));
+  memset(m2, 0, sizeof(m2));
+  
+  if(map_file.header)
+    printf("A/B on up to %d maps of the --maps file", most);
+  else
+    printf("A/B on up to %d maps from seed %u", most, game.seed);
+  printf(" on %d threads, B has %s\n", jobs, versus);
+  printf("%-6s %9s %9s  %s\n", "pairs", "score", "+-", "verdict");
+  while(verdict == AB_UNDECIDED && n < most)
+  {
+    comparison.last = n + AB_BATCH < most ? n + AB_BATCH : most;
+    run_threads(jobs, ab_thread);
+    
+    while(n < comparison.last && verdict == AB_UNDECIDED)
+    {
+      p = &comparison.pairs[n++];
+      for(j = 0; j < AB_METRICS; j++)
+      {
+        sum[j][0] += p->a[j];
+        sum[j][1] += p->b[j];
+        d = p->b[j] - p->a[j];
+        step = d - mean[j];
+        mean[j] += step / n;
+        m2[j] += step * (d - mean[j]);
+      }
+      verdict = ab_verdict(n, mean[AB_SCORE], m2[AB_SCORE], delta);
+    }
+    printf("%-6d %9.1f %9.1f  %s\n", n, mean[AB_SCORE], n > 1 ?
+      1.96 * sqrt(m2[AB_SCORE] / (n - 1) / n) : 0, ab_verdicts[verdict]);
+  }
+  
+  printf("\n%-9s %9s %9s %9s %9s\n", "", "A", "B", "B-A", "+-");
+  for(j = 0; j < AB_METRICS; j++)
+  {
+    ci = n > 1 ? 1.96 * sqrt(m2[j] / (n - 1) / n) : 0;
+    printf("%-9s %9.1f %9.1f %9.1f %9.1f\n", ab_metric_names[j],
+      sum[j][0] / n, sum[j][1] / n, mean[j], ci);
+  }
+  printf("\nLooking for %g points a game: %s", delta, ab_verdicts[verdict]);
+  if(verdict != AB_UNDECIDED)
+    printf(", %g%% sure after %d pairs", 100 * (1 - AB_ERROR), n);
+  printf("\nPlayed %d of the %d pairs it could have, %.1f%%\n",
+    comparison.last, most, 100. * comparison.last / most);
+  
+  pthread_mutex_destroy(&comparison.lock);
+  free(comparison.pairs);
+  return 0;
 }
 
 /*
- * puts a percept or sentence into the kb. requires a percept and does not
- * insert a row if one is already found of the same kind and position.
+ * can the action be taken in the state? like the kb agent, the policy only
+ * walks onto squares known to be safe. shooting without the arrow or grabbing
+ * without glitter takes no step, so a policy could do it forever.
  */
-void kb_insert(int sentence, int x, int y)
+int policy_allowed(int state, int action)
 {
-  int res = 0;
-  char query[128], *err_msg;
-  
-  /* don't insert another row of the same kind or for a wall */
-  if(kb_found(sentence, x, y))
-    return;
+  int rest = state / 5, square;
   
-  sprintf(query, "INSERT INTO KB (sentence, x, y) VALUES (%d, %d, %d);",
-    sentence, x, y);
-  res = sqlite3_exec(game.db, query, NULL, 0, &err_msg);
-  if(res != SQLITE_OK)
+  if(action < 4)
   {
-    fprintf(stderr, "KB_INSERT: %s\n", err_msg);
-    sqlite3_free(err_msg);
+    square = (rest >> (5 + 2 * (3 - action))) & 3;
+    return square == 1 || square == 2;
   }
+  if(action < 8)
+    return rest & 1;
+  if(policy_actions[action] == 'g')
+    return (rest >> 4) & 1;
+  return 1;
 }
 
-/* removes a statement from the database */
-void kb_delete(int sentence, int x, int y)
+/*
+ * the allowed action with the highest value, the last one on a tie so asking
+ * the kb wins those. an action tried fewer than POLICY_TRIED times has seen
+ * too few games for its value to mean much, and can not be the best yet.
+ */
+int policy_best(float *q, int *tried, int state)
 {
-  int res = 0;
-  char query[128], *err_msg;
-  if(!kb_found(sentence, x, y))
-    return;
-  
-  sprintf(query, "DELETE FROM KB WHERE sentence = %d AND x = %d AND y = %d;",
-    sentence, x, y);
-  res = sqlite3_exec(game.db, query, NULL, 0, &err_msg);
-  if(res != SQLITE_OK)
+  int i, best = -1, at;
+  for(i = 0; i < POLICY_ACTIONS; i++)
   {
-    fprintf(stderr, "KB_DELETE: %s\n", err_msg);
-    sqlite3_free(err_msg);
+    at = state * POLICY_ACTIONS + i;
+    if(policy_allowed(state, i) && (policy_actions[i] == '.' ||
+       tried[at] >= POLICY_TRIED) &&
+       (best < 0 || q[at] >= q[state * POLICY_ACTIONS + best]))
+      best = i;
   }
+  return best;
 }
 
-/*
- * generalization for checking around a spot. this will insert something
- * into the KB if found. it takes what it's looking for, what to insert when
- * found and a delta for x and y from the current player position.
- *
- * This requires two pieces of information, one known to be safe and one known
- * to have the percept. If you have more information, then something is not
- * right. If you have less, not enough can be inferred.
- */
-void check_corner(int percept, int known, int xd, int yd)
+/* the total score of the agent with the table, or just the kb for NULL */
+long long policy_check(struct WUMPLUS *settings, const char *table,
+  unsigned int seed)
 {
-  if(kb_found(percept, game.x + xd, game.y + yd) &&
-     !wall(game.x + xd, game.y + yd) &&
-     safe(game.x + xd, game.y) ^ safe(game.x, game.y + yd))
+  long long total = 0;
+  int i;
+  
+  for(i = 0; i < POLICY_CHECK; i++)
   {
-    if(safe(game.x + xd, game.y))
-      kb_insert(known, game.x, game.y + yd);
-    if(safe(game.x, game.y + yd))
-      kb_insert(known, game.x + xd, game.y);
+    game = *settings;
+    game.seed = seed + i;
+    game.policy = table;
+    init_game();
+    play_game();
+    total += game.score;
+    end_game();
   }
+  return total;
 }
 
 /*
- * check for something at each corner around where the player sits. This only
- * checks the diagonals around the player position. the general form to check
- * the squares immediately accessible to the player require three pieces of
- * information and only in the rarest of cases can you not determine this
- * otherwise. A specific situation is like this:
- *
- * ..P.
- * PPP.
+ * Learns a policy with tabular Q-learning and writes it to path as C source
+ * for policy.h. Every game is played on the next seed from --seed with the
+ * real rules and kb. The reward is whatever the score did, less POLICY_ASK
+ * for asking the kb, and a point for every step closer to where the route
+ * goes (a point off for every step further). The score alone can't tell one
+ * step from another: the same state comes up all over the map, so what the
+ * game came to hundreds of steps later buries a point or two either way, and
+ * nothing was learned. For the same reason the values are the plain average
+ * of everything the action got in the state, and the future only counts for
+ * POLICY_GAMMA. Quitting is up to the kb, a few moves ahead is too short a
+ * look to know when to give up.
  *
- * The agent does not seem to notice the middle P in the bottom row, but really
- * the agent will not maneuver to that square anyways. Not a big deal, really.
- *
- * This function requires the 'maybe' percept and the percept to tell the KB
- * that you 'found' the obstackle in question.
+ * Moves are random at first and get greedier over the first half of the
+ * games. The table keeps the best action for each state, and is only written
+ * if the agent with it does at least as well as the kb alone on the
+ * POLICY_CHECK seeds after the ones it learned on. Returns 1 if it did not.
  */
-void kb_inferrances(int percept, int known)
+int run_train(int episodes, const char *path)
 {
-  if(!kb_found(percept, game.x, game.y))
-    return;
-  
-  /* check north west corner above player */
-  check_corner(percept, known, -1, -1);
-  
-  /* check north east corner above player */
-  check_corner(percept, known, 1, -1);
+  float *q = calloc(POLICY_STATES * POLICY_ACTIONS, sizeof(float)), *cell;
+  int *tried = calloc(POLICY_STATES * POLICY_ACTIONS, sizeof(int));
+  int *seen = calloc(POLICY_STATES, sizeof(int));
+  char *table = malloc(POLICY_STATES + 1);
+  struct WUMPLUS settings = game;
+  unsigned int rng = game.seed;
+  int i, state, next = 0, action, before, from, to, done, states = 0;
+  int wins = 0;
+  long long total = 0, moves = 0, taken = 0, kb_total, table_total;
+  double epsilon, target;
+  FILE *fp = NULL;
   
-  /* check south west corner below player */
-  check_corner(percept, known, -1, 1);
+  settings.use_agent = 1;
+  settings.quiet = 1;
+  settings.policy = NULL;
+  printf("%9s %8s %9s %6s\n", "games", "epsilon", "score", "win");
+  for(i = 0; i < episodes; i++)
+  {
+    epsilon = 1 - 2. * i / episodes;
+    epsilon = epsilon < .05 ? .05 : epsilon;
+    game = settings;
+    game.seed = settings.seed + i;
+    init_game();
+    process_percepts();
+    state = policy_state();
+    do
+    {
+      if(rand_r(&rng) < epsilon * RAND_MAX)
+        do
+          action = rand_r(&rng) % POLICY_ACTIONS;
+        while(!policy_allowed(state, action));
+      else
+        action = policy_best(q, tried, state);
+      before = game.score;
+      from = policy_route_at(game.x, game.y);
+      game.percepts &= ~PERCEPT_BUMP;
+      process_player_command(policy_actions[action] == '.' ?
+        kb_ask_action() : policy_actions[action]);
+      if(!game.quit)
+        process_percepts();
+      done = game.quit || has_won() || has_lost();
+      
+      target = game.score - before;
+      if(policy_actions[action] == '.')
+        target -= POLICY_ASK;
+      /* the route is still the one from before the move */
+      to = policy_route_at(game.x, game.y);
+      if(!done && from >= 0 && to >= 0)
+        target += from - to;
+      if(!done)
+      {
+        next = policy_state();
+        target += POLICY_GAMMA *
+          q[next * POLICY_ACTIONS + policy_best(q, tried, next)];
+      }
+      cell = &q[state * POLICY_ACTIONS + action];
+      *cell += (target - *cell) / ++tried[state * POLICY_ACTIONS + action];
+      seen[state]++;
+      state = next;
+    } while(!done);
+    total += game.score;
+    wins += has_won() ? 1 : 0;
+    end_game();
+    
+    if((i + 1) % (episodes < 10 ? 1 : episodes / 10) == 0)
+    {
+      printf("%9d %8.2f %9.1f %5.1f%%\n", i + 1, epsilon,
+        (double)total / (episodes < 10 ? 1 : episodes / 10),
+        100. * wins / (episodes < 10 ? 1 : episodes / 10));
+      total = wins = 0;
+    }
+  }
   
-  /* check south east corner below player */
-  check_corner(percept, known, 1, 1);
+  for(i = 0; i < POLICY_STATES; i++)
+  {
+    table[i] = policy_actions[policy_best(q, tried, i)];
+    states += table[i] != '.';
+    moves += seen[i];
+    taken += table[i] != '.' ? seen[i] : 0;
+  }
+  table[POLICY_STATES] = 0;
+  kb_total = policy_check(&settings, NULL, settings.seed + episodes);
+  table_total = policy_check(&settings, table, settings.seed + episodes);
+  printf("Check:   %.1f with the table, %.1f with just the kb\n",
+    (double)table_total / POLICY_CHECK, (double)kb_total / POLICY_CHECK);
+  if(table_total < kb_total)
+    fprintf(stderr, "TRAIN: the table did worse than the kb, %s is left "
+      "alone\n", path);
+  else if((fp = fopen(path, "w")) == NULL)
+    fprintf(stderr, "TRAIN: can not write %s\n", path);
+  else
+  {
+    fprintf(fp, "/*\n * Generated by wumplus --seed %u --train %d, do not "
+      "edit. The best\n * action for every policy_state(), '.' to ask the "
+      "kb.\n */\n", settings.seed, episodes);
+    fprintf(fp, "static const char policy_table[POLICY_STATES + 1] =");
+    for(i = 0; i < POLICY_STATES; i++)
+    {
+      if(i % 64 == 0)
+        fprintf(fp, "%s\n  \"", i ? "\"" : "");
+      fputc(table[i], fp);
+    }
+    fprintf(fp, "\";\n");
+    fclose(fp);
+    printf("Learned %d of %d states, %.1f%% of the moves in training, "
+      "written to %s\n", states, POLICY_STATES,
+      moves ? 100. * taken / moves : 0, path);
+  }
+  free(q);
+  free(tried);
+  free(seen);
+  free(table);
+  return fp == NULL;
 }
 
 /*
- * tell the knowledge base about your percepts. this is a lot like processing
- * the percepts, only now we are telling the kb about what we see using only
- * the percepts.
+ * Maps the spectator ring in path, making it if it is not there. A ring left
+ * by an earlier run keeps counting from where it was, so viewers still
+ * attached to it just see more frames.
  */
-void kb_tell()
+int spectate_open(const char *path)
 {
-  kb_insert(PERCEPT_VISITED, game.x, game.y);
-  if(!(game.percepts & PERCEPT_DEAD))
-    kb_insert(PERCEPT_SAFE, game.x, game.y);
-  if(game.percepts & PERCEPT_SMELL)
-    kb_insert(PERCEPT_SMELL, game.x, game.y);
-  if(game.percepts & PERCEPT_BREEZE)
-    kb_insert(PERCEPT_BREEZE, game.x, game.y);
-  if(game.percepts & PERCEPT_MOO)
-    kb_insert(PERCEPT_MOO, game.x, game.y);
-  if(game.percepts & PERCEPT_GLITTER)
-    kb_insert(PERCEPT_GLITTER, game.x, game.y);
-  if(!(game.percepts & PERCEPT_SMELL) &&
-     !(game.percepts & PERCEPT_BREEZE))
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  ring *r;
+  if(fd < 0 || ftruncate(fd, sizeof(ring)) != 0)
   {
-    /*
-     * this is useful to expand the number of squares we can access after each
-     * move.
-     */
-    kb_insert(PERCEPT_SAFE, game.x - 1, game.y);
-    kb_insert(PERCEPT_SAFE, game.x + 1, game.y);
-    kb_insert(PERCEPT_SAFE, game.x, game.y - 1);
-    kb_insert(PERCEPT_SAFE, game.x, game.y + 1);
+    perror("spectate_open");
+    if(fd >= 0)
+      close(fd);
+    return 1;
   }
-  
-  /*
-   * now lets make some inferrances.
-   * this process is mostly the same, so just use the same function.
-   */
-  kb_inferrances(PERCEPT_SMELL, PERCEPT_WUMPUS);
-  kb_inferrances(PERCEPT_BREEZE, PERCEPT_PIT);
-  kb_inferrances(PERCEPT_MOO, PERCEPT_SUPMUW);
-}
-
-/* removes the pre-set destination, if it exists */
-void remove_destination()
-{
-  kb_delete(PERCEPT_DESTINATION, 0, 0);
-  game.dest_x = -1; game.dest_y = -1;
+  r = mmap(NULL, sizeof(ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(r == MAP_FAILED)
+  {
+    perror("spectate_open: mmap");
+    return 1;
+  }
+  if(r->magic != SPECTATE_MAGIC || r->frame_size != sizeof(frame))
+  {
+    memset(r, 0, sizeof(ring));
+    r->frame_size = sizeof(frame);
+    __atomic_store_n(&r->magic, SPECTATE_MAGIC, __ATOMIC_RELEASE);
+  }
+  spectator.ring = r;
+  return 0;
 }
 
 /*
- * sets a bee-line destination for the agent to navigate to this point.
- * I use destinations to force the agent to explore more of the map. It is the
- * sai-yu-sanji-kuyah (top priority) next to gold. You set a destination and the
- * agent goes there. Because i always require a coordinate in the KB for each
- * percept saved, i use (0, 0) as the coordinate in the database and keep the
- * real coordinates in the WUMPLUS struct. This simplifies many things about
- * the SQL code and prevents me from having to write another function just to
- * pull the two coordinates out.
+ * Starts publishing the current game if nothing else is. Games on other
+ * threads just go on without being watched.
  */
-void set_destination(int x, int y)
+void spectate_begin()
 {
-  kb_insert(PERCEPT_DESTINATION, 0, 0);
-  game.dest_x = x;
-  game.dest_y = y;
+  int idle = 0;
+  if(!spectator.ring || game.publishing ||
+     !__atomic_compare_exchange_n(&spectator.busy, &idle, 1, 0,
+       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return;
+  memset(&game.spectate, 0, sizeof(frame));
+  game.spectate.seed = game.seed;
+  game.publishing = 1;
 }
 
-/* does a destination exist? */
-int has_destination()
+/*
+ * Notes a change to the kb for the next frame. With --speculate whatever the
+ * planner changes while it decides happens on its own thread and is missed.
+ */
+void spectate_delta(int sentence, int x, int y)
 {
-  if(kb_found(PERCEPT_DESTINATION, 0, 0))
-    return 1;
-  return 0;
+  kb_delta *d;
+  if(game.spectate.deltas < SPECTATE_DELTAS)
+  {
+    d = &game.spectate.delta[game.spectate.deltas];
+    d->sentence = sentence;
+    d->x = x;
+    d->y = y;
+  }
+  game.spectate.deltas++;
 }
 
-/* is the agent is at the destination? */
-int at_destination()
+/*
+ * Writes out the turn that just happened. The slot is marked as being
+ * written, filled in and then marked with the frame it holds before the head
+ * moves on to it, all without waiting on anybody.
+ */
+void spectate_publish()
 {
-  if(has_destination() && game.x == game.dest_x && game.y == game.dest_y)
-    return 1;
-  return 0;
+  ring *r = spectator.ring;
+  frame *f;
+  unsigned long long n;
+  if(!game.publishing)
+    return;
+  
+  game.spectate.x = game.x;
+  game.spectate.y = game.y;
+  game.spectate.percepts = game.percepts;
+  game.spectate.score = game.score;
+  game.spectate.arrows = game.arrows;
+  game.spectate.has_gold = game.has_gold;
+  
+  n = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+  f = &r->frames[n % SPECTATE_FRAMES];
+  game.spectate.seq = 2 * n + 1;
+  __atomic_store_n(&f->seq, 2 * n + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(f, &game.spectate, sizeof(frame));
+  __atomic_store_n(&f->seq, 2 * n + 2, __ATOMIC_RELEASE);
+  __atomic_store_n(&r->head, n + 1, __ATOMIC_RELEASE);
+  
+  game.spectate.turn++;
+  game.spectate.action = 0;
+  game.spectate.deltas = 0;
 }
 
-/* is the agent is at the starting position? */
-int at_start()
+/* lets another game have the ring */
+void spectate_end()
 {
-  return game.x == 1 && game.y == 1;
+  if(!game.publishing)
+    return;
+  game.publishing = 0;
+  __atomic_store_n(&spectator.busy, 0, __ATOMIC_RELEASE);
 }
 
-/* callback to see if an unvisited safe square has been found */
-static int huss_callback(void *found, int argc, char **argv, char **cols)
+/*
+ * The viewer. Follows the ring from whatever is newest and prints a line for
+ * every frame, with the kb changes after it. Frames that were written over
+ * before they could be read are counted instead. Runs until it is killed.
+ */
+int run_watch(const char *path)
 {
-  int x = atoi(argv[1]), y = atoi(argv[2]);
-  if(!*((int *)found) && !visited(x, y) && !wall(x, y))
+  int fd = open(path, O_RDONLY), i;
+  ring *r;
+  frame copy, *f;
+  const char *sep;
+  unsigned long long next, head, seq;
+  long long missed = 0;
+  
+  if(fd < 0)
   {
-    *((int *)found) = 1;
-    set_destination(x, y);
+    perror("run_watch");
+    return 1;
+  }
+  r = mmap(NULL, sizeof(ring), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(r == MAP_FAILED)
+  {
+    perror("run_watch: mmap");
+    return 1;
+  }
+  if(__atomic_load_n(&r->magic, __ATOMIC_ACQUIRE) != SPECTATE_MAGIC ||
+     r->frame_size != sizeof(frame))
+  {
+    fprintf(stderr, "run_watch: %s is not a spectator stream\n", path);
+    return 1;
+  }
+  
+  next = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+  while(1)
+  {
+    head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    /* the ring was made over, start again from there */
+    if(next > head)
+      next = head;
+    if(next == head)
+    {
+      usleep(10000);
+      continue;
+    }
+    if(head - next > SPECTATE_FRAMES)
+    {
+      missed += head - SPECTATE_FRAMES - next;
+      next = head - SPECTATE_FRAMES;
+    }
+    
+    f = &r->frames[next % SPECTATE_FRAMES];
+    seq = __atomic_load_n(&f->seq, __ATOMIC_ACQUIRE);
+    if(seq == 2 * next + 1)
+      continue;
+    memcpy(&copy, f, sizeof(frame));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(seq != 2 * next + 2 || __atomic_load_n(&f->seq, __ATOMIC_RELAXED) != seq)
+    {
+      missed++;
+      next++;
+      continue;
+    }
+    next++;
+    
+    if(missed)
+      printf("(missed %lld frames)\n", missed);
+    missed = 0;
+    if(copy.action == 0)
+      printf("\nSeed: %u\n", copy.seed);
+    printf("%4d %c (%d, %d) Score: %5d Arrows: %d%s [", copy.turn,
+      copy.action ? copy.action : '-', copy.x, copy.y, copy.score,
+      copy.arrows, copy.has_gold ? " Gold" : "");
+    for(i = 1, sep = ""; i <= PERCEPT_DEAD; i <<= 1)
+      if(copy.percepts & i)
+      {
+        printf("%s%s", sep, word_from_percept(i));
+        sep = ",";
+      }
+    printf("]");
+    for(i = 0; i < copy.deltas && i < SPECTATE_DELTAS; i++)
+      printf(" %c%s(%d,%d)", copy.delta[i].sentence < 0 ? '-' : '+',
+        word_from_percept(abs(copy.delta[i].sentence)), copy.delta[i].x,
+        copy.delta[i].y);
+    if(copy.deltas > SPECTATE_DELTAS)
+      printf(" and %d more", copy.deltas - SPECTATE_DELTAS);
+    printf("\n");
+    fflush(stdout);
   }
   return 0;
 }
 
-/* finds a random unvisited safe square and sets the destination thusly */
-int has_unvisited_safe_squares()
+/* starts the event log in path and the thread that writes it */
+int log_open(const char *path)
 {
-  int res = 0, found = 0;
-  char query[128], *err_msg;
+  log_header header = { LOG_MAGIC, sizeof(event) };
   
-  sprintf(query, "SELECT * FROM kb WHERE sentence = %d ORDER BY random();",
-    PERCEPT_SAFE);
-  res = sqlite3_exec(game.db, query, huss_callback, &found, &err_msg);
-  if(res != SQLITE_OK)
+  event_log.fp = fopen(path, "wb");
+  if(event_log.fp == NULL ||
+     fwrite(&header, sizeof(header), 1, event_log.fp) != 1)
   {
-    fprintf(stderr, "HAS_UNVISITED_SAFE_SQUARES: %s\n", err_msg);
-    sqlite3_free(err_msg);
+    perror("log_open");
+    return 1;
   }
-  return found;
+  pthread_mutex_init(&event_log.lock, NULL);
+  pthread_key_create(&event_log.key, log_detach);
+  event_log.running = 1;
+  if(pthread_create(&event_log.thread, NULL, log_writer, NULL))
+  {
+    fprintf(stderr, "LOG_OPEN: can not start the writer thread\n");
+    fclose(event_log.fp);
+    event_log.fp = NULL;
+    return 1;
+  }
+  atexit(log_close);
+  return 0;
 }
 
-/* returns a direction to the requested square from the relative player pos. */
-char relative_direction(int x, int y)
+/* gives the thread a ring of its own and hands it to the writer */
+event_ring *log_attach()
 {
-  if(x == game.x)
-    return (game.y < y ? 's' : 'n');
-  if(y == game.y)
-    return (game.x < x ? 'e' : 'w');
-  return 'q';
+  event_ring *r = calloc(1, sizeof(event_ring));
+  if(r == NULL)
+    return NULL;
+  pthread_mutex_lock(&event_log.lock);
+  r->next = event_log.rings;
+  event_log.rings = r;
+  pthread_mutex_unlock(&event_log.lock);
+  pthread_setspecific(event_log.key, r);
+  log_ring = r;
+  return r;
 }
 
-/*
- * determines if two squares are neighbors.
- * returns a boolean if the delta between the two coordinates is one.
- */
-int neighbors(int x1, int y1, int x2, int y2)
+/* the thread is done, its ring goes once the writer has emptied it */
+static void log_detach(void *r)
 {
-  int xd = abs(x2 - x1), yd = abs(y2 - y1);
-  if(xd > 1 || yd > 1 || xd + yd > 1 || xd + xd == 0)
-    return 0;
-  return 1;
+  __atomic_store_n(&((event_ring *)r)->closed, 1, __ATOMIC_RELEASE);
 }
 
 /*
- * will return a char for the next step to get to the given square
- *
- * This function performs a breadth-first search to find the requested square.
- * It also uses a modified A* approach to this. I use the idea of cost-to-next
- * square-plus-heuristic to figure out where to go next. I use the breadth-first
- * traversal and calculate the cost to the destination from that square. It
- * adds one to the weights as it goes out. When you reach the player's square
- * you only have to choose the smallest non-zero square to determine the best
- * direction of travel.
- *
- * This is a lot of complication for a lot of simplification on the game side
- * This is probably the hardest part of the whole program. 'Knowing' things
- * about what you see is easy, inferring this is pretty easy. Getting there.
- * That's complication.
- *
- * This algorithm is also completely capable of navigating 'walls' of obstackles
- * in the game. Pits, walls, wumpuses, supmuws, whatever. It can get around it.
- *
- * ==General procedure==
- * Unmark and set weights to 0 for all squares.
- * Set weight to 1 for destination square.
- * Enqueue the destination.
- * While queue is not empty:
- *  Dequeue first item
- *  Skip if wall, not safe or marked
- *  Mark item
- *  Enqueue all four sides
- *  Set weights on all four sides to one plus current weight,
- *   if weight is zero or larger than desired weight
- * Dump queue
- * Zero all weights for walls or unsafe/unvisited squares
- * Find smallest weight neighboring the player's position
- * Go there.
+ * puts an event in the thread's ring if the game logs that kind of thing.
+ * never waits, a full ring just drops it.
  */
-char shortest_path()
+void log_event(int type, int x, int y, int value)
 {
-  int i = 0, j = 0, marked[MAP_SIZE][MAP_SIZE], weights[MAP_SIZE][MAP_SIZE];
-  coordinate possibles[MAP_SIZE][MAP_SIZE], temp, min;
-  int new_weight = 0;
-  char *queue = "queue";
+  event_ring *r = log_ring;
+  event *e;
+  unsigned long long head;
   
-  for(i = 0; i < MAP_SIZE; i++)
+  if(game.log_level < event_levels[type])
+    return;
+  if(r == NULL && (r = log_attach()) == NULL)
+    return;
+  head = r->head;
+  if(head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == LOG_EVENTS)
   {
-    for(j = 0; j < MAP_SIZE; j++)
-    {
-      marked[i][j] = 0;
-      weights[i][j] = 0;
-      possibles[i][j].x = i;
-      possibles[i][j].y = j;
-    }
+    r->dropped++;
+    return;
   }
+  e = &r->events[head % LOG_EVENTS];
+  e->seed = game.seed;
+  e->steps = game.steps_taken;
+  e->type = type;
+  e->x = x;
+  e->y = y;
+  e->value = value;
+  __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * writes out whatever is in the rings, and frees the ones whose thread is
+ * gone. returns how many events that was.
+ */
+int log_drain()
+{
+  event_ring **p, *r;
+  unsigned long long head, tail, n;
+  int closed, written = 0;
   
-  temp.x = -1;
-  temp.y = -1;
-  min.x = -1;
-  min.y = -1;
-  weights[game.dest_x][game.dest_y] = 1;
-  queue_enqueue(queue, &possibles[game.dest_x][game.dest_y]);
-  
-  while(!queue_empty(queue))
+  pthread_mutex_lock(&event_log.lock);
+  for(p = &event_log.rings; (r = *p) != NULL;)
   {
-    queue_dequeue(queue, &temp);
-    if(wall(temp.x, temp.y) || !safe(temp.x, temp.y) || marked[temp.x][temp.y])
-      continue;
-    
-    marked[temp.x][temp.y] = 1;
-    queue_enqueue(queue, &possibles[temp.x - 1][temp.y]);
-    queue_enqueue(queue, &possibles[temp.x + 1][temp.y]);
-    queue_enqueue(queue, &possibles[temp.x][temp.y - 1]);
-    queue_enqueue(queue, &possibles[temp.x][temp.y + 1]);
-    
-    new_weight = weights[temp.x][temp.y] + 1;
-    if(weights[temp.x - 1][temp.y] == 0 ||
-       weights[temp.x - 1][temp.y] > new_weight)
-    {
-      weights[temp.x - 1][temp.y] = new_weight;
-    }
-    if(weights[temp.x + 1][temp.y] == 0 ||
-       weights[temp.x + 1][temp.y] > new_weight)
+    closed = __atomic_load_n(&r->closed, __ATOMIC_ACQUIRE);
+    head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    /* up to the end of the ring at a time */
+    for(tail = r->tail; tail < head; tail += n)
     {
-      weights[temp.x + 1][temp.y] = new_weight;
+      n = LOG_EVENTS - tail % LOG_EVENTS;
+      n = n < head - tail ? n : head - tail;
+      fwrite(&r->events[tail % LOG_EVENTS], sizeof(event), n, event_log.fp);
+      written += n;
     }
-    if(weights[temp.x][temp.y - 1] == 0 ||
-       weights[temp.x][temp.y - 1] > new_weight)
+    __atomic_store_n(&r->tail, head, __ATOMIC_RELEASE);
+    if(closed)
     {
-      weights[temp.x][temp.y - 1] = new_weight;
-    }
-    if(weights[temp.x][temp.y + 1] == 0 ||
-       weights[temp.x][temp.y + 1] > new_weight)
-    {
-      weights[temp.x][temp.y + 1] = new_weight;
+      *p = r->next;
+      event_log.dropped += r->dropped;
+      free(r);
     }
+    else
+      p = &r->next;
   }
-  queue_make_empty(queue);
+  event_log.written += written;
+  pthread_mutex_unlock(&event_log.lock);
+  return written;
+}
+
+/* the writer thread, keeps emptying the rings until the log is closed */
+static void *log_writer(void *unused)
+{
+  while(__atomic_load_n(&event_log.running, __ATOMIC_ACQUIRE))
+    if(!log_drain())
+      usleep(1000);
+  return NULL;
+}
+
+/* stops the writer, writes out the rest and says if anything was lost */
+void log_close()
+{
+  event_ring *r;
   
-  for(i = 0; i < MAP_SIZE; i++)
-    for(j = 0; j < MAP_SIZE; j++)
-      if(wall(j, i) || (!safe(j, i) && !visited(j, i)))
-        weights[j][i] = 0;
+  if(event_log.fp == NULL)
+    return;
+  __atomic_store_n(&event_log.running, 0, __ATOMIC_RELEASE);
+  pthread_join(event_log.thread, NULL);
+  log_drain();
+  for(r = event_log.rings; r; r = r->next)
+    event_log.dropped += __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+  fclose(event_log.fp);
+  event_log.fp = NULL;
+  if(event_log.dropped)
+    fprintf(stderr, "Event log: %lld events written, %lld dropped when the "
+      "writer fell behind\n", event_log.written, event_log.dropped);
+}
+
+/* prints an event log, one event to a line */
+int run_read_log(const char *path)
+{
+  FILE *fp = fopen(path, "rb");
+  log_header header;
+  event e;
   
-  new_weight = 0;
-  temp.x = game.x; temp.y = game.y;
-  if((weights[game.x - 1][game.y] < new_weight || new_weight == 0) &&
-     weights[game.x - 1][game.y])
-  {
-    new_weight = weights[game.x - 1][game.y];
-    temp.x = game.x - 1;
-    temp.y = game.y;
-  }
-  if((weights[game.x + 1][game.y] < new_weight || new_weight == 0) &&
-     weights[game.x + 1][game.y])
+  if(fp == NULL)
   {
-    new_weight = weights[game.x + 1][game.y];
-    temp.x = game.x + 1;
-    temp.y = game.y;
+    perror("run_read_log");
+    return 1;
   }
-  if((weights[game.x][game.y - 1] < new_weight || new_weight == 0) &&
-     weights[game.x][game.y - 1])
+  if(fread(&header, sizeof(header), 1, fp) != 1 ||
+     header.magic != LOG_MAGIC || header.event_size != sizeof(event))
   {
-    new_weight = weights[game.x][game.y - 1];
-    temp.x = game.x;
-    temp.y = game.y - 1;
+    fprintf(stderr, "run_read_log: %s is not an event log\n", path);
+    fclose(fp);
+    return 1;
   }
-  if((weights[game.x][game.y + 1] < new_weight || new_weight == 0) &&
-     weights[game.x][game.y + 1])
+  while(fread(&e, sizeof(event), 1, fp) == 1)
   {
-    new_weight = weights[game.x][game.y + 1];
-    temp.x = game.x;
-    temp.y = game.y + 1;
+    printf("%10u %4d %-6s (%d, %d)", e.seed, e.steps,
+      e.type >= 0 && e.type < EVENT_TYPES ? event_names[e.type] : "?", e.x,
+      e.y);
+    if(e.type == EVENT_ACTION)
+      printf(" %c", e.value);
+    else if(e.type == EVENT_SHOOT)
+      printf(" %d left", e.value);
+    else if(e.type == EVENT_KB)
+      printf(" %c%s", e.value < 0 ? '-' : '+', word_from_percept(abs(e.value)));
+    printf("\n");
   }
-  
-  return relative_direction(temp.x, temp.y);
+  fclose(fp);
+  return 0;
 }
 
-/* determines if the (perceived) wumpus is in a nearby square */
-int wumpus_nearby(coordinate *wumpus)
+/* the random key for a fact, or for one of the ZOBRIST_ kinds */
+unsigned long long zobrist_key(int kind, int x, int y)
 {
-  int found = 0;
-  if(kb_found(PERCEPT_WUMPUS, game.x - 1, game.y))
-  {
-    wumpus->x = game.x - 1;
-    wumpus->y = game.y;
-    found = 1;
-  }
-  if(kb_found(PERCEPT_WUMPUS, game.x + 1, game.y))
-  {
-    wumpus->x = game.x + 1;
-    wumpus->y = game.y;
-    found = 1;
-  }
-  if(kb_found(PERCEPT_WUMPUS, game.x, game.y - 1))
+  unsigned long long z = ((unsigned long long)kind << 40) ^
+    ((unsigned long long)(unsigned int)x << 20) ^ (unsigned int)y ^
+    ((unsigned long long)(unsigned int)y << 44);
+  z += 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/* what the agent believes right now: the kb, where it is and what it has */
+unsigned long long belief_hash()
+{
+  return game.kb_hash ^ zobrist_key(ZOBRIST_PLAYER, game.x, game.y) ^
+    (game.has_gold ? zobrist_key(ZOBRIST_GOLD, 0, 0) : 0) ^
+    zobrist_key(ZOBRIST_ARROWS, game.arrows, 0);
+}
+
+/* the entry for key in the transposition table, if it is still there */
+tt_entry *tt_probe(unsigned long long key)
+{
+  tt_entry *bucket = &look.table[(key & ((1 << TT_BITS) - 1)) * TT_WAYS];
+  int i;
+  for(i = 0; i < TT_WAYS; i++)
+    if(bucket[i].key == key && bucket[i].depth)
+      return &bucket[i];
+  return NULL;
+}
+
+/*
+ * keeps a value in the transposition table. an entry for the same state is
+ * updated unless it was searched deeper this time round, otherwise the value
+ * goes over one left from an earlier move, or else the shallowest one.
+ */
+void tt_store(unsigned long long key, double value, int depth, char action)
+{
+  tt_entry *bucket = &look.table[(key & ((1 << TT_BITS) - 1)) * TT_WAYS];
+  tt_entry *victim = &bucket[0];
+  int i;
+  for(i = 0; i < TT_WAYS; i++)
   {
-    wumpus->x = game.x;
-    wumpus->y = game.y - 1;
-    found = 1;
+    if(bucket[i].key == key)
+    {
+      if(bucket[i].age == look.age && bucket[i].depth > depth)
+        return;
+      victim = &bucket[i];
+      break;
+    }
+    if((victim->age == look.age && bucket[i].age != look.age) ||
+       ((victim->age == look.age) == (bucket[i].age == look.age) &&
+        bucket[i].depth < victim->depth))
+      victim = &bucket[i];
   }
-  if(kb_found(PERCEPT_WUMPUS, game.x, game.y + 1))
+  victim->key = key;
+  victim->value = value;
+  victim->depth = depth;
+  victim->age = look.age;
+  victim->action = action;
+}
+
+/* writes down a change the search made to the kb */
+void lookahead_journal(int sentence, int x, int y)
+{
+  kb_delta *d;
+  if(look.journal_len == look.journal_cap)
   {
-    wumpus->x = game.x;
-    wumpus->y = game.y + 1;
-    found = 1;
+    look.journal_cap = look.journal_cap ? 2 * look.journal_cap : 256;
+    look.journal = realloc(look.journal, look.journal_cap * sizeof(kb_delta));
   }
-  return found;
+  d = &look.journal[look.journal_len++];
+  d->sentence = sentence;
+  d->x = x;
+  d->y = y;
 }
 
-/*
- * gets the action from the knowledge base.
- *
- * priority of actions is as follows:
- * 1. grab if glittering and set destination to start
- * 2. kill that wumpus, if you know where he is and he is nearby.
- * 3. go to the destination, if set
- * 4. find an unvisited safe square and go there
- * 5. go back to the beginning and give up.
- *
- * The supmuw will usually be de-food-ified through the normal course of travel
- * so specific rules are not really necessary. Hunting the wumpus is viewed
- * as a 'bonus' more than a goal, so it only happens if the agent discovers
- * where the wumpus is located and then travels to a nearby square.
- */
-char kb_ask_action()
+/* puts the kb back the way it was when the journal was mark long */
+void lookahead_undo(int mark)
 {
-  coordinate wumpus;
-  wumpus.x = game.x; wumpus.y = game.y;
-  
-  /* priority one: gold */
-  if(glitter(game.x, game.y))
+  kb_delta *d;
+  look.undoing = 1;
+  while(look.journal_len > mark)
   {
-    /* if gold, stop, drop and proceed to exit */
-    remove_destination();
-    set_destination(1, 1);
-    return 'g';
+    d = &look.journal[--look.journal_len];
+    if(d->sentence > 0)
+      kb_delete(d->sentence, d->x, d->y);
+    else
+      kb_insert(-d->sentence, d->x, d->y);
   }
-  
-  /* check to see if the destination is deadly or a wall, if so, remove it */
-  if(has_destination() && (wall(game.dest_x, game.dest_y) ||
-     !safe(game.dest_x, game.dest_y)))
+  look.undoing = 0;
+}
+
+#ifndef WUMPUS_TILED_KB
+/* callback for the queries that just count */
+static int kb_count_callback(void *count, int argc, char **argv, char **cols)
+{
+  *((int *)count) = atoi(argv[0]);
+  return 0;
+}
+#endif
+
+/* how many squares the agent has been to */
+int visited_count()
+{
+  int count = 0;
+#ifdef WUMPUS_TILED_KB
+  int i;
+  /* anywhere the agent has been is safe */
+  for(i = 0; i < game.db->safe_count; i++)
+    count += visited(game.db->safe[i].x, game.db->safe[i].y);
+#else
+  char query[128], *err_msg;
+  sprintf(query, "SELECT COUNT(*) FROM kb WHERE sentence = %d;",
+    PERCEPT_VISITED);
+  if(sqlite3_exec(game.db, query, kb_count_callback, &count, &err_msg) !=
+     SQLITE_OK)
   {
-    remove_destination();
+    fprintf(stderr, "VISITED_COUNT: %s\n", err_msg);
+    sqlite3_free(err_msg);
   }
-  
-  /* kill the wumpus, if he is nearby */
-  if(smell(game.x, game.y) && game.arrows && wumpus_nearby(&wumpus))
+#endif
+  return count;
+}
+
+/* how many squares are known to be safe but have not been looked at */
+int safe_unvisited()
+{
+  int count = 0;
+#ifdef WUMPUS_TILED_KB
+  int i;
+  coordinate *square;
+  for(i = 0; i < game.db->safe_count; i++)
   {
-    return (char)((int)relative_direction(wumpus.x, wumpus.y) - 32);
+    square = &game.db->safe[i];
+    if(!visited(square->x, square->y) && !wall(square->x, square->y))
+      count++;
   }
+#else
+  char query[256], *err_msg;
+  kb_memo_entry *e;
+  int i;
   
-  /*
-   * if has destination, go there now. if we're not at the destination, then
-   * go ahead and find a new random location and go there if we have unvisited
-   * safe areas.
-   */
-  if((has_destination() && !at_destination()) || has_unvisited_safe_squares())
+  /* the lookahead's kb is all in the memo, see kb_memo_load() */
+  if(kb_memo.complete && kb_memo.db == game.db)
   {
-    return shortest_path();
+    for(i = 0; i < kb_memo.slot_count; i++)
+    {
+      e = &kb_memo.slots[i];
+      if(e->sentence == PERCEPT_SAFE && e->found && !visited(e->x, e->y) &&
+         !wall(e->x, e->y))
+        count++;
+    }
+    return count;
   }
-  
-  /*
-   * should really hunt the wumpus and find the supmuw now, but we're gonna
-   * save that for later... since the objective is only to find the gold, this
-   * part is not strictly speaking necessary. Just go back and quit...
-   */
-  if(!at_start())
+  sprintf(query, "SELECT COUNT(*) FROM kb a WHERE sentence = %d AND NOT "
+    "EXISTS (SELECT 1 FROM kb b WHERE b.x = a.x AND b.y = a.y AND "
+    "b.sentence IN (%d, %d));", PERCEPT_SAFE, PERCEPT_VISITED, PERCEPT_BUMP);
+  if(sqlite3_exec(game.db, query, kb_count_callback, &count, &err_msg) !=
+     SQLITE_OK)
   {
-    set_destination(1, 1);
-    return shortest_path();
+    fprintf(stderr, "SAFE_UNVISITED: %s\n", err_msg);
+    sqlite3_free(err_msg);
   }
-  
-  /*
-   * failure condition, just quit. can't find the gold and can't guarantee
-   * that the agent will survive any new squares.
-   */
-  return 'q';
+#endif
+  return count;
 }
 
-/* returns a word for a percept */
-char *word_from_percept(int percept)
+/* steps home over safe squares, or -1 if the kb knows no way */
+int home_distance()
 {
-  char *res = "Unknown";
-  switch(percept)
+  int n = game.reach, head = 0, tail = 0, i, x, y, x2, y2, res = -1;
+  int dx[4] = { -1, 1, 0, 0 }, dy[4] = { 0, 0, -1, 1 };
+  int *dist, *queue;
+  
+  /* the search can take the player past anywhere it has really been */
+  n = (n > game.x ? n : game.x);
+  n = (n > game.y ? n : game.y) + 3;
+  n = (n < game.size ? n : game.size);
+  if(n * n > look.cells)
   {
-    case(PERCEPT_BUMP):
-      res = "BUMP";
-      break;
-    case(PERCEPT_SMELL):
-      res = "SMELL";
-      break;
-    case(PERCEPT_BREEZE):
-      res = "BREEZE";
-      break;
-    case(PERCEPT_MOO):
-      res = "MOO";
-      break;
-    case(PERCEPT_GLITTER):
-      res = "GLITTER";
-      break;
-    case(PERCEPT_DEAD):
-      res = "DEAD";
-      break;
-    case(PERCEPT_WUMPUS):
-      res = "WUMPUS";
-      break;
-    case(PERCEPT_SUPMUW):
-      res = "SUPMUW";
-      break;
-    case(PERCEPT_PIT):
-      res = "PIT";
-      break;
-    case(PERCEPT_SAFE):
-      res = "SAFE";
-      break;
-    case(PERCEPT_VISITED):
-      res = "VISITED";
-      break;
-    case(PERCEPT_DESTINATION):
-      res = "DESTINATION";
+    look.cells = n * n;
+    look.dist = realloc(look.dist, look.cells * sizeof(int));
+    look.queue = realloc(look.queue, look.cells * sizeof(int));
+  }
+  dist = look.dist;
+  queue = look.queue;
+  for(i = 0; i < n * n; i++)
+    dist[i] = -1;
+  dist[game.x * n + game.y] = 0;
+  queue[tail++] = game.x * n + game.y;
+  while(head < tail)
+  {
+    x = queue[head] / n; y = queue[head++] % n;
+    if(x == 1 && y == 1)
+    {
+      res = dist[x * n + y];
       break;
+    }
+    for(i = 0; i < 4; i++)
+    {
+      x2 = x + dx[i]; y2 = y + dy[i];
+      if(x2 < 0 || y2 < 0 || x2 >= n || y2 >= n || dist[x2 * n + y2] >= 0 ||
+         wall(x2, y2) || !safe(x2, y2))
+        continue;
+      dist[x2 * n + y2] = dist[x * n + y] + 1;
+      queue[tail++] = x2 * n + y2;
+    }
   }
   return res;
 }
 
-/* private callback for printing out each row of the knowledge base */
-static int kb_dump_callback(void *x, int argc, char **argv, char **cols)
+/*
+ * the odds that x, y holds a pit or a live wumpus. a visited neighbor without
+ * a breeze (or smell) rules them out, one with it means the square is one of
+ * the neighbor's unknown squares, otherwise it is as likely as anywhere.
+ */
+double death_chance(int x, int y)
 {
-  fprintf(stderr, "%4d: %7s: (%2d, %2d)\n", *((int *)x),
-    (argv[0] ? word_from_percept(atoi(argv[0])) : "NULL"),
-    atoi(argv[1]), atoi(argv[2]));
-  *((int *)x) = *((int *)x) + 1;
-  return 0;
+  int dx[4] = { -1, 1, 0, 0 }, dy[4] = { 0, 0, -1, 1 };
+  int kinds[2] = { PERCEPT_BREEZE, PERCEPT_SMELL };
+  double chance[2], alive = 1;
+  int i, j, k, unknown, x2, y2;
+  
+  if(safe(x, y))
+    return 0;
+  if(kb_found(PERCEPT_PIT, x, y) || kb_found(PERCEPT_WUMPUS, x, y))
+    return 1;
+  chance[0] = game.pit_ratio;
+  chance[1] = 1 / look.unvisited;
+  for(k = 0; k < 2; k++)
+  {
+    for(i = 0; i < 4 && chance[k] > 0; i++)
+    {
+      x2 = x + dx[i]; y2 = y + dy[i];
+      if(!visited(x2, y2))
+        continue;
+      if(!kb_found(kinds[k], x2, y2))
+      {
+        chance[k] = 0;
+        break;
+      }
+      for(j = 0, unknown = 0; j < 4; j++)
+        if(!safe(x2 + dx[j], y2 + dy[j]) && !wall(x2 + dx[j], y2 + dy[j]))
+          unknown++;
+      if(unknown && 1. / unknown > chance[k])
+        chance[k] = 1. / unknown;
+    }
+    alive *= 1 - chance[k];
+  }
+  return 1 - alive;
 }
 
-/* dumps the kb's contents to stderr; sorts on value then on column then row */
-void kb_dump()
+/* the odds of feeling a percept on x, y, which nobody has been to yet */
+double percept_chance(int percept, int x, int y)
 {
-  int res = 0, counter = 1;
-  char *err_msg;
+  int dx[4] = { -1, 1, 0, 0 }, dy[4] = { 0, 0, -1, 1 };
+  int i, unknown = 0, cause = 0;
   
-  fprintf(stderr, "Knowledge Base Dump\n");
-  res = sqlite3_exec(game.db, "SELECT * FROM kb ORDER BY sentence, y, x;",
-    kb_dump_callback, (void *)&counter, &err_msg);
-  if(res != SQLITE_OK)
+  if(percept == PERCEPT_GLITTER)
+    return game.has_gold ? 0 : 1 / look.unvisited;
+  switch(percept)
   {
-    fprintf(stderr, "KB_DUMP: %s\n", err_msg);
-    sqlite3_free(err_msg);
+    case PERCEPT_BREEZE: cause = PERCEPT_PIT; break;
+    case PERCEPT_SMELL: cause = PERCEPT_WUMPUS; break;
+    case PERCEPT_MOO: cause = PERCEPT_SUPMUW; break;
+  }
+  for(i = 0; i < 4; i++)
+  {
+    if(kb_found(cause, x + dx[i], y + dy[i]))
+      return 1;
+    if(!safe(x + dx[i], y + dy[i]) && !wall(x + dx[i], y + dy[i]))
+      unknown++;
   }
+  if(percept == PERCEPT_BREEZE)
+    return 1 - pow(1 - game.pit_ratio, unknown);
+  return unknown / look.unvisited < 1 ? unknown / look.unvisited : 1;
 }
 
-/* empties a queue */
-void queue_make_empty(const char *mylist)
+/*
+ * how good things look where the search stops. with the gold it is the gold
+ * less the walk home, without it the chance the gold is on one of the safe
+ * squares left to look at.
+ */
+double lookahead_leaf()
 {
-  int res = 0;
-  char query[128], *err_msg;
-  sprintf(query, "DELETE FROM queue WHERE name = '%s';", mylist);
-  res = sqlite3_exec(game.db, query, NULL, 0, &err_msg);
-  if(res != SQLITE_OK)
+  int d;
+  if(game.has_gold)
   {
-    fprintf(stderr, "QUEUE_MAKE_EMPTY: %s\n", err_msg);
-    sqlite3_free(err_msg);
+    d = home_distance();
+    return d < 0 ? 0 : SCORE_GOLD + d * SCORE_MOVE;
   }
+  return SCORE_GOLD * (safe_unvisited() / look.unvisited);
 }
 
-/* private callback to check if the number of items in a queue is empty */
-static int queue_empty_callback(void *empty, int argc, char **argv, char **cols)
+/* actions worth looking into from here, anything else is a waste of time */
+int lookahead_allowed(char action)
 {
-  int result = atoi(argv[0]);
-  if(result > 0)
-    *((int *)empty) = 0;
-  return 0;
+  int x2 = game.x, y2 = game.y;
+  delta_coordinates(&x2, &y2, command_direction(action));
+  if(action == 'g')
+    return glitter(game.x, game.y);
+  if(action >= 'a')
+    return !wall(x2, y2) && death_chance(x2, y2) < 1;
+  return game.arrows && smell(game.x, game.y) && !wall(x2, y2) &&
+    !safe(x2, y2);
 }
 
-/* is the queue empty */
-int queue_empty(const char *mylist)
+/*
+ * the odds of each of the n ways the action could turn out, going by what the
+ * kb knows. returns the odds that it kills the agent instead, which none of
+ * them cover. needs look.unvisited.
+ */
+double outcome_chances(char action, outcome *list, int n, double *chance)
 {
-  int res = 0, empty = 1;
-  char query[128], *err_msg;
-  sprintf(query, "SELECT COUNT(*) FROM queue WHERE name = '%s';", mylist);
-  res = sqlite3_exec(game.db, query, queue_empty_callback, &empty, &err_msg);
-  if(res != SQLITE_OK)
+  static const int kinds[4] = { PERCEPT_SMELL, PERCEPT_BREEZE, PERCEPT_MOO,
+    PERCEPT_GLITTER };
+  double feel[4], death = 0, bump = 0, hit = 0;
+  int i, k, fresh, x2 = game.x, y2 = game.y;
+  
+  delta_coordinates(&x2, &y2, command_direction(action));
+  fresh = action >= 'a' && action != 'g' && !visited(x2, y2);
+  if(fresh)
   {
-    fprintf(stderr, "QUEUE_EMPTY: %s\n", err_msg);
-    sqlite3_free(err_msg);
+    bump = game.wall_ratio;
+    death = (1 - bump) * death_chance(x2, y2);
+    for(k = 0; k < 4; k++)
+      feel[k] = percept_chance(kinds[k], x2, y2);
+  }
+  else if(action < 'a')
+  {
+    /* a sure thing if the kb found the wumpus, otherwise a guess */
+    if(kb_found(PERCEPT_WUMPUS, x2, y2))
+      hit = 1;
+    else if(smell(game.x, game.y))
+    {
+      for(k = 0; k < 4; k++)
+      {
+        x2 = game.x; y2 = game.y;
+        delta_coordinates(&x2, &y2, k + 1);
+        hit += !safe(x2, y2) && !wall(x2, y2);
+      }
+      hit = hit ? 1 / hit : 0;
+    }
+  }
+  for(i = 0; i < n; i++)
+  {
+    chance[i] = 1;
+    if(list[i].percepts & PERCEPT_BUMP)
+      chance[i] = bump;
+    else if(fresh)
+    {
+      chance[i] = 1 - bump - death;
+      for(k = 0; k < 4; k++)
+        chance[i] *= list[i].percepts & kinds[k] ? feel[k] : 1 - feel[k];
+    }
+    else if(action < 'a')
+      /* only the wumpus is ever shot at, and it takes the smell with it */
+      chance[i] = !list[i].heard_scream ? 1 - hit :
+        !(list[i].percepts & PERCEPT_SMELL) &&
+        (list[i].percepts & PERCEPT_MOO) == (game.percepts & PERCEPT_MOO) ?
+        hit : 0;
   }
-  return empty;
+  return death;
 }
 
-/* adds a coordinate into the queue */
-void queue_enqueue(const char *mylist, coordinate *data)
+/*
+ * what the action is worth on average over the ways it could turn out, each
+ * looked into depth - 1 more moves. the gold only counts once it is home.
+ */
+double lookahead_q(char action, int depth)
 {
-  int res = 0;
-  char query[128], *err_msg;
+  outcome list[SPECULATE_MAX], saved;
+  double chance[SPECULATE_MAX], death, total = 0, value = 0, reward;
+  int i, n, mark, fresh, x2 = game.x, y2 = game.y;
   
-  sprintf(query, "INSERT INTO queue (name, x, y) VALUES ('%s', %d, %d);",
-    mylist, data->x, data->y);
-  res = sqlite3_exec(game.db, query, NULL, 0, &err_msg);
-  if(res != SQLITE_OK)
+  if(action == 'q')
+    return 0;
+  delta_coordinates(&x2, &y2, command_direction(action));
+  reward = action == 'g' ? 0 : action >= 'a' ? SCORE_MOVE : SCORE_SHOOT;
+  if(action >= 'a' && action != 'g' && game.has_gold && x2 == 1 && y2 == 1)
+    return reward + SCORE_GOLD;
+  
+  n = speculate_outcomes(action, list);
+  fresh = action >= 'a' && action != 'g' && !visited(x2, y2);
+  death = outcome_chances(action, list, n, chance);
+  for(i = 0; i < n; i++)
   {
-    fprintf(stderr, "QUEUE_ENQUEUE: %s\n", err_msg);
-    sqlite3_free(err_msg);
+    if(chance[i] < LOOKAHEAD_PRUNE)
+      chance[i] = 0;
+    total += chance[i];
+  }
+  if(total <= 0)
+    return reward + death * SCORE_DEATH;
+  
+  for(i = 0; i < n && !deadline_passed(); i++)
+  {
+    if(!chance[i])
+      continue;
+    saved.x = game.x; saved.y = game.y; saved.percepts = game.percepts;
+    saved.arrows = game.arrows; saved.has_gold = game.has_gold;
+    saved.heard_scream = game.heard_scream;
+    mark = look.journal_len;
+    if(fresh && !(list[i].percepts & PERCEPT_BUMP))
+      look.unvisited--;
+    outcome_apply(action, &list[i]);
+    value += chance[i] / total * ((list[i].heard_scream ? SCORE_KILL : 0) +
+      lookahead_value(depth - 1));
+    lookahead_undo(mark);
+    if(fresh && !(list[i].percepts & PERCEPT_BUMP))
+      look.unvisited++;
+    game.x = saved.x; game.y = saved.y; game.percepts = saved.percepts;
+    game.arrows = saved.arrows; game.has_gold = saved.has_gold;
+    game.heard_scream = saved.heard_scream;
   }
+  return reward + death * SCORE_DEATH + (1 - death) * value;
 }
 
-/* private callback for dequeue to return the coordinate */
-static int dequeue_callback(void *coord, int argc, char **argv, char **cols)
+/*
+ * the expectimax. the best the agent can expect from here looking depth moves
+ * ahead, quitting being worth nothing. states seen before, this move or an
+ * earlier one, come out of the transposition table if they were searched at
+ * least as deep.
+ */
+double lookahead_value(int depth)
 {
-  coordinate *mycoord = (coordinate *)coord;
-  mycoord->x = atoi(argv[2]);
-  mycoord->y = atoi(argv[3]);
-  return 0;
+  static const char actions[] = "neswNESWg";
+  unsigned long long key;
+  tt_entry *entry;
+  double best = 0, value;
+  char choice = 'q';
+  int i;
+  
+  if(depth == 0 || deadline_passed())
+    return lookahead_leaf();
+  key = belief_hash();
+  if((entry = tt_probe(key)) && entry->depth >= depth)
+  {
+    look.hits++;
+    return entry->value;
+  }
+  look.nodes++;
+  for(i = 0; actions[i]; i++)
+  {
+    if(!lookahead_allowed(actions[i]))
+      continue;
+    value = lookahead_q(actions[i], depth);
+    if(value > best)
+    {
+      best = value;
+      choice = actions[i];
+    }
+  }
+  /* a search that ran out of time stopped short, do not keep it */
+  if(!game.out_of_time)
+    tt_store(key, best, depth, choice);
+  return best;
 }
 
-/* removes an item from the queue and returns the values into *result */
-void queue_dequeue(const char *mylist, coordinate *result)
+/*
+ * asks the kb what to do and then looks ahead to see if anything else is
+ * clearly better, a move deeper each time round until game.lookahead or the
+ * move budget. a few moves is too short a look to beat the kb at getting
+ * around, and an arrow shot on a guess is not there later when the kb pins
+ * the wumpus down, so the search only gets a say once the kb has given up on
+ * the gold. then quitting on the spot, a shot in the dark or a step into the
+ * unknown can all beat walking home, if they win by LOOKAHEAD_MARGIN.
+ */
+char lookahead_action()
 {
-  int res = 0;
-  char query[128], *err_msg;
+  static const char actions[] = "neswNESWgq";
+  char choice = kb_ask_action(), best = choice, found;
+  double kb_value = 0, best_value = 0, value, asked, found_value;
+  int depth, i, giving_up;
   
-  sprintf(query,
-    "SELECT * FROM queue WHERE name = '%s' ORDER BY id ASC LIMIT 1;",
-    mylist);
-  res = sqlite3_exec(game.db, query, dequeue_callback, result, &err_msg);
-  if(res != SQLITE_OK)
+  giving_up = !game.has_gold && (choice == 'q' || (has_destination() &&
+    game.dest_x == 1 && game.dest_y == 1));
+  if(!giving_up)
+    return choice;
+  
+  /* every game starts with an empty table, see end_game() */
+  if(!look.table)
   {
-    fprintf(stderr, "QUEUE_DEQUEUE: %s\n", err_msg);
-    sqlite3_free(err_msg);
+    look.table = aligned_alloc(64, sizeof(tt_entry) * TT_WAYS << TT_BITS);
+    memset(look.table, 0, sizeof(tt_entry) * TT_WAYS << TT_BITS);
   }
+  look.age++;
+  look.unvisited = (double)(game.size - 2) * (game.size - 2) - visited_count();
+  if(look.unvisited < 1)
+    look.unvisited = 1;
   
-  sprintf(query,
-    "DELETE FROM queue WHERE name = '%s' AND x = %d AND y = %d;",
-    mylist, result->x, result->y);
-  res = sqlite3_exec(game.db, query, NULL, 0, &err_msg);
-  if(res != SQLITE_OK)
+  /* the SQL kb is searched in memory, see kb_memo_load() */
+#ifndef WUMPUS_TILED_KB
+  kb_memo_load();
+#endif
+  look.searching = 1;
+  for(depth = 1; depth <= game.lookahead; depth++)
   {
-    fprintf(stderr, "QUEUE_DEQUEUE: %s\n", err_msg);
-    sqlite3_free(err_msg);
+    asked = found_value = lookahead_q(choice, depth);
+    found = choice;
+    for(i = 0; actions[i] && !game.out_of_time; i++)
+    {
+      if(actions[i] == choice || (actions[i] != 'q' &&
+         !lookahead_allowed(actions[i])))
+        continue;
+      value = lookahead_q(actions[i], depth);
+      if(value > found_value)
+      {
+        found_value = value;
+        found = actions[i];
+      }
+    }
+    /* only a search that finished is any good */
+    if(game.out_of_time)
+      break;
+    kb_value = asked;
+    best = found;
+    best_value = found_value;
+  }
+  look.searching = 0;
+#ifndef WUMPUS_TILED_KB
+  kb_memo.complete = 0;
+#endif
+  
+  if(best != choice && best_value > kb_value + LOOKAHEAD_MARGIN)
+  {
+    message("lookahead: %c instead of %c (%.1f over %.1f)\n", best, choice,
+      best_value, kb_value);
+    remove_destination();
+    return best;
   }
+  return choice;
 }